@@ -0,0 +1,89 @@
+/*
+ * Memory bandwidth aggressor: a streaming read, write or copy kernel pinned
+ * to one core.
+ *
+ * Usage: ./bw_stress -c <cpu> [-k read|write|copy] [-s <MB>] [-i <intensity %>] [-d <sec>]
+ * Prints "cpu=<cpu> kernel=<kernel> intensity=<%> mb_s=<achieved MB/s>".
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sched.h>
+#include "bw_kernels.h"
+
+static volatile int stop_requested = 0;
+
+static void handle_stop(int sig) {
+    (void)sig;
+    stop_requested = 1;
+}
+
+static void usage(const char* prog) {
+    fprintf(stderr,
+            "Usage: %s -c <cpu> [-k read|write|copy] [-s <MB>] [-i <intensity %%>] [-d <sec>]\n"
+            "  -k  kernel (default: read)\n"
+            "  -s  buffer size, larger than the LLC (default: 64)\n"
+            "  -i  share of each 1 ms slot spent streaming (default: 100)\n"
+            "  -d  duration, 0: until SIGINT/SIGTERM (default: 10)\n",
+            prog);
+}
+
+int main(int argc, char* argv[]) {
+    struct bw_kernel kernel;
+    enum bw_kernel_type type = BW_KERNEL_READ;
+    int cpu = -1, intensity = 100, opt;
+    size_t size_mb = 64;
+    double duration = 10;
+    uint64_t start, bytes;
+    cpu_set_t set;
+
+    while ((opt = getopt(argc, argv, "c:k:s:i:d:h")) != -1) {
+        switch (opt) {
+        case 'c': cpu = atoi(optarg); break;
+        case 'k':
+            if (bw_kernel__parse_type(optarg, &type) < 0) {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 's': size_mb = strtoul(optarg, NULL, 0); break;
+        case 'i': intensity = atoi(optarg); break;
+        case 'd': duration = atof(optarg); break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    if (cpu < 0 || size_mb == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) < 0) {
+        perror("sched_setaffinity");
+        return 1;
+    }
+
+    signal(SIGINT, handle_stop);
+    signal(SIGTERM, handle_stop);
+
+    if (bw_kernel__init(&kernel, type, size_mb << 20, intensity) < 0)
+        return 1;
+
+    start = bw_kernel__now_ns();
+    bytes = bw_kernel__run(&kernel, duration > 0 ? (uint64_t)(duration * 1e9) : UINT64_MAX, &stop_requested);
+
+    printf("cpu=%d kernel=%s intensity=%d mb_s=%.1f\n", cpu, bw_kernel__type_name(type), kernel.intensity,
+           bytes / (1024.0 * 1024.0) / ((bw_kernel__now_ns() - start) / 1e9));
+
+    bw_kernel__destroy(&kernel);
+
+    return 0;
+}
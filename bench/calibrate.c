@@ -0,0 +1,316 @@
+/*
+ * Cost table calibration: measures the bytes behind one counted event, to
+ * be loaded into /sys/kernel/debug/cl_mem_reg/cost_table.
+ *
+ * Cores: runs the streaming read, write and copy kernels pinned to each core
+ * and counts the module's read event (or the generic cache-miss event) for
+ * the same footprint.
+ * GPU: runs a blit command of a known size while the module is loaded with
+ * the GPU profiler (or fake_gpu), and compares the beats it received with
+ * the bytes the blit moved.
+ *
+ * Usage: ./calibrate [-c <cpus>] [-e raw|cache_misses] [-r <raw id>] [-s <MB>] [-d <sec>]
+ *                    [-g <cluster>:<MB> -x <blit command>]
+ * The table goes to stdout, one entry per line; the measurements to stderr.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "bw_kernels.h"
+#include "cl_mem_reg_model.h"
+#include "cl_mem_reg_stats.h"
+
+/* Same as the module's PMU_LLC_RD_COUNTER_ID */
+#if defined(__aarch64__) || defined(__arm__)
+#define DEFAULT_RAW_ID 0x2A     /* L3D_CACHE_REFILL */
+#else
+#define DEFAULT_RAW_ID 0x08b0   /* OFFCORE_REQUESTS.ALL_DATA_RD */
+#endif
+
+#define MAX_CPUS 64
+#define MAX_EVENT_BYTES 4096    /* cost_table limit */
+#define STATS_BIN "/sys/kernel/debug/cl_mem_reg/stats_bin"
+#define COST_TABLE "/sys/kernel/debug/cl_mem_reg/cost_table"
+
+static const enum bw_kernel_type kernel_types[] = {BW_KERNEL_READ, BW_KERNEL_WRITE, BW_KERNEL_COPY};
+
+static void usage(const char* prog) {
+    fprintf(stderr,
+            "Usage: %s [-c <cpus>] [-e raw|cache_misses] [-r <raw id>] [-s <MB>] [-d <sec>]\n"
+            "          [-g <cluster>:<MB> -x <blit command>]\n"
+            "  -c  cores to calibrate, e.g. 0-3,6 (default: all online)\n"
+            "  -e  counted event, as the module's counter source (default: raw)\n"
+            "  -r  raw event id (default: 0x%x, the module's default)\n"
+            "  -s  buffer size, larger than the LLC (default: 64)\n"
+            "  -d  duration per core and kernel (default: 2)\n"
+            "  -g  GPU of a cluster, and the MB its blit command moves (module loaded, GPU profiler running)\n",
+            prog, DEFAULT_RAW_ID);
+}
+
+static int parse_cpus(const char* list, int* cpus) {
+    char* copy = strdup(list);
+    char *p = copy, *tok;
+    int n = 0, first, last, i;
+
+    while ((tok = strsep(&p, ",")) != NULL) {
+        if (sscanf(tok, "%d-%d", &first, &last) != 2) {
+            if (sscanf(tok, "%d", &first) != 1)
+                goto err;
+            last = first;
+        }
+        if (first < 0 || last < first || last >= MAX_CPUS)
+            goto err;
+        for (i = first; i <= last; i++)
+            cpus[i] = 1;
+        n += last - first + 1;
+    }
+
+    free(copy);
+    return n;
+
+err:
+    free(copy);
+    return -1;
+}
+
+static int open_counter(int use_raw, uint64_t raw_id) {
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = use_raw ? PERF_TYPE_RAW : PERF_TYPE_HARDWARE;
+    attr.config = use_raw ? raw_id : PERF_COUNT_HW_CACHE_MISSES;
+    attr.disabled = 1;
+
+    /* This thread only, wherever it runs (it is pinned) */
+    return syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+/* Bytes per event of one core: all kernels together, as the module charges them alike */
+static int calibrate_cpu(int cpu, int use_raw, uint64_t raw_id, size_t size, double duration) {
+    uint64_t total_bytes = 0, total_events = 0;
+    cpu_set_t set;
+    size_t k;
+    int fd;
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) < 0) {
+        perror("sched_setaffinity");
+        return -1;
+    }
+
+    fd = open_counter(use_raw, raw_id);
+    if (fd < 0) {
+        perror("perf_event_open");
+        return -1;
+    }
+
+    for (k = 0; k < sizeof(kernel_types) / sizeof(kernel_types[0]); k++) {
+        struct bw_kernel kernel;
+        uint64_t bytes, events;
+
+        if (bw_kernel__init(&kernel, kernel_types[k], size, 100) < 0) {
+            close(fd);
+            return -1;
+        }
+
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        bytes = bw_kernel__run(&kernel, (uint64_t)(duration * 1e9), NULL);
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(fd, &events, sizeof(events)) != sizeof(events))
+            events = 0;
+
+        bw_kernel__destroy(&kernel);
+
+        fprintf(stderr, "cpu%d %-5s %10.1f MB %12llu events %8.1f B/event\n", cpu, bw_kernel__type_name(kernel_types[k]),
+                bytes / (1024.0 * 1024.0), (unsigned long long)events, events ? (double)bytes / events : 0);
+        total_bytes += bytes;
+        total_events += events;
+    }
+
+    close(fd);
+
+    if (total_events == 0) {
+        fprintf(stderr, "cpu%d: event never counted\n", cpu);
+        return -1;
+    }
+
+    return (int)((total_bytes + total_events / 2) / total_events);
+}
+
+static int read_gpu_events(int cluster, uint64_t* events) {
+    struct cl_mem_reg_stats_snapshot snapshot;
+    int fd = open(STATS_BIN, O_RDONLY);
+    ssize_t len;
+
+    if (fd < 0) {
+        perror(STATS_BIN);
+        return -1;
+    }
+    len = read(fd, &snapshot, sizeof(snapshot));
+    close(fd);
+
+    if (len != sizeof(snapshot) || snapshot.magic != CL_MEM_REG_STATS_MAGIC || snapshot.version != CL_MEM_REG_STATS_VERSION) {
+        fprintf(stderr, "%s: unexpected layout\n", STATS_BIN);
+        return -1;
+    }
+
+    *events = snapshot.cluster_total[cluster - 1].gpu_events;
+    return 0;
+}
+
+/* Bytes per read beat the module currently charges for the cluster's GPU */
+static int read_gpu_cost(int cluster) {
+    char line[64];
+    FILE* fp = fopen(COST_TABLE, "r");
+    int id, rd_bytes, wr_bytes, bytes = -1;
+
+    if (!fp) {
+        perror(COST_TABLE);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), fp))
+        if (sscanf(line, "gpu%d %d %d", &id, &rd_bytes, &wr_bytes) == 3 && id == cluster)
+            bytes = rd_bytes;
+    fclose(fp);
+
+    return bytes;
+}
+
+/*
+ * The module charges beats at the current cost, so the beats behind the
+ * charged events are events * cache line / cost. Read and write beats are
+ * taken at the read cost.
+ */
+static int calibrate_gpu(int cluster, double mb, const char* command) {
+    uint64_t before, after;
+    double beats;
+    int cost, status;
+
+    cost = read_gpu_cost(cluster);
+    if (cost <= 0 || read_gpu_events(cluster, &before) < 0)
+        return -1;
+
+    status = system(command);
+    if (status != 0) {
+        fprintf(stderr, "'%s' failed (%d)\n", command, status);
+        return -1;
+    }
+    /* Let the last GPU samples arrive */
+    usleep(100 * 1000);
+
+    if (read_gpu_events(cluster, &after) < 0)
+        return -1;
+
+    beats = (double)(after - before) * CL_MEM_REG_CACHE_LINE_SIZE / cost;
+    fprintf(stderr, "gpu%d %10.1f MB %12.0f beats %8.1f B/beat\n", cluster, mb, beats, beats ? mb * 1024 * 1024 / beats : 0);
+    if (beats < 1) {
+        fprintf(stderr, "gpu%d: no beats received, is the GPU profiler running?\n", cluster);
+        return -1;
+    }
+
+    return (int)(mb * 1024 * 1024 / beats + 0.5);
+}
+
+static int clamp_bytes(int bytes) { return bytes < 1 ? 1 : bytes > MAX_EVENT_BYTES ? MAX_EVENT_BYTES : bytes; }
+
+int main(int argc, char* argv[]) {
+    int cpus[MAX_CPUS] = {0}, bytes[MAX_CPUS];
+    int nr_cpus = 0, use_raw = 1, gpu_cluster = 0, opt, i, first, ret = 0;
+    uint64_t raw_id = DEFAULT_RAW_ID;
+    size_t size_mb = 64;
+    double duration = 2, gpu_mb = 0;
+    const char* blit_command = NULL;
+
+    while ((opt = getopt(argc, argv, "c:e:r:s:d:g:x:h")) != -1) {
+        switch (opt) {
+        case 'c':
+            nr_cpus = parse_cpus(optarg, cpus);
+            if (nr_cpus <= 0) {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'e':
+            if (strcmp(optarg, "raw") == 0) use_raw = 1;
+            else if (strcmp(optarg, "cache_misses") == 0) use_raw = 0;
+            else {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'r': raw_id = strtoull(optarg, NULL, 0); break;
+        case 's': size_mb = strtoul(optarg, NULL, 0); break;
+        case 'd': duration = atof(optarg); break;
+        case 'g':
+            if (sscanf(optarg, "%d:%lf", &gpu_cluster, &gpu_mb) != 2 || gpu_cluster < 1 ||
+                gpu_cluster > CL_MEM_REG_STATS_MAX_CLUSTERS || gpu_mb <= 0) {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'x': blit_command = optarg; break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    if (size_mb == 0 || duration <= 0 || (gpu_cluster && !blit_command)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    /* Default: every online core */
+    if (nr_cpus == 0) {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+        for (i = 0; i < n && i < MAX_CPUS; i++)
+            cpus[i] = 1;
+    }
+
+    for (i = 0; i < MAX_CPUS; i++) {
+        bytes[i] = -1;
+        if (cpus[i]) {
+            bytes[i] = calibrate_cpu(i, use_raw, raw_id, size_mb << 20, duration);
+            if (bytes[i] < 0)
+                ret = 1;
+        }
+    }
+
+    /* Ranges of neighbouring cores with the same cost, as cost_table takes them */
+    for (i = 0; i < MAX_CPUS; i++) {
+        if (bytes[i] < 0)
+            continue;
+
+        first = i;
+        while (i + 1 < MAX_CPUS && bytes[i + 1] == bytes[first])
+            i++;
+
+        if (i == first)
+            printf("cpu%d %d\n", first, clamp_bytes(bytes[first]));
+        else
+            printf("cpu%d-%d %d\n", first, i, clamp_bytes(bytes[first]));
+    }
+
+    if (gpu_cluster) {
+        int gpu_bytes = calibrate_gpu(gpu_cluster, gpu_mb, blit_command);
+
+        if (gpu_bytes < 0)
+            ret = 1;
+        else
+            printf("gpu%d %d\n", gpu_cluster, clamp_bytes(gpu_bytes));
+    }
+
+    return ret;
+}
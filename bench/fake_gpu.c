@@ -0,0 +1,158 @@
+/*
+ * Fake GPU profiler: answers cl_mem_reg's GPU sample requests with
+ * synthetic beats, so GPU accounting can be exercised on boards without a
+ * Mali GPU (or on x86).
+ *
+ * Usage: ./fake_gpu <cluster>:<MB/s>[:<write %>] [<cluster>:<MB/s>[:<write %>]]
+ * Like gpu_profiler, it writes its PID to /tmp/gpu_profiler_pid, to be
+ * passed as g_gpu_profiler_pid_clN.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include "cl_mem_reg_model.h"
+
+#define CL_MEM_REG_FORMAT "/dev/cl_mem_reg_cl%d"
+#define STOP_GPU_PROFILING_FORMAT "/sys/kernel/cl_mem_reg_cl%d/stop_gpu_bandwidth_profiling"
+#define GPU_PROFILER_PID_FILE "/tmp/gpu_profiler_pid"
+#define NUMBER_OF_CLUSTERS 2
+
+/* Same signals as gpu_profiler */
+#define GPU_PROFILING_SIGNAL_CL1 SIGUSR1
+#define GPU_PROFILING_SIGNAL_CL2 SIGUSR2
+
+struct fake_gpu_target {
+    int enabled;
+    int fd;
+    double mb;                  /* MB/s */
+    int write_pct;              /* share of write beats */
+    uint64_t last_ns;
+    double residual_beats;
+    uint64_t requests;
+};
+
+static struct fake_gpu_target targets[NUMBER_OF_CLUSTERS];
+
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void handle_request(int cluster) {
+    struct fake_gpu_target* target = &targets[cluster - 1];
+    uint64_t now = monotonic_ns();
+    double beats;
+    int gpu_beats[2];
+
+    /* The device appears once cl_mem_reg is loaded */
+    if (target->fd < 0) {
+        char path[64];
+
+        snprintf(path, sizeof(path), CL_MEM_REG_FORMAT, cluster);
+        target->fd = open(path, O_WRONLY);
+        if (target->fd < 0)
+            return;
+        target->last_ns = now;
+        return;
+    }
+
+    /* Beats since the previous sample */
+    beats = target->mb * 1024 * 1024 * ((now - target->last_ns) / 1e9) / CL_MEM_REG_GPU_BEAT_SIZE + target->residual_beats;
+    target->last_ns = now;
+    target->residual_beats = beats - (int)beats;
+
+    gpu_beats[1] = (int)beats * target->write_pct / 100;  /* write */
+    gpu_beats[0] = (int)beats - gpu_beats[1];            /* read */
+
+    target->requests++;
+    if (write(target->fd, gpu_beats, sizeof(gpu_beats)) != sizeof(gpu_beats))
+        fprintf(stderr, "Failed to write beats of cluster %d\n", cluster);
+}
+
+static void stop_gpu_bandwidth_profiling(void) {
+    char path[128];
+    int i, fd;
+
+    for (i = 0; i < NUMBER_OF_CLUSTERS; i++) {
+        if (!targets[i].enabled)
+            continue;
+
+        snprintf(path, sizeof(path), STOP_GPU_PROFILING_FORMAT, i + 1);
+        fd = open(path, O_WRONLY);
+        if (fd >= 0) {
+            if (write(fd, "0", 1) != 1)
+                perror(path);
+            close(fd);
+        }
+        if (targets[i].fd >= 0)
+            close(targets[i].fd);
+
+        printf("cluster=%d mb_s=%.1f requests=%llu\n", i + 1, targets[i].mb, (unsigned long long)targets[i].requests);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    sigset_t set;
+    siginfo_t info;
+    FILE* fp;
+    int i;
+
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <cluster>:<MB/s>[:<write %%>] [<cluster>:<MB/s>[:<write %%>]]\n", argv[0]);
+        return 1;
+    }
+
+    for (i = 0; i < NUMBER_OF_CLUSTERS; i++)
+        targets[i].fd = -1;
+
+    for (i = 1; i < argc; i++) {
+        int cluster, write_pct = 0;
+        double mb;
+
+        if (sscanf(argv[i], "%d:%lf:%d", &cluster, &mb, &write_pct) < 2 ||
+            cluster < 1 || cluster > NUMBER_OF_CLUSTERS || mb < 0 || write_pct < 0 || write_pct > 100) {
+            fprintf(stderr, "Invalid target: %s\n", argv[i]);
+            return 1;
+        }
+        targets[cluster - 1].enabled = 1;
+        targets[cluster - 1].mb = mb;
+        targets[cluster - 1].write_pct = write_pct;
+    }
+
+    fp = fopen(GPU_PROFILER_PID_FILE, "w");
+    if (!fp) {
+        perror(GPU_PROFILER_PID_FILE);
+        return 1;
+    }
+    fprintf(fp, "%d", getpid());
+    fclose(fp);
+
+    sigemptyset(&set);
+    sigaddset(&set, GPU_PROFILING_SIGNAL_CL1);
+    sigaddset(&set, GPU_PROFILING_SIGNAL_CL2);
+    sigaddset(&set, SIGINT);
+    sigaddset(&set, SIGTERM);
+    sigprocmask(SIG_BLOCK, &set, NULL);
+
+    while (1) {
+        int sig = sigwaitinfo(&set, &info);
+
+        if (sig == GPU_PROFILING_SIGNAL_CL1 && targets[0].enabled)
+            handle_request(1);
+        else if (sig == GPU_PROFILING_SIGNAL_CL2 && targets[1].enabled)
+            handle_request(2);
+        else if (sig == SIGINT || sig == SIGTERM)
+            break;
+    }
+
+    stop_gpu_bandwidth_profiling();
+
+    return 0;
+}
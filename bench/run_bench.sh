@@ -0,0 +1,207 @@
+#!/bin/bash
+
+# === Memory bandwidth regulation benchmark ===
+# Sweeps budgets, T_A and T_R. For every combination, loads cl_mem_reg,
+# runs the aggressors (bw_stress), the victim and the fake GPU, and prints one
+# CSV row per cluster:
+#   achieved bandwidth vs budget, victim latency percentiles and slowdown,
+#   regulation overhead (ticks/s, mean tick cycles), overshoot and the longest stall,
+#   release skew at period boundaries and throttle IPIs, time idle cores had their timer stopped
+#
+# Run as root from bench/ after 'make bench' and 'make kernel_module'.
+# Works on any box where the module loads (e.g. an x86 VM, where the default
+# read counter is the offcore event; with COUNTER_SOURCE=synthetic no PMU is needed).
+
+cd "$(dirname "$0")"
+
+# Sweep (space-separated lists)
+BUDGETS=${BUDGETS:-"1000 2000 4000"}        # MB/s, applied to both clusters
+AGGREGATION_PERIODS=${AGGREGATION_PERIODS:-"100 500"}  # us
+REGULATION_PERIODS=${REGULATION_PERIODS:-"5300"}       # us
+THROTTLE_POLICIES=${THROTTLE_POLICIES:-"0 1"}          # 0: core, 1: best effort
+THROTTLE_MODES=${THROTTLE_MODES:-"0 1"}                # 0: until the end of T_R, 1: duty cycle
+COORDINATED=${COORDINATED:-"1"}                        # 1: leader-driven release and throttle, 0: per core
+NOHZ_IDLE=${NOHZ_IDLE:-"0"}                            # 1: idle cores stop their timer
+
+# Workload
+DURATION=${DURATION:-10}                    # seconds per run
+KERNEL=${KERNEL:-read}                      # read, write, copy
+INTENSITY=${INTENSITY:-100}                 # %
+BUFFER_MB=${BUFFER_MB:-64}
+FAKE_GPU_MB=${FAKE_GPU_MB:-0}               # MB/s per cluster, 0: no fake GPU
+COUNTER_SOURCE=${COUNTER_SOURCE:-auto}      # synthetic: no PMU needed
+CARRY_OVER=${CARRY_OVER:-0}                 # 1: carry credit and debt over periods
+BURST_CAP_PCT=${BURST_CAP_PCT:-100}         # carry-over credit cap (% of the budget)
+SYNTHETIC_RATE_MB=${SYNTHETIC_RATE_MB:-2000} # MB/s per core with the synthetic source
+VICTIM_PRIO=${VICTIM_PRIO:-10}              # SCHED_FIFO priority of the victim (critical task)
+CRITICAL_CGROUP=${CRITICAL_CGROUP:-}        # cgroup v2 name for the victim, exempt from throttling
+
+MODULE=../cl_mem_reg.ko
+DEBUGFS=/sys/kernel/debug/cl_mem_reg
+
+NR_CPUS=$(nproc)
+if [ "$NR_CPUS" -lt 2 ]; then
+    echo "At least 2 CPUs are required"
+    exit 1
+fi
+
+# The module regulates cpus 0-3 (cluster 1) and 4-7 (cluster 2). The victim
+# runs on the last regulated core, aggressors on every other one.
+LAST_CPU=$(( NR_CPUS < 8 ? NR_CPUS - 1 : 7 ))
+VICTIM_CPU=$LAST_CPU
+AGGRESSOR_CPUS=$(seq 0 $(( LAST_CPU - 1 )))
+
+cluster_of() {
+    if [ "$1" -lt 4 ]; then echo 1; else echo 2; fi
+}
+
+# Field 'key' of the stats line starting with 'prefix'
+stats_field() {
+    grep "^$2 scope=total" "$1" | tr ' ' '\n' | grep "^$3=" | cut -d= -f2
+}
+
+# The victim is the critical task: SCHED_FIFO, optionally in the critical cgroup
+run_victim() {
+    if [ -n "$CRITICAL_CGROUP" ]; then
+        sh -c "echo \$\$ > /sys/fs/cgroup/$CRITICAL_CGROUP/cgroup.procs && exec chrt -f $VICTIM_PRIO ./victim -c $VICTIM_CPU -s $BUFFER_MB -d $DURATION $1"
+    else
+        chrt -f $VICTIM_PRIO ./victim -c $VICTIM_CPU -s $BUFFER_MB -d $DURATION $1
+    fi
+}
+
+if [ ! -f "$MODULE" ]; then
+    echo "$MODULE not found; run 'make kernel_module' first"
+    exit 1
+fi
+rmmod cl_mem_reg 2>/dev/null
+
+CRITICAL_CGROUP_PARAM=
+if [ -n "$CRITICAL_CGROUP" ]; then
+    mkdir -p /sys/fs/cgroup/$CRITICAL_CGROUP
+    CRITICAL_CGROUP_PARAM="g_critical_cgroup=/$CRITICAL_CGROUP"
+fi
+
+echo 25 > /proc/sys/kernel/perf_cpu_time_max_percent
+echo 100000 > /proc/sys/kernel/perf_event_max_sample_rate
+echo 0 > /proc/sys/kernel/perf_cpu_time_max_percent
+
+# Unregulated baseline of the victim, alone
+BASELINE=$(run_victim "" | tr ' ' '\n' | grep '^mean_ns=' | cut -d= -f2)
+echo "# victim baseline mean_ns=$BASELINE (cpu $VICTIM_CPU), aggressors: $KERNEL at $INTENSITY% on cpus" $AGGRESSOR_CPUS >&2
+
+echo "throttle_policy,throttle_mode,coordinated,nohz_idle,budget_mb,t_a_us,t_r_us,cluster,achieved_mb,budget_util_pct,overrun_pct,overshoot_mean_mb,overshoot_max_mb,gpu_mb,ticks_per_s,tick_cycles_mean,stall_max_us,release_skew_mean_us,release_skew_max_us,throttle_ipis_per_s,duplicate_requests_per_s,parked_pct,victim_mean_ns,victim_p50_ns,victim_p99_ns,victim_p999_ns,victim_slowdown"
+
+for policy in $THROTTLE_POLICIES; do
+for mode in $THROTTLE_MODES; do
+for coordinated in $COORDINATED; do
+for nohz in $NOHZ_IDLE; do
+for budget in $BUDGETS; do
+for t_a in $AGGREGATION_PERIODS; do
+for t_r in $REGULATION_PERIODS; do
+    GPU_PID_CL1=-1
+    GPU_PID_CL2=-1
+    FAKE_GPU=
+    if [ "$FAKE_GPU_MB" -gt 0 ]; then
+        rm -f /tmp/gpu_profiler_pid
+        ./fake_gpu 1:$FAKE_GPU_MB 2:$FAKE_GPU_MB > /dev/null &
+        FAKE_GPU=$!
+        sleep 0.5
+        GPU_PID_CL1=$(cat /tmp/gpu_profiler_pid)
+        GPU_PID_CL2=$GPU_PID_CL1
+    fi
+
+    if ! insmod $MODULE \
+        g_bandwidth_budget_cl1=$budget \
+        g_bandwidth_budget_cl2=$budget \
+        g_gpu_profiler_pid_cl1=$GPU_PID_CL1 \
+        g_gpu_profiler_pid_cl2=$GPU_PID_CL2 \
+        g_regulation_period_us=$t_r \
+        g_aggregation_period_us=$t_a \
+        g_counter_source=$COUNTER_SOURCE \
+        g_synthetic_rate_mb=$SYNTHETIC_RATE_MB \
+        g_throttle_policy=$policy $CRITICAL_CGROUP_PARAM \
+        g_throttle_mode=$mode g_coordinated_regulation=$coordinated g_nohz_idle=$nohz \
+        g_carry_over=$CARRY_OVER g_burst_cap_pct=$BURST_CAP_PCT \
+        g_tick_profiling=1; then
+        echo "insmod failed (policy $policy, mode $mode, coordinated $coordinated, nohz $nohz, budget $budget, T_A $t_a, T_R $t_r)" >&2
+        [ -n "$FAKE_GPU" ] && kill $FAKE_GPU
+        continue
+    fi
+    sleep 0.5
+
+    PIDS=
+    for cpu in $AGGRESSOR_CPUS; do
+        ./bw_stress -c $cpu -k $KERNEL -s $BUFFER_MB -i $INTENSITY -d $DURATION > /dev/null &
+        PIDS="$PIDS $!"
+    done
+    VICTIM=$(run_victim "-b $BASELINE")
+    wait $PIDS
+
+    cp $DEBUGFS/stats /tmp/cl_mem_reg_bench_stats.txt
+    cp $DEBUGFS/tick_profile /tmp/cl_mem_reg_bench_tick_profile.txt
+    rmmod cl_mem_reg
+    if [ -n "$FAKE_GPU" ]; then
+        kill $FAKE_GPU
+        wait $FAKE_GPU 2>/dev/null
+    fi
+
+    victim_field() {
+        echo "$VICTIM" | tr ' ' '\n' | grep "^$1=" | cut -d= -f2
+    }
+
+    for cluster in 1 2; do
+        STATS=/tmp/cl_mem_reg_bench_stats.txt
+        periods=$(stats_field $STATS cluster$cluster periods)
+        [ -z "$periods" ] || [ "$periods" -eq 0 ] && continue
+
+        # Ticks, longest stall, time parked and mean tick cost ('total' phase) over the cluster's cores
+        ticks=0
+        stall_max=0
+        parked_ns=0
+        cores=0
+        for cpu in $(seq 0 $LAST_CPU); do
+            [ "$(cluster_of $cpu)" -eq $cluster ] || continue
+            ticks=$(( ticks + $(stats_field $STATS cpu$cpu ticks) ))
+            parked_ns=$(( parked_ns + $(stats_field $STATS cpu$cpu parked_ns) ))
+            cores=$(( cores + 1 ))
+            stall=$(stats_field $STATS cpu$cpu stall_max_ns)
+            [ "$stall" -gt "$stall_max" ] && stall_max=$stall
+        done
+        tick_cycles=$(awk -v c=$cluster '
+            /^cpu[0-9]+$/ { cpu = substr($1, 4) + 0 }
+            $1 == "total" && (cpu < 4) == (c == 1) {
+                split($2, n, "="); split($3, s, "="); count += n[2]; sum += n[2] * s[2]
+            }
+            END { printf "%.0f", count ? sum / count : 0 }' /tmp/cl_mem_reg_bench_tick_profile.txt)
+
+        awk -v policy=$policy -v mode=$mode -v coordinated=$coordinated -v nohz=$nohz -v budget=$budget -v t_a=$t_a -v t_r=$t_r -v cluster=$cluster -v periods=$periods -v ticks=$ticks \
+            -v tick_cycles=$tick_cycles -v stall_max=$stall_max -v parked_ns=$parked_ns -v cores=$cores \
+            -v used=$(stats_field $STATS cluster$cluster used_events) \
+            -v budget_events=$(stats_field $STATS cluster$cluster budget_events) \
+            -v overrun=$(stats_field $STATS cluster$cluster overrun_periods) \
+            -v overshoot=$(stats_field $STATS cluster$cluster overshoot_events) \
+            -v overshoot_max=$(stats_field $STATS cluster$cluster overshoot_max_events) \
+            -v gpu=$(stats_field $STATS cluster$cluster gpu_events) \
+            -v skew_mean=$(stats_field $STATS cluster$cluster release_skew_mean_ns) \
+            -v skew_max=$(stats_field $STATS cluster$cluster release_skew_max_ns) \
+            -v broadcasts=$(stats_field $STATS cluster$cluster throttle_broadcasts) \
+            -v duplicates=$(stats_field $STATS cluster$cluster duplicate_throttle_requests) \
+            -v victim="$(victim_field mean_ns),$(victim_field p50_ns),$(victim_field p99_ns),$(victim_field p999_ns),$(victim_field slowdown)" \
+            'BEGIN {
+                # events are 64-byte lines; per period -> MB/s
+                mb = 64 / (1024 * 1024); secs = periods * t_r / 1e6
+                printf "%d,%d,%d,%d,%d,%d,%d,%d,%.1f,%.1f,%.2f,%.2f,%.2f,%.1f,%.0f,%s,%.0f,%.1f,%.1f,%.1f,%.1f,%.1f,%s\n",
+                    policy, mode, coordinated, nohz, budget, t_a, t_r, cluster,
+                    used * mb / secs, budget_events ? 100 * used / budget_events : 0, 100 * overrun / periods,
+                    overrun ? overshoot * mb / (overrun * t_r / 1e6) : 0, overshoot_max * mb / (t_r / 1e6),
+                    gpu * mb / secs, ticks / secs, tick_cycles, stall_max / 1000, skew_mean / 1000, skew_max / 1000,
+                    broadcasts / secs, duplicates / secs, 100 * parked_ns / (secs * 1e9 * cores), victim
+            }'
+    done
+done
+done
+done
+done
+done
+done
+done
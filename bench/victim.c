@@ -0,0 +1,155 @@
+/*
+ * Latency-sensitive victim: a pointer chase over a random cyclic list of
+ * cache lines, pinned to one core.
+ *
+ * Usage: ./victim -c <cpu> [-s <MB>] [-d <sec>] [-b <baseline ns>]
+ * Prints the per-access latency percentiles and, given the latency of an
+ * unloaded run (-b), the slowdown.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include "bw_kernels.h"
+
+#define CACHE_LINE_SIZE 64
+#define HOPS_PER_SAMPLE 256
+#define MAX_SAMPLES (16 * 1024 * 1024)
+
+/* One node per cache line */
+struct node {
+    struct node* next;
+    char pad[CACHE_LINE_SIZE - sizeof(struct node*)];
+};
+
+static void usage(const char* prog) {
+    fprintf(stderr,
+            "Usage: %s -c <cpu> [-s <MB>] [-d <sec>] [-b <baseline ns>]\n"
+            "  -s  working set, larger than the LLC (default: 64)\n"
+            "  -d  duration (default: 10)\n"
+            "  -b  mean latency of an unloaded run, to report the slowdown\n",
+            prog);
+}
+
+static int compare_double(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static double percentile(double* sorted, size_t n, double p) {
+    size_t idx = (size_t)(p / 100.0 * (n - 1) + 0.5);
+
+    return sorted[idx < n ? idx : n - 1];
+}
+
+/* Random cyclic permutation so that hardware prefetchers cannot follow */
+static struct node* build_chain(size_t count) {
+    struct node* nodes;
+    size_t* order;
+    size_t i;
+
+    if (posix_memalign((void**)&nodes, CACHE_LINE_SIZE, count * sizeof(struct node)))
+        return NULL;
+    order = malloc(count * sizeof(size_t));
+    if (!order) {
+        free(nodes);
+        return NULL;
+    }
+
+    for (i = 0; i < count; i++)
+        order[i] = i;
+    for (i = count - 1; i > 0; i--) {
+        size_t j = (size_t)rand() % (i + 1);
+        size_t tmp = order[i];
+
+        order[i] = order[j];
+        order[j] = tmp;
+    }
+    for (i = 0; i < count; i++)
+        nodes[order[i]].next = &nodes[order[(i + 1) % count]];
+
+    free(order);
+
+    return nodes;
+}
+
+int main(int argc, char* argv[]) {
+    int cpu = -1, opt;
+    size_t size_mb = 64, count, num_samples = 0, i;
+    double duration = 10, baseline = 0, sum = 0, *samples;
+    struct node *nodes, *p;
+    uint64_t start, now;
+    cpu_set_t set;
+
+    while ((opt = getopt(argc, argv, "c:s:d:b:h")) != -1) {
+        switch (opt) {
+        case 'c': cpu = atoi(optarg); break;
+        case 's': size_mb = strtoul(optarg, NULL, 0); break;
+        case 'd': duration = atof(optarg); break;
+        case 'b': baseline = atof(optarg); break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    if (cpu < 0 || size_mb == 0 || duration <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) < 0) {
+        perror("sched_setaffinity");
+        return 1;
+    }
+
+    count = (size_mb << 20) / sizeof(struct node);
+    nodes = build_chain(count);
+    samples = malloc(MAX_SAMPLES * sizeof(double));
+    if (!nodes || !samples) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    /* Warm up: one lap over the chain */
+    for (p = nodes, i = 0; i < count; i++)
+        p = p->next;
+
+    start = now = bw_kernel__now_ns();
+    while (now - start < (uint64_t)(duration * 1e9) && num_samples < MAX_SAMPLES) {
+        uint64_t sample_start = now;
+
+        for (i = 0; i < HOPS_PER_SAMPLE; i++)
+            p = p->next;
+
+        now = bw_kernel__now_ns();
+        samples[num_samples] = (double)(now - sample_start) / HOPS_PER_SAMPLE;
+        sum += samples[num_samples];
+        num_samples++;
+    }
+
+    if (num_samples == 0 || p == NULL) {
+        fprintf(stderr, "No samples\n");
+        return 1;
+    }
+
+    qsort(samples, num_samples, sizeof(double), compare_double);
+
+    printf("cpu=%d samples=%zu mean_ns=%.1f p50_ns=%.1f p90_ns=%.1f p99_ns=%.1f p999_ns=%.1f max_ns=%.1f",
+           cpu, num_samples, sum / num_samples, percentile(samples, num_samples, 50), percentile(samples, num_samples, 90),
+           percentile(samples, num_samples, 99), percentile(samples, num_samples, 99.9), samples[num_samples - 1]);
+    if (baseline > 0)
+        printf(" slowdown=%.3f", sum / num_samples / baseline);
+    printf("\n");
+
+    free(samples);
+    free(nodes);
+
+    return 0;
+}
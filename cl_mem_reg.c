@@ -49,6 +49,10 @@
 #include <linux/vmalloc.h>
 #include <linux/preempt.h>
 #include <linux/mutex.h>
+#include <linux/timex.h>
+#include <linux/cgroup.h>
+#include <linux/cpuhotplug.h>
+#include <linux/tracepoint.h>
 
 #if LINUX_VERSION_CODE > KERNEL_VERSION(5, 0, 0)
 #include <uapi/linux/sched/types.h>
@@ -57,14 +61,17 @@
 #endif
 #include <linux/sched.h>
 
+#define CREATE_TRACE_POINTS
+#include "cl_mem_reg_trace.h"
+#include "cl_mem_reg_stats.h"
+#include "cl_mem_reg_model.h"
+#include "cl_mem_reg_log.h"
+#include "cl_mem_reg_live.h"
+#include "cl_mem_reg_gpu_actuator.h"
 
 /**************************************************************************
  * Public Definitions
  **************************************************************************/
-#define DEBUG(x)
-#define DEBUG_RECLAIM(x) x
-#define DEBUG_USER(x)
-#define DEBUG_PROFILE(x) x
 
 /* PMU counters */
 #if defined(__aarch64__) || defined(__arm__)
@@ -83,9 +90,11 @@
 #define TM_NS(x) (x).tv64
 #endif
 
-#define CACHE_LINE_SIZE 64 // B
+#define CACHE_LINE_SIZE CL_MEM_REG_CACHE_LINE_SIZE // B
+#define MAX_EVENT_BYTES 4096 // cost_table
 #define BUF_SIZE 256
 #define LOGGING_BUF_SIZE 128
+#define LOG_WRITER_BUF_SIZE (64 * 1024) // binary logs, per buffer (two per file)
 
 #define DEFAULT_RD_BUDGET_MB 204800
 #define NUMBER_OF_CORES 8
@@ -94,8 +103,67 @@
 
 #define GPU_BEATS_CLEANED -1
 
+#define MAX_CGROUP_BUDGETS 8
+#define MAX_LONG_WINDOWS 3
+#define NUMBER_OF_CLUSTERS 2
+
+/* g_gpu_overrun_policy (with CPU/GPU sub-budgets) */
+#define GPU_OVERRUN_POLICY_THROTTLE 0 /* stall the cluster's CPUs */
+#define GPU_OVERRUN_POLICY_HOOK 1     /* call the GPU actuator hook, CPUs keep running */
+
+/* g_throttle_policy */
+#define THROTTLE_POLICY_CORE 0 /* stall every task of the core */
+#define THROTTLE_POLICY_BE 1   /* stall tasks below SCHED_FIFO priority 2 only */
+
+/* g_logging */
+#define LOGGING_CSV 1    /* one text line per sample */
+#define LOGGING_BINARY 2 /* include/cl_mem_reg_log.h */
+
+/* g_throttle_mode */
+#define THROTTLE_MODE_PERIOD 0 /* over budget: stall until the end of the regulation period */
+#define THROTTLE_MODE_DUTY 1   /* also stall a share of each T_A slot to spread the budget */
+
+/* Signals requesting a GPU sample; one profiler may serve both clusters */
+#define GPU_PROFILING_SIGNAL_CL1 SIGUSR1
+#define GPU_PROFILING_SIGNAL_CL2 SIGUSR2
+
 #define US_TO_NS(us) us * 1000ULL
 
+#define TICK_HIST_BUCKETS 32 /* log2 buckets */
+
+/*
+ * Record the cycles spent since 't' in a tick phase and restart 't'.
+ * 'profiling' is g_tick_profiling as read once at the start of the tick.
+ */
+#define TICK_PROFILE_PHASE(profiling, core_info, phase, t) \
+    do { \
+        if (unlikely(profiling)) { \
+            cycles_t __now = get_cycles(); \
+            tick_hist_add(&(core_info)->tick_profile.phase_cycles[phase], __now - (t)); \
+            (t) = __now; \
+        } \
+    } while (0)
+
+/* Update a statistics record (total and running window) */
+#define STATS_ADD(stats, field, v) \
+    do { \
+        (stats)->total.field += (v); \
+        (stats)->window.field += (v); \
+    } while (0)
+
+#define STATS_MAX(stats, field, v) \
+    do { \
+        if ((v) > (stats)->total.field) (stats)->total.field = (v); \
+        if ((v) > (stats)->window.field) (stats)->window.field = (v); \
+    } while (0)
+
+/* Close the running window */
+#define STATS_ROLL(stats) \
+    do { \
+        (stats)->last_window = (stats)->window; \
+        memset(&(stats)->window, 0, sizeof((stats)->window)); \
+    } while (0)
+
 extern struct module __this_module;
 
 /**************************************************************************
@@ -103,6 +171,78 @@ extern struct module __this_module;
  **************************************************************************/
 
 static int module_unloading = 0; 
+static struct tracepoint *sched_switch_tp = NULL; /* idle ticking */
+static int cl_mem_reg_hp_state = CPUHP_INVALID;
+static int module_loaded = 0;
+
+/* Phases of a regulation tick (timer_callback_master) */
+enum tick_phase {
+    TICK_PHASE_PERF_STOP,
+    TICK_PHASE_PERIOD_COUNT,   /* atomic64_cmpxchg on the global period count */
+    TICK_PHASE_HRTIMER_START,
+    TICK_PHASE_SLAVE,          /* timer_callback_slave */
+    TICK_PHASE_PERF_START,
+    TICK_PHASE_REGULATION,     /* regulation_period_func */
+    TICK_PHASE_AGGREGATION,    /* aggregation_period_func */
+    TICK_PHASE_TOTAL,
+    NR_TICK_PHASES,
+};
+
+static const char * const tick_phase_names[NR_TICK_PHASES] = {
+    "perf_stop",
+    "period_count",
+    "hrtimer_start",
+    "slave",
+    "perf_start",
+    "regulation",
+    "aggregation",
+    "total",
+};
+
+/* log2 histogram */
+struct tick_hist {
+    u64 buckets[TICK_HIST_BUCKETS];
+    u64 count;
+    u64 sum;
+    u64 max;
+};
+
+/* per CPU tick overhead profile */
+struct tick_profile {
+    struct tick_hist phase_cycles[NR_TICK_PHASES]; /* get_cycles() units */
+    struct tick_hist lateness_ns;                  /* fire time - programmed expiry */
+};
+
+/* Regulation statistics (layout in cl_mem_reg_stats.h) */
+struct core_stats {
+    struct cl_mem_reg_core_stats total;
+    struct cl_mem_reg_core_stats window;      /* running window */
+    struct cl_mem_reg_core_stats last_window; /* last completed window */
+};
+
+struct cluster_stats {
+    struct cl_mem_reg_cluster_stats total;
+    struct cl_mem_reg_cluster_stats window;
+    struct cl_mem_reg_cluster_stats last_window;
+};
+
+struct core_info;
+
+/* Per-core accounting source; every op runs on the core it accounts */
+struct counter_source {
+    const char *name;
+    int (*init)(struct core_info *core_info);    /* create and enable, 0 or -errno */
+    void (*release)(struct core_info *core_info);
+    void (*stop)(struct core_info *core_info);   /* tick entry: freeze the count */
+    void (*start)(struct core_info *core_info);  /* tick exit */
+    u64 (*read)(struct core_info *core_info);    /* cumulative events */
+};
+
+/* Weighted accounting: bytes per counted event, and the same as a cost in LLC events (debugfs cost_table) */
+struct event_cost {
+    u64 bytes;
+    u64 cost; /* fixed point, CL_MEM_REG_COST_SHIFT */
+};
 
 /* per CPU info */
 struct core_info {
@@ -110,7 +250,18 @@ struct core_info {
     struct cluster_info *cluster_info;
     struct task_struct *throttled_task;
     ktime_t throttled_time;             // absolute time when throttled
-    struct perf_event *read_event;      // PMC: LLC miss count
+    ktime_t throttle_until;             // end of a duty-cycle stall, 0: end of the regulation period
+    int duty;                           // per mille of the current T_A slot stalled (duty-cycle mode)
+    const struct counter_source *counter_source;
+    struct perf_event *read_event;      // PMC: LLC miss count (perf sources)
+    struct event_cost cost;             // of one counted event
+    u64 cost_rem;                       // fraction of an LLC event not charged yet
+
+    /* synthetic source */
+    int synthetic_rate_mb;              // MB/s
+    u64 synthetic_count;                // events
+    u64 synthetic_rem;                  // sub-event remainder (events * ns)
+    ktime_t synthetic_last;
 
     /* throttle thread */
     struct task_struct *throttle_thread; // forced throttle idle thread
@@ -118,16 +269,27 @@ struct core_info {
 
     /* statistics */
     int64_t aggregation_period_cnt;      // active periods count
+    int64_t next_tick_cnt;               // aggregation_period_cnt of the next tick (adaptive T_A)
     s64 old_read_val;
 
     /* per-core hr timer */
     struct hrtimer hr_timer;
 
+    /* idle ticking: the timer is stopped while the core is idle */
+    int parked;
+    ktime_t parked_time;
+    struct irq_work unpark_work;
+
     /* Flag for gpu bandwidth profiling */
     int profile_gpu_bandwidth; 
 
     ktime_t start_time;
 
+    /* tick overhead profile */
+    struct tick_profile tick_profile;
+
+    /* regulation statistics */
+    struct core_stats stats;
 };
 
 /* global info */
@@ -137,19 +299,54 @@ struct global_info {
     atomic64_t count;
 };
 
+/* Long budget window: a whole number of regulation periods with its own rate */
+struct budget_window {
+    int ms;
+    int budget_mb;
+    int periods;           /* length (regulation periods) */
+    s64 budget_events;     /* over the whole window */
+    s64 usage;             /* completed periods of the current window */
+    int elapsed;           /* completed periods of the current window */
+    int exhausted;         /* the current window ran out of budget */
+
+    /* statistics */
+    u64 completed;         /* completed windows */
+    u64 exhausted_windows;
+    u64 limiting_periods;  /* periods whose budget this window capped */
+    int last_util_pct;     /* utilization of the last completed window */
+    int max_util_pct;
+};
+
 /* cluster info */
 struct cluster_info {
     char label[BUF_SIZE];
+    int id; /* 1: cluster 1, 2: cluster 2 */
 
     /* cluster_info */
-    int size; /* Number of cores in the cluster */
+    int size; /* Number of regulated cores in the cluster */
     uint64_t regulation_period_cnt;
 
     /* for control logic */
     int bandwidth_budget;
-    int cur_bandwidth_budget;
+    int cur_bandwidth_budget; /* budget of the current period: bandwidth_budget + carry_balance */
+    s64 carry_balance;        /* carry-over: credit (> 0) or debt (< 0), events */
+
+    /* system-wide budget: this cluster's share (MB/s) and predicted demand (events per period) */
+    int share_mb;
+    s64 demand_ewma;
+    ktime_t period_start;
+
+    /* CPU/GPU sub-budgets (events): reservations and the shared pool (rest of the budget) */
+    int sub_budgets;
+    s64 cpu_reservation;
+    s64 gpu_reservation;
+    s64 shared_pool;
+    int gpu_over; /* the GPU overran its share in this period */
 
     atomic_t bandwidth_usage;
+    atomic_t cpu_usage; /* per-class shares of bandwidth_usage */
+    atomic_t gpu_usage;
+    s64 prev_period_usage; /* usage of the previous regulation period (adaptive T_A) */
 
     ktime_t throttled_time;
 
@@ -157,10 +354,56 @@ struct cluster_info {
                                     the previous period for the read counter */
 
     int leader_core;
+    atomic64_t reset_period; /* last period whose boundary was handled (idle ticking: by any core) */
 
-    cpumask_var_t cpu_mask;
+    cpumask_var_t member_mask;  /* cores of the cluster, online or not */
+    cpumask_var_t cpu_mask;     /* regulated (online) cores */
+    cpumask_var_t parked_mask;  /* idle ticking: cores with a stopped timer */
+    cpumask_var_t release_mask; /* scratch of the core handling the period boundary */
 
     int is_throttled;
+    atomic_t throttle_requested; /* the cluster overran in this period (exempt cores included) */
+    atomic_t throttle_broadcasts;  /* since the last regulation tick of the leader */
+    atomic_t duplicate_requests;
+
+    /* release skew at period boundaries */
+    spinlock_t release_lock;
+    spinlock_t live_lock;               // live page entry: leader tick vs period start
+    u64 release_period;     /* boundary being released */
+    ktime_t release_first;
+    ktime_t release_last;
+    s64 release_skew_ns;    /* of the last complete boundary, -1: not folded into the stats yet */
+
+    /* cluster-scoped PMU counter (DSU/uncore), read by one core */
+    struct perf_event *cluster_event;
+    int cluster_event_cpu;
+
+    /* weighted accounting of the cluster PMU and the GPU */
+    struct event_cost cluster_cost;
+    struct event_cost gpu_rd_cost; /* per beat */
+    struct event_cost gpu_wr_cost;
+    u64 gpu_cost_rem;
+
+    /* long budget windows, on top of T_R (shortest first) */
+    struct budget_window windows[MAX_LONG_WINDOWS];
+    int nr_windows;
+
+    /* regulation statistics */
+    struct cluster_stats stats;
+};
+
+/* Per-cgroup budget, applied in each cluster (debugfs cgroups) */
+struct cgroup_budget {
+    int active;                                  /* published with release/acquire */
+    char path[BUF_SIZE];
+    struct cgroup *cgrp;
+    int budget_mb;
+    s64 budget_events;                           /* per regulation period */
+
+    atomic_t usage[NUMBER_OF_CLUSTERS];          /* events in the current period */
+    atomic_t over[NUMBER_OF_CLUSTERS];           /* over budget in the current period */
+    atomic64_t total_events[NUMBER_OF_CLUSTERS];
+    atomic64_t over_periods[NUMBER_OF_CLUSTERS];
 };
 
 /* Logging work */
@@ -170,34 +413,116 @@ struct logging_work {
     char buf[LOGGING_BUF_SIZE];
 };
 
+/*
+ * Binary log file: the producer (the core's tick, or the cluster's GPU beats
+ * receiver) encodes records into the active buffer; a full buffer is written
+ * out by the logging workqueue while the other one fills.
+ */
+struct log_writer {
+    struct file *file;
+    loff_t pos;
+    int source;                         // CL_MEM_REG_LOG_CPU or CL_MEM_REG_LOG_GPU
+    int cpu;                            // flushed on (-1: any)
+    struct cl_mem_reg_log_state state;
+
+    u8 *buf[2];
+    int active;
+    size_t len;                         // of the active buffer
+
+    struct work_struct work;
+    atomic_t flushing;                  // the other buffer is being written
+    u8 *flush_buf;
+    size_t flush_len;
+    u64 dropped;                        // records lost while both buffers were full
+};
+
 /**************************************************************************
  * Function Prototypes
  **************************************************************************/
 static void cl_mem_reg_on_each_cpu_mask(const struct cpumask *mask, smp_call_func_t func, void *info, bool wait);
 static inline u64 convert_mb_to_events(int mb);
 static inline int convert_events_to_mb(u64 events);
-static inline void print_current_context(void);
+static inline void request_gpu_sample(struct task_struct *task, int signal);
 static inline u64 perf_event_count(struct perf_event *event);
 static inline u64 get_read_event_used(struct core_info *core_info);
 static inline u64 get_cur_read_event(struct core_info *core_info);
 static void __throttle_core(void *info);
+static void throttle_core(struct core_info *core_info);
+static void throttle_cluster(struct cluster_info *cluster_info);
+static void __release_core(void *info);
+static void release_core(struct core_info *core_info, u64 period);
+static void throttle_core_until(struct core_info *core_info, ktime_t until);
+static void duty_cycle_throttle(struct core_info *core_info, s64 events);
+static struct cgroup_budget *charge_cgroup(struct cluster_info *cluster_info, u64 events);
+static void reset_cgroup_budgets(struct cluster_info *cluster_info);
+static int cl_mem_reg_cgroups_show(struct seq_file *m, void *v);
+static int cl_mem_reg_windows_show(struct seq_file *m, void *v);
+static int cl_mem_reg_windows_open(struct inode *inode, struct file *filp);
+static int cl_mem_reg_cgroups_open(struct inode *inode, struct file *filp);
+static ssize_t cl_mem_reg_cgroups_write(struct file *filp, const char __user *ubuf, size_t cnt, loff_t *ppos);
+static void set_bandwidth_budget(struct cluster_info *cluster_info, int mb);
+static void set_sub_budgets(struct cluster_info *cluster_info, int cpu_mb, int gpu_mb);
+static inline int cpu_over_budget(struct cluster_info *cluster_info);
+static inline s64 cpu_headroom(struct cluster_info *cluster_info);
+static inline s64 cur_shared_pool(struct cluster_info *cluster_info);
+static void carry_over(struct cluster_info *cluster_info, s64 usage, s64 idle_periods);
+static void init_long_windows(struct cluster_info *cluster_info, int *budgets, int nr_budgets);
+static void account_long_windows(struct cluster_info *cluster_info, s64 usage, s64 idle_periods);
+static void init_system_budget(void);
+static void redistribute_system_budget(struct cluster_info *cluster_info, s64 usage, int throttled);
+static void gpu_over_budget(struct cluster_info *cluster_info);
+static int bandwidth_budget_param_set(const char *val, const struct kernel_param *kp);
 static ssize_t cl_mem_reg_sysfs_show_cl1(struct kobject *kobj, struct kobj_attribute *attr, char *buf);
 static ssize_t cl_mem_reg_sysfs_show_cl2(struct kobject *kobj, struct kobj_attribute *attr, char *buf);
 static ssize_t cl_mem_reg_sysfs_store_cl1(struct kobject *kobj, struct kobj_attribute *attr, const char *buf, size_t count);
 static ssize_t cl_mem_reg_sysfs_store_cl2(struct kobject *kobj, struct kobj_attribute *attr, const char *buf, size_t count);
 static enum hrtimer_restart timer_callback_master(struct hrtimer *timer);
 static inline void regulation_period_func(void);
+static void start_cluster_period(struct cluster_info *cluster_info, int close_window, s64 idle_periods);
+static void claim_period_boundary(struct core_info *core_info);
+static inline int can_park(struct core_info *core_info);
+static void start_timer_at_next_tick(struct core_info *core_info, ktime_t now);
+static void park_core(struct core_info *core_info);
 static inline void aggregation_period_func(void);
 static inline void logging_work_func(struct work_struct* work);
+static void log_writer_flush_func(struct work_struct *work);
+static void log_writer_append(struct log_writer *writer, const struct cl_mem_reg_log_record *record);
+static struct log_writer *log_writer_open(const char *path, int source, int id, struct cluster_info *cluster_info, int cpu);
+static void log_writer_close(struct log_writer *writer);
 static void timer_callback_slave(struct core_info *core_info);
-static struct perf_event *init_counter(int cpu, int budget, int counter_id, void *callback);
+static struct perf_event *init_counter(int cpu, int budget, u32 type, u64 config, void *callback);
+static int init_counter_source(struct core_info *core_info);
+static void init_cluster_counter(struct cluster_info *cluster_info, int type, u64 config);
+static void release_cluster_counter(struct cluster_info *cluster_info);
 static void __start_counter(void *info);
 static void __stop_counter(void *info);
+static int cl_mem_reg_cpu_online(unsigned int cpu);
+static int cl_mem_reg_cpu_offline(unsigned int cpu);
 static void start_logging(void);
 static void stop_logging(void);
 static int cl_mem_reg_config_show(struct seq_file *m, void *v);
 static int cl_mem_reg_config_open(struct inode *inode, struct file *filp);
 static int cl_mem_reg_config_debugfs_init(void);
+static inline void tick_hist_add(struct tick_hist *hist, u64 value);
+static int cl_mem_reg_tick_profile_show(struct seq_file *m, void *v);
+static int cl_mem_reg_tick_profile_open(struct inode *inode, struct file *filp);
+static ssize_t cl_mem_reg_tick_profile_write(struct file *filp, const char __user *ubuf, size_t cnt, loff_t *ppos);
+static void __reset_tick_profile(void *info);
+static inline int next_aggregation_step(struct core_info *core_info);
+static void account_regulation_period(struct cluster_info *cluster_info, s64 usage, int throttled);
+static void fill_stats_snapshot(struct cl_mem_reg_stats_snapshot *snapshot);
+static int cl_mem_reg_stats_show(struct seq_file *m, void *v);
+static int cl_mem_reg_stats_open(struct inode *inode, struct file *filp);
+static ssize_t cl_mem_reg_stats_bin_read(struct file *filp, char __user *ubuf, size_t cnt, loff_t *ppos);
+static int cl_mem_reg_live_mmap(struct file *filp, struct vm_area_struct *vma);
+static void update_live_core(struct core_info *core_info);
+static void update_live_cluster(struct cluster_info *cluster_info);
+static int cl_mem_reg_synthetic_rate_show(struct seq_file *m, void *v);
+static int cl_mem_reg_synthetic_rate_open(struct inode *inode, struct file *filp);
+static ssize_t cl_mem_reg_synthetic_rate_write(struct file *filp, const char __user *ubuf, size_t cnt, loff_t *ppos);
+static int cl_mem_reg_cost_table_show(struct seq_file *m, void *v);
+static int cl_mem_reg_cost_table_open(struct inode *inode, struct file *filp);
+static ssize_t cl_mem_reg_cost_table_write(struct file *filp, const char __user *ubuf, size_t cnt, loff_t *ppos);
 static int throttle_thread_func(void *arg);
 static int gpu_beats_receiver_thread_func_cl1(void* arg);
 static int gpu_beats_receiver_thread_func_cl2(void* arg);
@@ -220,14 +545,50 @@ static struct cluster_info _cluster_info_cl2;
 static struct dentry *cl_mem_reg_dir;
 static struct global_info global_info;
 static struct core_info __percpu *_core_info;
+static struct cl_mem_reg_live_page *live_page; /* debugfs live, mapped read-only by cl_mem_reg_top */
 
 /* Param */
 static int g_read_counter_id = PMU_LLC_RD_COUNTER_ID;
+static char *g_counter_source = "auto";
+static int g_synthetic_rate_mb = 0;
+static int g_throttle_policy = THROTTLE_POLICY_CORE;
+static int g_throttle_mode = THROTTLE_MODE_PERIOD;
+static int g_coordinated_regulation = 1;
+static int g_nohz_idle = 0;
+static int g_exempt_cpus = 0;
+static char *g_critical_cgroup = NULL;
+static struct cgroup *critical_cgroup = NULL;
+static int g_cluster_pmu_type_cl1 = -1;
+static int g_cluster_pmu_config_cl1 = 0;
+static int g_cluster_pmu_type_cl2 = -1;
+static int g_cluster_pmu_config_cl2 = 0;
 static int g_regulation_period_us = 5300;
 static int g_aggregation_period_us = 100;
+static int g_adaptive_aggregation = 0;
+static int g_aggregation_period_max_us = 1000;
 static int g_bandwidth_budget_cl1 = 204800;
 static int g_bandwidth_budget_cl2 = 204800;
+static int g_system_budget = -1;
+static int g_cluster_min_cl1 = 0;
+static int g_cluster_min_cl2 = 0;
+static int g_demand_ewma_shift = 2;
+static int g_carry_over = 0;
+static int g_burst_cap_pct = 100;
+static int g_long_window_ms[MAX_LONG_WINDOWS];
+static int g_nr_long_windows = 0;
+static int g_long_window_budget_cl1[MAX_LONG_WINDOWS];
+static int g_nr_long_window_budgets_cl1 = 0;
+static int g_long_window_budget_cl2[MAX_LONG_WINDOWS];
+static int g_nr_long_window_budgets_cl2 = 0;
+static int g_cpu_reservation_cl1 = -1;
+static int g_gpu_reservation_cl1 = -1;
+static int g_cpu_reservation_cl2 = -1;
+static int g_gpu_reservation_cl2 = -1;
+static int g_gpu_overrun_policy = GPU_OVERRUN_POLICY_HOOK;
+static cl_mem_reg_gpu_overrun_fn __rcu gpu_overrun_hook = NULL;
 static int g_logging = 0;
+static int g_tick_profiling = 0;
+static int g_stats_window_periods = 100;
 static int g_gpu_profiling_cl1 = 1;
 static int g_gpu_profiling_cl2 = 1;
 static int g_gpu_profiling_core_cl1 = 3;
@@ -263,10 +624,19 @@ static struct workqueue_struct* g_logging_workqueue = NULL;
 static struct file* g_cpu_logging_files[NUMBER_OF_CORES];
 static struct file* g_gpu_logging_file_cl1;
 static struct file* g_gpu_logging_file_cl2;
+static struct log_writer* g_cpu_log_writers[NUMBER_OF_CORES];
+static struct log_writer* g_gpu_log_writer_cl1;
+static struct log_writer* g_gpu_log_writer_cl2;
 
 /* Mutex */
 static DEFINE_MUTEX(g_mutex_cl1);
 static DEFINE_MUTEX(g_mutex_cl2);
+static DEFINE_MUTEX(g_mutex_cgroups);
+static DEFINE_SPINLOCK(g_system_budget_lock);
+
+/* Per-cgroup budgets; ticks scan the active slots */
+static struct cgroup_budget cgroup_budgets[MAX_CGROUP_BUDGETS];
+static int nr_cgroup_budgets = 0;
 
 /**************************************************************************
  * Module parameters
@@ -278,26 +648,123 @@ module_param(g_read_counter_id, hexint, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
 module_param(g_read_counter_id, int, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
 #endif
 
+module_param(g_counter_source, charp, 0444);
+MODULE_PARM_DESC(g_counter_source, "Accounting source: raw, cache_misses, synthetic, or auto (first that works, in that order)");
+
+module_param(g_synthetic_rate_mb, int, 0444);
+MODULE_PARM_DESC(g_synthetic_rate_mb, "Initial per-core rate (MB/s) of the synthetic source (debugfs synthetic_rate)");
+
+module_param(g_cluster_pmu_type_cl1, int, 0444);
+MODULE_PARM_DESC(g_cluster_pmu_type_cl1, "perf type of cluster 1's cluster-scoped PMU (e.g. arm_dsu_0), -1: per-core counters");
+module_param(g_cluster_pmu_type_cl2, int, 0444);
+MODULE_PARM_DESC(g_cluster_pmu_type_cl2, "perf type of cluster 2's cluster-scoped PMU, -1: per-core counters");
+
+#if LINUX_VERSION_CODE > KERNEL_VERSION(5, 10, 0)
+module_param(g_cluster_pmu_config_cl1, hexint, 0444);
+module_param(g_cluster_pmu_config_cl2, hexint, 0444);
+#else
+module_param(g_cluster_pmu_config_cl1, int, 0444);
+module_param(g_cluster_pmu_config_cl2, int, 0444);
+#endif
+MODULE_PARM_DESC(g_cluster_pmu_config_cl1, "Cluster 1's cluster-scoped PMU event (cache lines to/from memory)");
+MODULE_PARM_DESC(g_cluster_pmu_config_cl2, "Cluster 2's cluster-scoped PMU event (cache lines to/from memory)");
+
+module_param(g_throttle_policy, int, 0444);
+MODULE_PARM_DESC(g_throttle_policy, "0: throttling stalls every task of the core, 1: only tasks below SCHED_FIFO priority 2 (best effort)");
+
+module_param(g_coordinated_regulation, int, 0444);
+MODULE_PARM_DESC(g_coordinated_regulation, "1: the leader releases the cluster with one IPI per period and throttles it with one IPI per overrun, 0: every core releases itself and every overrun check broadcasts");
+
+module_param(g_nohz_idle, int, 0444);
+MODULE_PARM_DESC(g_nohz_idle, "1: an idle core stops its aggregation timer until it runs a task again, and any core handles the period boundary");
+
+module_param(g_throttle_mode, int, 0644);
+MODULE_PARM_DESC(g_throttle_mode, "0: stall until the end of the regulation period once over budget, 1: duty cycle (stall a share of each T_A)");
+
+#if LINUX_VERSION_CODE > KERNEL_VERSION(5, 10, 0)
+module_param(g_exempt_cpus, hexint, 0644);
+#else
+module_param(g_exempt_cpus, int, 0644);
+#endif
+MODULE_PARM_DESC(g_exempt_cpus, "Bitmask of cores that are charged but never throttled");
+
+module_param(g_critical_cgroup, charp, 0444);
+MODULE_PARM_DESC(g_critical_cgroup, "cgroup (v2 path, e.g. /critical) whose tasks are charged but never throttled");
+
 module_param(g_regulation_period_us, int, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
 module_param(g_aggregation_period_us, int, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
-module_param(g_bandwidth_budget_cl1, int, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
-module_param(g_bandwidth_budget_cl2, int, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+
+module_param(g_adaptive_aggregation, int, 0444);
+MODULE_PARM_DESC(g_adaptive_aggregation, "Stretch T_A up to g_aggregation_period_max_us while the cluster is far below its budget");
+
+module_param(g_aggregation_period_max_us, int, 0644);
+MODULE_PARM_DESC(g_aggregation_period_max_us, "Maximum aggregation period (us) in adaptive mode");
+
+/* Budgets can be changed at runtime */
+static const struct kernel_param_ops bandwidth_budget_param_ops = {
+    .set = bandwidth_budget_param_set,
+    .get = param_get_int,
+};
+
+module_param_cb(g_bandwidth_budget_cl1, &bandwidth_budget_param_ops, &g_bandwidth_budget_cl1, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+MODULE_PARM_DESC(g_bandwidth_budget_cl1, "Cluster 1 memory bandwidth budget (MB/s)");
+module_param_cb(g_bandwidth_budget_cl2, &bandwidth_budget_param_ops, &g_bandwidth_budget_cl2, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+MODULE_PARM_DESC(g_bandwidth_budget_cl2, "Cluster 2 memory bandwidth budget (MB/s)");
+
+module_param(g_system_budget, int, 0444);
+MODULE_PARM_DESC(g_system_budget, "System-wide memory bandwidth budget (MB/s) shared by the clusters, -1: independent cluster budgets");
+module_param(g_cluster_min_cl1, int, 0444);
+MODULE_PARM_DESC(g_cluster_min_cl1, "Cluster 1 guaranteed share (MB/s) of the system budget");
+module_param(g_cluster_min_cl2, int, 0444);
+MODULE_PARM_DESC(g_cluster_min_cl2, "Cluster 2 guaranteed share (MB/s) of the system budget");
+module_param(g_demand_ewma_shift, int, 0444);
+MODULE_PARM_DESC(g_demand_ewma_shift, "Demand prediction: weight of the last period is 1 / 2^shift");
+
+module_param(g_carry_over, int, 0444);
+MODULE_PARM_DESC(g_carry_over, "Carry unused budget (credit) and overshoot (debt) over to the next regulation periods");
+module_param(g_burst_cap_pct, int, 0644);
+MODULE_PARM_DESC(g_burst_cap_pct, "Carry-over: credit cap, in % of the period budget");
+
+module_param_array(g_long_window_ms, int, &g_nr_long_windows, 0444);
+MODULE_PARM_DESC(g_long_window_ms, "Long budget windows (ms, comma-separated), enforced together with the regulation period");
+module_param_array(g_long_window_budget_cl1, int, &g_nr_long_window_budgets_cl1, 0444);
+MODULE_PARM_DESC(g_long_window_budget_cl1, "Cluster 1 average budget (MB/s) of each long window, -1: none");
+module_param_array(g_long_window_budget_cl2, int, &g_nr_long_window_budgets_cl2, 0444);
+MODULE_PARM_DESC(g_long_window_budget_cl2, "Cluster 2 average budget (MB/s) of each long window, -1: none");
+
+module_param(g_cpu_reservation_cl1, int, 0444);
+MODULE_PARM_DESC(g_cpu_reservation_cl1, "Cluster 1 CPU reservation (MB/s) within the budget, -1: one pool for CPUs and GPU");
+module_param(g_gpu_reservation_cl1, int, 0444);
+MODULE_PARM_DESC(g_gpu_reservation_cl1, "Cluster 1 GPU reservation (MB/s) within the budget, -1: one pool for CPUs and GPU");
+module_param(g_cpu_reservation_cl2, int, 0444);
+MODULE_PARM_DESC(g_cpu_reservation_cl2, "Cluster 2 CPU reservation (MB/s) within the budget, -1: one pool for CPUs and GPU");
+module_param(g_gpu_reservation_cl2, int, 0444);
+MODULE_PARM_DESC(g_gpu_reservation_cl2, "Cluster 2 GPU reservation (MB/s) within the budget, -1: one pool for CPUs and GPU");
+
+module_param(g_gpu_overrun_policy, int, 0644);
+MODULE_PARM_DESC(g_gpu_overrun_policy, "GPU over its sub-budget: 0: throttle the cluster's CPUs, 1: call the GPU actuator hook only");
 
 module_param(g_gpu_profiling_core_cl1, int, 0644);
 MODULE_PARM_DESC(g_gpu_profiling_core_cl1, "CPU core which propfiling cluster 1's GPU bandwidth");
 
 module_param(g_gpu_profiler_pid_cl1, int, 0644);
-MODULE_PARM_DESC(g_gpu_profiler_pid_cl1, "PID of gpu profiler of cluster 1 process");
+MODULE_PARM_DESC(g_gpu_profiler_pid_cl1, "PID of gpu profiler of cluster 1 (TID of its sampling thread)");
 
 module_param(g_gpu_profiling_core_cl2, int, 0644);
 MODULE_PARM_DESC(g_gpu_profiling_core_cl2, "CPU core which propfiling cluster 2's GPU bandwidth");
 
 module_param(g_gpu_profiler_pid_cl2, int, 0644);
-MODULE_PARM_DESC(g_gpu_profiler_pid_cl2, "PID of gpu profiler of cluster 2 process");
+MODULE_PARM_DESC(g_gpu_profiler_pid_cl2, "PID of gpu profiler of cluster 2 (TID of its sampling thread)");
 
 
 module_param(g_logging, int, 0644);
-MODULE_PARM_DESC(g_logging, "Logging flag");
+MODULE_PARM_DESC(g_logging, "Logging: 0: off, 1: CSV, 2: binary (include/cl_mem_reg_log.h)");
+
+module_param(g_tick_profiling, int, 0644);
+MODULE_PARM_DESC(g_tick_profiling, "Profile the cost and lateness of every regulation tick (debugfs tick_profile)");
+
+module_param(g_stats_window_periods, int, 0644);
+MODULE_PARM_DESC(g_stats_window_periods, "Length of the statistics window (regulation periods)");
 
 static struct kobj_attribute cl_mem_reg_sysfs_attribute_cl1 =
     __ATTR(stop_gpu_bandwidth_profiling, 0660, cl_mem_reg_sysfs_show_cl1, cl_mem_reg_sysfs_store_cl1);
@@ -313,6 +780,63 @@ static const struct file_operations cl_mem_reg_config_fops = {
     .release = single_release,
 };
 
+static const struct file_operations cl_mem_reg_tick_profile_fops = {
+    .open = cl_mem_reg_tick_profile_open,
+    .write = cl_mem_reg_tick_profile_write,
+    .read = seq_read,
+    .llseek = seq_lseek,
+    .release = single_release,
+};
+
+static const struct file_operations cl_mem_reg_stats_fops = {
+    .open = cl_mem_reg_stats_open,
+    .read = seq_read,
+    .llseek = seq_lseek,
+    .release = single_release,
+};
+
+static const struct file_operations cl_mem_reg_stats_bin_fops = {
+    .read = cl_mem_reg_stats_bin_read,
+    .llseek = default_llseek,
+};
+
+/* Pins the module while the page is mapped */
+static const struct file_operations cl_mem_reg_live_fops = {
+    .owner = THIS_MODULE,
+    .mmap = cl_mem_reg_live_mmap,
+};
+
+static const struct file_operations cl_mem_reg_cgroups_fops = {
+    .open = cl_mem_reg_cgroups_open,
+    .write = cl_mem_reg_cgroups_write,
+    .read = seq_read,
+    .llseek = seq_lseek,
+    .release = single_release,
+};
+
+static const struct file_operations cl_mem_reg_windows_fops = {
+    .open = cl_mem_reg_windows_open,
+    .read = seq_read,
+    .llseek = seq_lseek,
+    .release = single_release,
+};
+
+static const struct file_operations cl_mem_reg_cost_table_fops = {
+    .open = cl_mem_reg_cost_table_open,
+    .write = cl_mem_reg_cost_table_write,
+    .read = seq_read,
+    .llseek = seq_lseek,
+    .release = single_release,
+};
+
+static const struct file_operations cl_mem_reg_synthetic_rate_fops = {
+    .open = cl_mem_reg_synthetic_rate_open,
+    .write = cl_mem_reg_synthetic_rate_write,
+    .read = seq_read,
+    .llseek = seq_lseek,
+    .release = single_release,
+};
+
 static const struct file_operations gpu_bandwidth_profiling_fops_cl1 = {
     .owner = THIS_MODULE,
     .write = gpu_bandwidth_profiling_write_cl1,
@@ -345,556 +869,2460 @@ static void cl_mem_reg_on_each_cpu_mask(const struct cpumask *mask, smp_call_fun
 }
 
 /** convert MB/s to #of events (i.e., LLC miss counts) per period */
-static inline u64 convert_mb_to_events(int mb) {
-    return div64_u64((u64)mb * 1024 * 1024,
-                            CACHE_LINE_SIZE * (1000000 / (u64)g_regulation_period_us));
+static inline u64 convert_mb_to_events(int mb) { return cl_mem_reg_model__mb_to_events(mb, g_regulation_period_us); }
+static inline int convert_events_to_mb(u64 events) { return cl_mem_reg_model__events_to_mb(events, g_regulation_period_us); }
+
+/** read current counter value. */
+static inline u64 perf_event_count(struct perf_event *event) { return local64_read(&event->count) + atomic64_read(&event->child_count); }
+static inline u64 get_read_event_used(struct core_info *core_info) { return core_info->counter_source->read(core_info) - core_info->old_read_val; }
+static inline u64 get_cur_read_event(struct core_info *core_info) { return core_info->counter_source->read(core_info); }
+
+/**
+ * Ask the GPU profiler for a sample. The request carries the low 32 bits of
+ * CLOCK_MONOTONIC so that the profiler can measure its sampling latency.
+ * send_sig_info() signals this one thread: the profiler registers the TID of
+ * the thread waiting for requests, not its process ID.
+ */
+static inline void request_gpu_sample(struct task_struct *task, int signal) {
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 20, 0)
+    struct kernel_siginfo info;
+#else
+    struct siginfo info;
+#endif
+
+    memset(&info, 0, sizeof(info));
+    info.si_signo = signal;
+    info.si_code = SI_QUEUE;
+    info.si_int = (int)(u32)ktime_get_ns();
+
+    send_sig_info(signal, &info, task);
 }
 
-static inline int convert_events_to_mb(u64 events) {
-    u64 divisor = (u64)g_regulation_period_us * 1024 * 1024;
-    int mb = div64_u64(events * CACHE_LINE_SIZE * 1000000 + (divisor - 1), divisor);
-    return mb;
+static inline void set_event_cost(struct event_cost *cost, u64 bytes) {
+    WRITE_ONCE(cost->bytes, bytes);
+    WRITE_ONCE(cost->cost, cl_mem_reg_model__cost(bytes));
 }
 
-static inline int convert_bytes_to_events(u64 bytes) {
-    return div64_u64(bytes, CACHE_LINE_SIZE);
+/* Counted events of the core -> LLC events (the cluster PMU reader counts at the cluster's cost) */
+static inline u64 weigh_core_events(struct core_info *core_info, u64 events) {
+    struct cluster_info *cluster_info = core_info->cluster_info;
+    struct event_cost *cost = &core_info->cost;
+
+    if (cluster_info->cluster_event && cluster_info->cluster_event_cpu == core_info->cpu)
+        cost = &cluster_info->cluster_cost;
+
+    return cl_mem_reg_model__weigh(events, READ_ONCE(cost->cost), &core_info->cost_rem);
 }
 
-static inline void print_current_context(void) {
-    trace_printk("in_interrupt(%ld)(hard(%ld),softirq(%d)"
-                 ",in_nmi(%d)),irqs_disabled(%d)\n",
-                 in_interrupt(), in_irq(), (int)in_softirq(), (int)in_nmi(), (int)irqs_disabled());
+/* GPU beats -> LLC events (GPU beats receiver of the cluster) */
+static inline u64 weigh_gpu_beats(struct cluster_info *cluster_info, int rd_beats, int wr_beats) {
+    return cl_mem_reg_model__weigh(rd_beats, READ_ONCE(cluster_info->gpu_rd_cost.cost), &cluster_info->gpu_cost_rem) +
+        cl_mem_reg_model__weigh(wr_beats, READ_ONCE(cluster_info->gpu_wr_cost.cost), &cluster_info->gpu_cost_rem);
 }
 
-/** read current counter value. */
-static inline u64 perf_event_count(struct perf_event *event) { return local64_read(&event->count) + atomic64_read(&event->child_count); }
-static inline u64 get_read_event_used(struct core_info *core_info) { return perf_event_count(core_info->read_event) - core_info->old_read_val; }
-static inline u64 get_cur_read_event(struct core_info *core_info) { return perf_event_count(core_info->read_event); }
+/**
+ * Cores in g_exempt_cpus, and cores running a task of g_critical_cgroup when
+ * the request comes, keep running. Their usage is still charged, and the
+ * request is repeated every T_A while the cluster is over budget.
+ */
+static inline int throttle_exempt(struct core_info *core_info) {
+    if (g_exempt_cpus & (1 << core_info->cpu))
+        return 1;
+
+    return critical_cgroup && task_under_cgroup_hierarchy(current, critical_cgroup);
+}
 
+/* Cluster throttle request (IPI to every core of the cluster) */
 static void __throttle_core(void *info) {
     struct core_info *core_info = this_cpu_ptr(_core_info);
-    ktime_t start;
-    start = ktime_get();
 
-    core_info->throttled_task = current;
-    core_info->throttled_time = start;
-    wake_up_interruptible(&core_info->throttle_evt);
+    /* Idle: it stalls at its first tick if it wakes up before the release. Offline: sent before it left */
+    if (READ_ONCE(core_info->parked) || !cpumask_test_cpu(core_info->cpu, core_info->cluster_info->cpu_mask))
+        return;
 
-    return;
+    throttle_core(core_info);
 }
 
+/*
+ * Throttle every core of the cluster. The first request of a period wins
+ * the throttled state and broadcasts; with coordinated regulation the
+ * later ones are dropped (cores that were spared then stall at their next
+ * tick instead).
+ */
+static void throttle_cluster(struct cluster_info *cluster_info) {
+    if (atomic_cmpxchg(&cluster_info->throttle_requested, 0, 1)) {
+        atomic_inc(&cluster_info->duplicate_requests);
+        if (g_coordinated_regulation)
+            return;
+    }
+    else {
+        cluster_info->throttled_time = ktime_get();
+    }
 
-static ssize_t cl_mem_reg_sysfs_show_cl1(struct kobject *kobj, struct kobj_attribute *attr, char *buf)
-{
-    return sprintf(buf, "Use echo 0 > /sys/kernel/cl_mem_reg_cl1/stop_gpu_bandwidth_profiling to stop the gpu bandwidth profiling\n");
-}
-
-static ssize_t cl_mem_reg_sysfs_show_cl2(struct kobject *kobj, struct kobj_attribute *attr, char *buf)
-{
-    return sprintf(buf, "Use echo 0 > /sys/kernel/cl_mem_reg_cl2/stop_gpu_bandwidth_profiling to stop the gpu bandwidth profiling\n");
+    atomic_inc(&cluster_info->throttle_broadcasts);
+    cl_mem_reg_on_each_cpu_mask(cluster_info->cpu_mask, __throttle_core, NULL, 0);
 }
 
-static ssize_t cl_mem_reg_sysfs_store_cl1(struct kobject *kobj, struct kobj_attribute *attr, const char *buf, size_t count) {
+/* Release skew: first to last core released at the boundary of 'period' */
+static void track_release(struct cluster_info *cluster_info, u64 period) {
+    ktime_t now = ktime_get();
 
-    if (buf[0] == '0') {
-        gpu_profiler_task_cl1 = NULL;;
-        
-        printk(KERN_INFO "Disable GPU profiler\n");
+    spin_lock(&cluster_info->release_lock);
+    if (period != cluster_info->release_period) {
+        if (cluster_info->release_period)
+            cluster_info->release_skew_ns = ktime_to_ns(ktime_sub(cluster_info->release_last, cluster_info->release_first));
+        cluster_info->release_period = period;
+        cluster_info->release_first = cluster_info->release_last = now;
     }
-    return count;
+    else if (ktime_after(now, cluster_info->release_last)) {
+        cluster_info->release_last = now;
+    }
+    spin_unlock(&cluster_info->release_lock);
 }
 
-static ssize_t cl_mem_reg_sysfs_store_cl2(struct kobject *kobj, struct kobj_attribute *attr, const char *buf, size_t count) {
+/* Leader's period boundary (IPI to every core of the cluster) */
+static void __release_core(void *info) {
+    release_core(this_cpu_ptr(_core_info), (u64)(unsigned long)info);
+}
 
-    if (buf[0] == '0') {
-        gpu_profiler_task_cl2 = NULL;;
-        
-        printk(KERN_INFO "Disable GPU profiler\n");
+/* Unthrottle core at the start of regulation period 'period' */
+static void release_core(struct core_info *core_info, u64 period) {
+    if (core_info->throttled_task) {
+        STATS_ADD(&core_info->stats, throttled_periods, 1);
     }
-    return count;
+
+    core_info->throttled_task = NULL;
+    core_info->duty = 0;
+    track_release(core_info->cluster_info, period);
 }
 
-static enum hrtimer_restart timer_callback_master(struct hrtimer *timer)
-{
-    struct global_info *global = &global_info;
-    struct core_info *core_info = this_cpu_ptr(_core_info);
-    int cpu;
-    int orun;
+/* Stall this core until the end of the regulation period */
+static void throttle_core(struct core_info *core_info) {
+    throttle_core_until(core_info, 0);
+}
 
-    ktime_t next_time;
+/* Stall this core until 'until', or until the end of the regulation period if 0 */
+static void throttle_core_until(struct core_info *core_info, ktime_t until) {
+    struct cluster_info *cluster_info = core_info->cluster_info;
+    ktime_t start;
+    start = ktime_get();
 
-    cpu = core_info->cpu;    
+    /* Already throttled: keep the time of the first request, extend a duty-cycle stall to the period */
+    if (core_info->throttled_task) {
+        if (!until)
+            WRITE_ONCE(core_info->throttle_until, 0);
+        return;
+    }
 
-    /* must be irq disabled. hard irq */
-    BUG_ON(!irqs_disabled());
-    WARN_ON_ONCE(!in_interrupt());
+    if (throttle_exempt(core_info)) {
+        return;
+    }
 
-    /* Stop counter (disable overflow event) */
-    core_info->read_event->pmu->stop(core_info->read_event, PERF_EF_UPDATE);
+    trace_cl_mem_reg_throttle_begin(core_info->cpu, cluster_info->id,
+                                    atomic_read(&cluster_info->bandwidth_usage), cluster_info->cur_bandwidth_budget);
 
-    atomic64_cmpxchg(&global->count, core_info->aggregation_period_cnt, core_info->aggregation_period_cnt+1);
+    core_info->throttled_time = start;
+    WRITE_ONCE(core_info->throttle_until, until);
+    core_info->throttled_task = current;
+    wake_up_interruptible(&core_info->throttle_evt);
 
-    core_info->aggregation_period_cnt = atomic64_read(&global->count);
+    return;
+}
 
-    next_time = ktime_add_ns(core_info->start_time, core_info->aggregation_period_cnt * g_aggregation_period_us * 1000);
+/*
+ * Duty-cycle mode, cluster under budget: stall this core for a share of the
+ * next T_A slot so that the CPUs spread what is left of the budget over the
+ * rest of the regulation period.
+ */
+static void duty_cycle_throttle(struct core_info *core_info, s64 events) {
+    struct cluster_info *cluster_info = core_info->cluster_info;
+    int slots_left = g_manage_period_interval -
+        cl_mem_reg_model__period_position(core_info->aggregation_period_cnt, g_manage_period_interval);
+    s64 rate = events;
+
+    /* The last slot only ran for (1 - duty) of T_A */
+    if (core_info->duty > 0 && core_info->duty < CL_MEM_REG_DUTY_FULL)
+        rate = div64_u64((u64)events * CL_MEM_REG_DUTY_FULL, CL_MEM_REG_DUTY_FULL - core_info->duty);
+
+    core_info->duty = cl_mem_reg_model__duty_cycle(cpu_headroom(cluster_info), rate, slots_left, READ_ONCE(cluster_info->size));
+    if (core_info->duty)
+        throttle_core_until(core_info, ktime_add_ns(ktime_get(),
+                            div64_u64((u64)g_aggregation_period_us * NSEC_PER_USEC * core_info->duty, CL_MEM_REG_DUTY_FULL)));
+}
 
-    hrtimer_start(timer, next_time, HRTIMER_MODE_ABS_PINNED);
+/**
+ * Charge a tick's traffic to the cgroup of the task the tick interrupted
+ * (first matching budget). Returns the budget, or NULL.
+ */
+static struct cgroup_budget *charge_cgroup(struct cluster_info *cluster_info, u64 events) {
+    int c = cluster_info->id - 1;
+    int i;
 
-    /* Assign local period */
-    timer_callback_slave(core_info);
+    if (!READ_ONCE(nr_cgroup_budgets))
+        return NULL;
 
-    /* Restart counter */
-    core_info->read_event->pmu->start(core_info->read_event, PERF_EF_RELOAD);
+    for (i = 0; i < MAX_CGROUP_BUDGETS; i++) {
+        struct cgroup_budget *budget = &cgroup_budgets[i];
 
-    /* Regulation period handling */
-    if (core_info->aggregation_period_cnt % g_manage_period_interval == 1) {
-        regulation_period_func();
-    }
-    else{
-        /* Aggregation period handling */
-        aggregation_period_func();
+        if (!smp_load_acquire(&budget->active) || !task_under_cgroup_hierarchy(current, budget->cgrp))
+            continue;
+
+        atomic_add(events, &budget->usage[c]);
+        atomic64_add(events, &budget->total_events[c]);
+        /* Every core of the cluster gets here: only the first to cross counts the period */
+        if (!atomic_read(&budget->over[c]) &&
+            cl_mem_reg_model__should_throttle(atomic_read(&budget->usage[c]), READ_ONCE(budget->budget_events)) &&
+            atomic_cmpxchg(&budget->over[c], 0, 1) == 0)
+            atomic64_inc(&budget->over_periods[c]);
+        return budget;
     }
 
-    return HRTIMER_NORESTART;
+    return NULL;
 }
 
-static inline void regulation_period_func(void) {
-    struct core_info *core_info = this_cpu_ptr(_core_info);
-    struct cluster_info *cluster_info = core_info->cluster_info;    
+/* Leader, at the regulation tick */
+static void reset_cgroup_budgets(struct cluster_info *cluster_info) {
+    int c = cluster_info->id - 1;
+    int i;
 
-    /* Unthrottle core */
-    core_info->throttled_task = NULL;
-    cluster_info->is_throttled = 0;
+    if (!READ_ONCE(nr_cgroup_budgets))
+        return;
 
-    /* Reset usage if current CPU is the cluster leader */
-    if (core_info->cpu == cluster_info->leader_core) {
-        cluster_info->bandwidth_usage = (atomic_t) {(0)};
-        cluster_info->regulation_period_cnt++;
+    for (i = 0; i < MAX_CGROUP_BUDGETS; i++) {
+        atomic_set(&cgroup_budgets[i].usage[c], 0);
+        atomic_set(&cgroup_budgets[i].over[c], 0);
     }
-
-    return;
 }
 
-static void aggregation_period_func(void) {
-    struct core_info *core_info = this_cpu_ptr(_core_info);
-    struct cluster_info *cluster_info = core_info->cluster_info;
-    s64 cur_cpu_bandwidth_usage; // events
-    size_t profiling_info_buf_size = 0;
-    struct timespec64 time;
-    struct task_struct* gpu_profiler_task = NULL;
-
-    if(module_unloading) return;
-
-    ktime_get_real_ts64(&time);
-    
-    /* Profiling CPU memory bandwidth usage */
-    cur_cpu_bandwidth_usage = get_read_event_used(core_info);
-    core_info->old_read_val += cur_cpu_bandwidth_usage;
-    atomic_add(cur_cpu_bandwidth_usage, &cluster_info->bandwidth_usage);
-
-    /* Profiling GPU memory bandwidth usage */
-    if (core_info->profile_gpu_bandwidth) {
-
-        if(core_info->cpu < 4) {
-            gpu_profiler_task = gpu_profiler_task_cl1;
-        }
-        else{
-            gpu_profiler_task = gpu_profiler_task_cl2;
-        }
+/* Budget of the current period (events), kept within an int */
+static inline void set_cur_budget(struct cluster_info *cluster_info, s64 budget) {
+    cluster_info->cur_bandwidth_budget = clamp_t(s64, budget, 0, INT_MAX);
+}
 
-        if(gpu_profiler_task && pid_alive(gpu_profiler_task)) {
-            /* Request GPU memory bandwidth profiling */
-            send_sig(SIGUSR1, gpu_profiler_task, 0);
-        }
-    }
+/* Cap a period budget by what each long window has left */
+static s64 long_window_cap(struct cluster_info *cluster_info, s64 budget) {
+    int i;
 
-    /* Logging (CPU) */
-    if(g_logging && g_cpu_logging_files[core_info->cpu]) {
-        struct logging_work* logging_work_data;
+    for (i = 0; i < cluster_info->nr_windows; i++)
+        budget = min_t(s64, budget, cluster_info->windows[i].budget_events - cluster_info->windows[i].usage);
 
-        logging_work_data = kmalloc(sizeof(struct logging_work), GFP_ATOMIC);
-        if(!logging_work_data) {
-            pr_err("Failed to allocate memory for logging work");
-            return;
-        }
+    return budget;
+}
 
-        INIT_WORK(&logging_work_data->work, logging_work_func);
+/* Desc.: Apply a new budget (MB/s); it takes effect from the current regulation period */
+static void set_bandwidth_budget(struct cluster_info *cluster_info, int mb) {
+    int old_mb = convert_events_to_mb(cluster_info->bandwidth_budget);
 
-        logging_work_data->file = g_cpu_logging_files[core_info->cpu];
-        profiling_info_buf_size = snprintf(logging_work_data->buf, LOGGING_BUF_SIZE, "%llu,%lld.%09ld,%llu,%d\n", cluster_info->regulation_period_cnt, (long long)time.tv_sec, time.tv_nsec, cur_cpu_bandwidth_usage, cluster_info->is_throttled);
-        profiling_info_buf_size = profiling_info_buf_size > LOGGING_BUF_SIZE ? LOGGING_BUF_SIZE : profiling_info_buf_size;
-        
-        queue_work_on(core_info->cpu, g_logging_workqueue, &logging_work_data->work);
+    cluster_info->bandwidth_budget = convert_mb_to_events(mb);
+    /* Keep the carry-over balance and the long windows' cap of the current period */
+    set_cur_budget(cluster_info, long_window_cap(cluster_info, cluster_info->bandwidth_budget + cluster_info->carry_balance));
+    if (cluster_info->sub_budgets) {
+        cluster_info->shared_pool = max_t(s64, cluster_info->bandwidth_budget - cluster_info->cpu_reservation -
+                                          cluster_info->gpu_reservation, 0);
     }
 
+    trace_cl_mem_reg_budget_change(cluster_info->id, old_mb, mb, cluster_info->bandwidth_budget);
+}
 
-    /* Check if the core is throttled */
-    if (core_info->throttled_task != NULL) {
+/* Reservations of -1 keep a single pool for CPUs and GPU */
+static void set_sub_budgets(struct cluster_info *cluster_info, int cpu_mb, int gpu_mb) {
+    if (cpu_mb < 0 || gpu_mb < 0) {
+        cluster_info->sub_budgets = 0;
         return;
     }
 
+    cluster_info->cpu_reservation = convert_mb_to_events(cpu_mb);
+    cluster_info->gpu_reservation = convert_mb_to_events(gpu_mb);
+    if (cluster_info->cpu_reservation + cluster_info->gpu_reservation > cluster_info->bandwidth_budget)
+        pr_warn("cluster%d: CPU and GPU reservations exceed the budget, no shared pool\n", cluster_info->id);
+    cluster_info->shared_pool = max_t(s64, cluster_info->bandwidth_budget - cluster_info->cpu_reservation -
+                                      cluster_info->gpu_reservation, 0);
+    cluster_info->sub_budgets = 1;
+}
 
-    /* Throttle core if the read usage exceeds the current budget */
-    if (atomic_read(&cluster_info->bandwidth_usage) > cluster_info->cur_bandwidth_budget) {
-        if (core_info->cpu == cluster_info->leader_core) cluster_info->is_throttled = 1;
-        cl_mem_reg_on_each_cpu_mask(cluster_info->cpu_mask, __throttle_core, NULL, 0);
-    }
+/* CPUs: the cluster budget, or their reservation plus what the GPU left of the pool */
+static inline int cpu_over_budget(struct cluster_info *cluster_info) {
+    if (!cluster_info->sub_budgets)
+        return cl_mem_reg_model__should_throttle(atomic_read(&cluster_info->bandwidth_usage), cluster_info->cur_bandwidth_budget);
 
-    g_debug_cnt++;
+    return cl_mem_reg_model__class_over_budget(atomic_read(&cluster_info->cpu_usage), cluster_info->cpu_reservation,
+                                               atomic_read(&cluster_info->gpu_usage), cluster_info->gpu_reservation,
+                                               cur_shared_pool(cluster_info));
+}
+
+/* Shared pool of the current period: carried-over credit grows it, debt and long windows shrink it */
+static inline s64 cur_shared_pool(struct cluster_info *cluster_info) {
+    return max_t(s64, cluster_info->shared_pool + cluster_info->cur_bandwidth_budget - cluster_info->bandwidth_budget, 0);
+}
+
+/*
+ * Leader, at the end of a regulation period: carry credit or debt over to
+ * the next one. Periods nobody ticked in (idle ticking) were unused.
+ * The system budget shares hand out the whole system budget, which leaves
+ * no headroom for credit: only debt is carried there.
+ */
+static void carry_over(struct cluster_info *cluster_info, s64 usage, s64 idle_periods) {
+    s64 cap = 0;
+
+    if (g_system_budget <= 0)
+        cap = div64_u64((u64)cluster_info->bandwidth_budget * max(g_burst_cap_pct, 0), 100);
+
+    cluster_info->carry_balance = cl_mem_reg_model__carry_over(cluster_info->carry_balance, usage,
+                                                               cluster_info->bandwidth_budget, cap);
+    if (idle_periods)
+        cluster_info->carry_balance = cl_mem_reg_model__carry_over(cluster_info->carry_balance, 0,
+                                                                   cluster_info->bandwidth_budget * idle_periods, cap);
+    set_cur_budget(cluster_info, cluster_info->bandwidth_budget + cluster_info->carry_balance);
+
+    if (cluster_info->carry_balance > 0)
+        STATS_ADD(&cluster_info->stats, credit_periods, 1);
+    else if (cluster_info->carry_balance < 0)
+        STATS_ADD(&cluster_info->stats, debt_periods, 1);
+}
+
+static void init_long_windows(struct cluster_info *cluster_info, int *budgets, int nr_budgets) {
+    int i;
+
+    cluster_info->nr_windows = 0;
+    for (i = 0; i < g_nr_long_windows && i < nr_budgets; i++) {
+        struct budget_window *window = &cluster_info->windows[cluster_info->nr_windows];
+
+        if (budgets[i] < 0)
+            continue;
+
+        memset(window, 0, sizeof(*window));
+        window->ms = g_long_window_ms[i];
+        window->budget_mb = budgets[i];
+        window->periods = DIV_ROUND_UP(g_long_window_ms[i] * 1000, g_regulation_period_us);
+        window->budget_events = convert_mb_to_events(budgets[i]) * window->periods;
+        cluster_info->nr_windows++;
+    }
+}
+
+/* Even split of what is left above the guaranteed shares, until the first demand predictions */
+static void init_system_budget(void) {
+    int remainder = g_system_budget - g_cluster_min_cl1 - g_cluster_min_cl2;
+
+    _cluster_info_cl1.share_mb = g_cluster_min_cl1 + remainder / NUMBER_OF_CLUSTERS;
+    _cluster_info_cl2.share_mb = g_cluster_min_cl2 + remainder / NUMBER_OF_CLUSTERS;
+    set_bandwidth_budget(&_cluster_info_cl1, _cluster_info_cl1.share_mb);
+    set_bandwidth_budget(&_cluster_info_cl2, _cluster_info_cl2.share_mb);
+}
+
+/*
+ * Leader, at the end of a regulation period: update the cluster's demand
+ * prediction and take its share of the system budget for the next period.
+ * Above the guaranteed shares, the remainder goes to the predicted demand
+ * (proportionally when the clusters ask for more than there is, evenly
+ * what is left otherwise). The share never exceeds what the other cluster
+ * does not hold for its current period, so the sum stays within the
+ * system budget.
+ */
+static void redistribute_system_budget(struct cluster_info *cluster_info, s64 usage, int throttled) {
+    struct cluster_info *clusters[NUMBER_OF_CLUSTERS] = {&_cluster_info_cl1, &_cluster_info_cl2};
+    int mins[NUMBER_OF_CLUSTERS] = {g_cluster_min_cl1, g_cluster_min_cl2};
+    int remainder = g_system_budget - g_cluster_min_cl1 - g_cluster_min_cl2;
+    int c = cluster_info->id - 1;
+    s64 demand = usage, excess[NUMBER_OF_CLUSTERS], total_excess = 0, share;
+    s64 system_events = convert_mb_to_events(g_system_budget);
+    u64 period_ns = (u64)g_regulation_period_us * NSEC_PER_USEC;
+    int i;
+
+    /* A throttled cluster ran for part of the period: extrapolate its demand */
+    if (throttled) {
+        u64 run_ns = ktime_to_ns(ktime_sub(cluster_info->throttled_time, cluster_info->period_start));
+
+        if (run_ns < period_ns)
+            demand = run_ns ? div64_u64((u64)usage * period_ns, run_ns) : system_events;
+    }
+    demand = min(demand, system_events);
+
+    spin_lock(&g_system_budget_lock);
+
+    cluster_info->demand_ewma += div64_s64(demand - cluster_info->demand_ewma, 1 << g_demand_ewma_shift);
+
+    for (i = 0; i < NUMBER_OF_CLUSTERS; i++) {
+        excess[i] = max_t(s64, convert_events_to_mb(max_t(s64, clusters[i]->demand_ewma, 0)) - mins[i], 0);
+        total_excess += excess[i];
+    }
+
+    if (total_excess <= remainder)
+        share = mins[c] + excess[c] + div64_s64(remainder - total_excess, NUMBER_OF_CLUSTERS);
+    else
+        share = mins[c] + div64_s64((s64)remainder * excess[c], total_excess);
+    share = min_t(s64, share, g_system_budget - clusters[1 - c]->share_mb);
+
+    if (share != cluster_info->share_mb) {
+        cluster_info->share_mb = share;
+        set_bandwidth_budget(cluster_info, share);
+    }
+
+    spin_unlock(&g_system_budget_lock);
+}
+
+/*
+ * Leader, at the end of a regulation period: charge the long windows, and
+ * cap the next period's budget by what each of them has left. Periods
+ * nobody ticked in (idle ticking) follow the charged one, unused.
+ */
+static void account_long_windows(struct cluster_info *cluster_info, s64 usage, s64 idle_periods) {
+    s64 budget = cluster_info->bandwidth_budget + cluster_info->carry_balance;
+    int i;
+
+    if (!cluster_info->nr_windows)
+        return;
+
+    for (i = 0; i < cluster_info->nr_windows; i++) {
+        struct budget_window *window = &cluster_info->windows[i];
+        s64 left;
+
+        s64 elapsed = window->elapsed + 1 + idle_periods;
+
+        window->usage += usage;
+        if (window->usage >= window->budget_events)
+            window->exhausted = 1;
+
+        if (elapsed >= window->periods) {
+            s64 completed = div64_s64(elapsed, window->periods);
+
+            window->last_util_pct = div64_u64(max_t(s64, window->usage, 0) * 100, max_t(s64, window->budget_events, 1));
+            window->max_util_pct = max(window->max_util_pct, window->last_util_pct);
+            /* Windows made of idle periods only */
+            if (completed > 1)
+                window->last_util_pct = 0;
+            window->completed += completed;
+            window->exhausted_windows += window->exhausted;
+            window->usage = 0;
+            elapsed -= completed * window->periods;
+            window->exhausted = 0;
+        }
+        window->elapsed = elapsed;
+
+        left = window->budget_events - window->usage;
+        if (left < budget) {
+            budget = left;
+            window->limiting_periods++;
+        }
+    }
+
+    set_cur_budget(cluster_info, budget);
+}
+
+/* Events the CPUs may still use in this period */
+static inline s64 cpu_headroom(struct cluster_info *cluster_info) {
+    s64 gpu_borrowed;
+
+    if (!cluster_info->sub_budgets)
+        return (s64)cluster_info->cur_bandwidth_budget - atomic_read(&cluster_info->bandwidth_usage);
+
+    gpu_borrowed = max_t(s64, atomic_read(&cluster_info->gpu_usage) - cluster_info->gpu_reservation, 0);
+
+    return cluster_info->cpu_reservation + max_t(s64, cur_shared_pool(cluster_info) - gpu_borrowed, 0) -
+        atomic_read(&cluster_info->cpu_usage);
+}
+
+/* GPU beats receiver: enforce the GPU's share (or, without sub-budgets, the cluster budget) */
+static void gpu_over_budget(struct cluster_info *cluster_info) {
+    s64 usage = atomic_read(&cluster_info->gpu_usage);
+    s64 cpu_borrowed, share;
+    cl_mem_reg_gpu_overrun_fn hook;
+
+    if (!cluster_info->sub_budgets) {
+        if (cl_mem_reg_model__should_throttle(atomic_read(&cluster_info->bandwidth_usage), cluster_info->cur_bandwidth_budget))
+            throttle_cluster(cluster_info);
+        return;
+    }
+
+    if (!cl_mem_reg_model__class_over_budget(usage, cluster_info->gpu_reservation, atomic_read(&cluster_info->cpu_usage),
+                                             cluster_info->cpu_reservation, cur_shared_pool(cluster_info)))
+        return;
+
+    cpu_borrowed = max_t(s64, atomic_read(&cluster_info->cpu_usage) - cluster_info->cpu_reservation, 0);
+    share = cluster_info->gpu_reservation + max_t(s64, cur_shared_pool(cluster_info) - cpu_borrowed, 0);
+
+    if (!cluster_info->gpu_over) {
+        cluster_info->gpu_over = 1;
+        trace_cl_mem_reg_gpu_overrun(cluster_info->id, usage, share, g_gpu_overrun_policy);
+    }
+
+    if (g_gpu_overrun_policy == GPU_OVERRUN_POLICY_THROTTLE) {
+        throttle_cluster(cluster_info);
+        return;
+    }
+
+    rcu_read_lock();
+    hook = rcu_dereference(gpu_overrun_hook);
+    if (hook)
+        hook(cluster_info->id, usage, share);
+    rcu_read_unlock();
+}
+
+int cl_mem_reg_register_gpu_overrun_hook(cl_mem_reg_gpu_overrun_fn fn) {
+    if (cmpxchg((cl_mem_reg_gpu_overrun_fn *)&gpu_overrun_hook, NULL, fn) != NULL)
+        return -EBUSY;
+
+    return 0;
+}
+EXPORT_SYMBOL_GPL(cl_mem_reg_register_gpu_overrun_hook);
+
+void cl_mem_reg_unregister_gpu_overrun_hook(cl_mem_reg_gpu_overrun_fn fn) {
+    if (cmpxchg((cl_mem_reg_gpu_overrun_fn *)&gpu_overrun_hook, fn, NULL) == fn)
+        synchronize_rcu();
+}
+EXPORT_SYMBOL_GPL(cl_mem_reg_unregister_gpu_overrun_hook);
+
+static int bandwidth_budget_param_set(const char *val, const struct kernel_param *kp) {
+    int mb, ret;
+
+    ret = kstrtoint(val, 0, &mb);
+    if (ret)
+        return ret;
+    if (mb <= 0)
+        return -EINVAL;
+
+    /* The system budget sets the cluster budgets every period */
+    if (g_system_budget > 0 && module_loaded)
+        return -EBUSY;
+
+    *(int *)kp->arg = mb;
+
+    /* Before init, the value is picked up by cl_mem_reg_init() */
+    if (module_loaded && !module_unloading) {
+        set_bandwidth_budget(kp->arg == &g_bandwidth_budget_cl1 ? &_cluster_info_cl1 : &_cluster_info_cl2, mb);
+    }
+
+    return 0;
+}
+
+
+static ssize_t cl_mem_reg_sysfs_show_cl1(struct kobject *kobj, struct kobj_attribute *attr, char *buf)
+{
+    return sprintf(buf, "Use echo 0 > /sys/kernel/cl_mem_reg_cl1/stop_gpu_bandwidth_profiling to stop the gpu bandwidth profiling\n");
+}
+
+static ssize_t cl_mem_reg_sysfs_show_cl2(struct kobject *kobj, struct kobj_attribute *attr, char *buf)
+{
+    return sprintf(buf, "Use echo 0 > /sys/kernel/cl_mem_reg_cl2/stop_gpu_bandwidth_profiling to stop the gpu bandwidth profiling\n");
+}
+
+static ssize_t cl_mem_reg_sysfs_store_cl1(struct kobject *kobj, struct kobj_attribute *attr, const char *buf, size_t count) {
+
+    if (buf[0] == '0') {
+        gpu_profiler_task_cl1 = NULL;;
+        
+        printk(KERN_INFO "Disable GPU profiler\n");
+    }
+    return count;
+}
+
+static ssize_t cl_mem_reg_sysfs_store_cl2(struct kobject *kobj, struct kobj_attribute *attr, const char *buf, size_t count) {
+
+    if (buf[0] == '0') {
+        gpu_profiler_task_cl2 = NULL;;
+        
+        printk(KERN_INFO "Disable GPU profiler\n");
+    }
+    return count;
+}
+
+static enum hrtimer_restart timer_callback_master(struct hrtimer *timer)
+{
+    struct global_info *global = &global_info;
+    struct core_info *core_info = this_cpu_ptr(_core_info);
+    int cpu;
+    int orun;
+    int park;
+    int profiling = READ_ONCE(g_tick_profiling);
+    cycles_t tick_start = 0, t = 0;
+
+    ktime_t next_time;
+
+    cpu = core_info->cpu;    
+
+    /* must be irq disabled. hard irq */
+    BUG_ON(!irqs_disabled());
+    WARN_ON_ONCE(!in_interrupt());
+
+    if (unlikely(profiling)) {
+        /* Lateness: how long after its programmed expiry (next_time) the tick fired */
+        s64 lateness = ktime_to_ns(ktime_sub(ktime_get(), hrtimer_get_expires(timer)));
+        tick_hist_add(&core_info->tick_profile.lateness_ns, lateness > 0 ? lateness : 0);
+        tick_start = t = get_cycles();
+    }
+
+    /* Stop counter (disable overflow event) */
+    core_info->counter_source->stop(core_info);
+    TICK_PROFILE_PHASE(profiling, core_info, TICK_PHASE_PERF_STOP, t);
+
+    /* Idle ticking: an idle core stops its timer after this tick (see unpark_core) */
+    park = g_nohz_idle && can_park(core_info);
+
+    if (g_adaptive_aggregation || g_nohz_idle) {
+        /* Cores skip ticks, so each core follows its own plan instead of the global count */
+        core_info->aggregation_period_cnt = core_info->next_tick_cnt;
+    }
+    else {
+        atomic64_cmpxchg(&global->count, core_info->aggregation_period_cnt, core_info->aggregation_period_cnt+1);
+
+        core_info->aggregation_period_cnt = atomic64_read(&global->count);
+    }
+    core_info->next_tick_cnt = core_info->aggregation_period_cnt + 1;
+    STATS_ADD(&core_info->stats, ticks, 1);
+    TICK_PROFILE_PHASE(profiling, core_info, TICK_PHASE_PERIOD_COUNT, t);
+
+    if (!g_adaptive_aggregation && !park) {
+        next_time = ktime_add_ns(core_info->start_time, core_info->aggregation_period_cnt * g_aggregation_period_us * 1000);
+
+        hrtimer_start(timer, next_time, HRTIMER_MODE_ABS_PINNED);
+        TICK_PROFILE_PHASE(profiling, core_info, TICK_PHASE_HRTIMER_START, t);
+    }
+
+    /* Assign local period */
+    timer_callback_slave(core_info);
+    TICK_PROFILE_PHASE(profiling, core_info, TICK_PHASE_SLAVE, t);
+
+    /* Restart counter */
+    core_info->counter_source->start(core_info);
+    TICK_PROFILE_PHASE(profiling, core_info, TICK_PHASE_PERF_START, t);
+
+    if (g_nohz_idle) {
+        claim_period_boundary(core_info);
+    }
+
+    /* Regulation period handling */
+    if (cl_mem_reg_model__is_regulation_tick(core_info->aggregation_period_cnt, g_manage_period_interval)) {
+        regulation_period_func();
+        TICK_PROFILE_PHASE(profiling, core_info, TICK_PHASE_REGULATION, t);
+    }
+    else{
+        /* Aggregation period handling */
+        aggregation_period_func();
+        TICK_PROFILE_PHASE(profiling, core_info, TICK_PHASE_AGGREGATION, t);
+    }
+
+    /* Adaptive T_A: the next tick depends on the usage just accounted */
+    if (g_adaptive_aggregation && !park) {
+        core_info->next_tick_cnt = core_info->aggregation_period_cnt + next_aggregation_step(core_info);
+        next_time = ktime_add_ns(core_info->start_time, (core_info->next_tick_cnt - 1) * g_aggregation_period_us * 1000);
+
+        hrtimer_start(timer, next_time, HRTIMER_MODE_ABS_PINNED);
+        TICK_PROFILE_PHASE(profiling, core_info, TICK_PHASE_HRTIMER_START, t);
+    }
+
+    if (park) {
+        park_core(core_info);
+    }
+
+    TICK_PROFILE_PHASE(profiling, core_info, TICK_PHASE_TOTAL, tick_start);
+
+    return HRTIMER_NORESTART;
+}
+
+/* Desc.: Ticks from the current tick to the next tick of this core (adaptive T_A) */
+static inline int next_aggregation_step(struct core_info *core_info) {
+    struct cluster_info *cluster_info = core_info->cluster_info;
+    s64 cnt = core_info->aggregation_period_cnt;
+    int pos = cl_mem_reg_model__period_position(cnt, g_manage_period_interval);
+    s64 usage = atomic_read(&cluster_info->bandwidth_usage);
+    s64 rate; /* cluster events per tick */
+
+    /* At the regulation tick, the usage was just reset: use the previous period */
+    if (pos)
+        rate = div64_u64(usage, pos);
+    else
+        rate = div64_u64(cluster_info->prev_period_usage, g_manage_period_interval);
+
+    return cl_mem_reg_model__aggregation_step(cnt, g_manage_period_interval, usage, cluster_info->cur_bandwidth_budget,
+                                              rate, g_aggregation_period_max_us / g_aggregation_period_us);
+}
+
+static inline void regulation_period_func(void) {
+    struct core_info *core_info = this_cpu_ptr(_core_info);
+    struct cluster_info *cluster_info = core_info->cluster_info;    
+    int close_window = g_stats_window_periods > 0 &&
+        cl_mem_reg_model__regulation_period(core_info->aggregation_period_cnt, g_manage_period_interval) % g_stats_window_periods == 0;
+
+    /* Unthrottle core (coordinated: the leader releases the whole cluster below) */
+    if (!g_coordinated_regulation) {
+        release_core(core_info, cl_mem_reg_model__regulation_period(core_info->aggregation_period_cnt, g_manage_period_interval));
+    }
+    if (close_window) {
+        STATS_ROLL(&core_info->stats);
+    }
+
+    cluster_info->is_throttled = 0;
+
+    /* Reset usage if current CPU is the cluster leader (idle ticking: see claim_period_boundary) */
+    if (!g_nohz_idle && core_info->cpu == cluster_info->leader_core) {
+        start_cluster_period(cluster_info, close_window, 0);
+    }
+
+    return;
+}
+
+/*
+ * Period boundary of the cluster, by the leader. With idle ticking, by the
+ * first core to tick in the new period, after 'idle_periods' periods in
+ * which every core of the cluster was parked.
+ */
+static void start_cluster_period(struct cluster_info *cluster_info, int close_window, s64 idle_periods) {
+    s64 usage = atomic_read(&cluster_info->bandwidth_usage);
+    int cluster_throttled = atomic_read(&cluster_info->throttle_requested);
+    int i;
+
+    trace_cl_mem_reg_period_start(cluster_info->id, cluster_info->regulation_period_cnt + 1 + idle_periods,
+                                  usage, cluster_info->cur_bandwidth_budget, cluster_throttled);
+
+    /* Throttle requests cover the whole cluster, exempt cores included */
+    if (cluster_info->regulation_period_cnt) {
+        account_regulation_period(cluster_info, usage, cluster_throttled);
+        if (idle_periods) {
+            STATS_ADD(&cluster_info->stats, periods, idle_periods);
+            STATS_ADD(&cluster_info->stats, budget_events, cluster_info->bandwidth_budget * idle_periods);
+            STATS_ADD(&cluster_info->stats, idle_periods, idle_periods);
+        }
+        if (g_system_budget > 0) {
+            redistribute_system_budget(cluster_info, usage, cluster_throttled);
+            /* A few empty periods are enough for the demand prediction to settle */
+            for (i = 0; i < min_t(s64, idle_periods, 16); i++)
+                redistribute_system_budget(cluster_info, 0, 0);
+        }
+        if (g_carry_over)
+            carry_over(cluster_info, usage, idle_periods);
+        account_long_windows(cluster_info, usage, idle_periods);
+    }
+    atomic_set(&cluster_info->throttle_requested, 0);
+    reset_cgroup_budgets(cluster_info);
+    if (close_window) {
+        STATS_ROLL(&cluster_info->stats);
+    }
+
+    cluster_info->prev_period_usage = usage;
+    cluster_info->bandwidth_usage = (atomic_t) {(0)};
+    atomic_set(&cluster_info->cpu_usage, 0);
+    atomic_set(&cluster_info->gpu_usage, 0);
+    cluster_info->gpu_over = 0;
+    cluster_info->period_start = ktime_get();
+    cluster_info->regulation_period_cnt += 1 + idle_periods;
+    update_live_cluster(cluster_info);
+
+    /* One IPI releases every core at once, after the reset (parked cores are idle, hence not throttled) */
+    if (g_coordinated_regulation) {
+        cpumask_andnot(cluster_info->release_mask, cluster_info->cpu_mask, cluster_info->parked_mask);
+        cl_mem_reg_on_each_cpu_mask(cluster_info->release_mask, __release_core,
+                                    (void *)(unsigned long)cluster_info->regulation_period_cnt, 0);
+    }
+}
+
+/*
+ * Idle ticking: the regulation tick of a period may find every core of the
+ * cluster parked, so the first core to tick in a new period handles its
+ * boundary, at whichever tick that is.
+ */
+static void claim_period_boundary(struct core_info *core_info) {
+    struct cluster_info *cluster_info = core_info->cluster_info;
+    s64 cnt = core_info->aggregation_period_cnt;
+    s64 period = cl_mem_reg_model__regulation_period(cnt - cl_mem_reg_model__period_position(cnt, g_manage_period_interval),
+                                                     g_manage_period_interval);
+    s64 last = atomic64_read(&cluster_info->reset_period);
+    int close_window;
+
+    if (period <= last || atomic64_cmpxchg(&cluster_info->reset_period, last, period) != last)
+        return;
+
+    /* Closes the stats window if the skipped periods crossed its end */
+    close_window = g_stats_window_periods > 0 &&
+        (period % g_stats_window_periods == 0 || period / g_stats_window_periods != last / g_stats_window_periods);
+
+    start_cluster_period(cluster_info, close_window, period - last - 1);
+}
+
+/* Idle ticking: an idle core stops its timer, unless it stalls, samples the GPU or reads the cluster counter */
+static inline int can_park(struct core_info *core_info) {
+    struct cluster_info *cluster_info = core_info->cluster_info;
+
+    if (!is_idle_task(current) || core_info->throttled_task || core_info->profile_gpu_bandwidth || module_unloading)
+        return 0;
+
+    return !(cluster_info->cluster_event && cluster_info->cluster_event_cpu == core_info->cpu);
+}
+
+static void park_core(struct core_info *core_info) {
+    core_info->parked_time = ktime_get();
+    cpumask_set_cpu(core_info->cpu, core_info->cluster_info->parked_mask);
+    WRITE_ONCE(core_info->parked, 1);
+    STATS_ADD(&core_info->stats, parks, 1);
+}
+
+/*
+ * Start the timer of this core at the first T_A boundary after 'now', on
+ * the grid of the other cores (tick 'cnt' expires at start_time +
+ * (cnt - 1) * T_A). The global count then takes the core along.
+ */
+static void start_timer_at_next_tick(struct core_info *core_info, ktime_t now) {
+    s64 cnt = div64_s64(ktime_to_ns(ktime_sub(now, core_info->start_time)), g_aggregation_period_us * 1000LL) + 1;
+
+    core_info->aggregation_period_cnt = cnt;
+    core_info->next_tick_cnt = cnt + 1;
+    hrtimer_start(&core_info->hr_timer, ktime_add_ns(core_info->start_time, cnt * g_aggregation_period_us * 1000LL),
+                  HRTIMER_MODE_ABS_PINNED);
+}
+
+/*
+ * irq_work queued by the first context switch out of idle: restart the
+ * timer at the next T_A boundary. The counter kept running, so the first
+ * tick charges what the core used meanwhile, and the period count catches
+ * up from the time.
+ */
+static void unpark_core(struct irq_work *work) {
+    struct core_info *core_info = container_of(work, struct core_info, unpark_work);
+    ktime_t now = ktime_get();
+
+    if (!core_info->parked || module_unloading)
+        return;
+
+    WRITE_ONCE(core_info->parked, 0);
+    cpumask_clear_cpu(core_info->cpu, core_info->cluster_info->parked_mask);
+    STATS_ADD(&core_info->stats, parked_ns, ktime_to_ns(ktime_sub(now, core_info->parked_time)));
+
+    start_timer_at_next_tick(core_info, now);
+}
+
+/* Idle ticking: wake a parked core's timer up when it leaves the idle task */
+static void cl_mem_reg_sched_switch(void *data, bool preempt, struct task_struct *prev, struct task_struct *next
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 18, 0)
+                                    , unsigned int prev_state
+#endif
+                                    ) {
+    struct core_info *core_info = this_cpu_ptr(_core_info);
+
+    if (is_idle_task(prev) && READ_ONCE(core_info->parked))
+        irq_work_queue(&core_info->unpark_work);
+}
+
+static void find_sched_switch(struct tracepoint *tp, void *priv) {
+    if (!strcmp(tp->name, "sched_switch"))
+        *(struct tracepoint **)priv = tp;
+}
+
+static void account_regulation_period(struct cluster_info *cluster_info, s64 usage, int throttled) {
+    struct cluster_stats *stats = &cluster_info->stats;
+    s64 budget = cluster_info->cur_bandwidth_budget;
+
+    STATS_ADD(stats, periods, 1);
+    STATS_ADD(stats, used_events, usage);
+    STATS_ADD(stats, budget_events, budget);
+    STATS_ADD(stats, throttle_broadcasts, atomic_xchg(&cluster_info->throttle_broadcasts, 0));
+    STATS_ADD(stats, duplicate_throttle_requests, atomic_xchg(&cluster_info->duplicate_requests, 0));
+
+    spin_lock(&cluster_info->release_lock);
+    if (cluster_info->release_skew_ns >= 0) {
+        STATS_ADD(stats, release_skews, 1);
+        STATS_ADD(stats, release_skew_sum_ns, cluster_info->release_skew_ns);
+        STATS_MAX(stats, release_skew_max_ns, cluster_info->release_skew_ns);
+        cluster_info->release_skew_ns = -1;
+    }
+    spin_unlock(&cluster_info->release_lock);
+
+    /* Usage kept growing after the throttle request (in-flight misses, GPU) */
+    cluster_info->prev_read_throttle_error = usage > budget;
+    if (cluster_info->prev_read_throttle_error) {
+        u64 overshoot = usage - budget;
+
+        STATS_ADD(stats, overrun_periods, 1);
+        STATS_ADD(stats, overshoot_events, overshoot);
+        STATS_MAX(stats, overshoot_max_events, overshoot);
+    }
+
+    if (cluster_info->sub_budgets) {
+        s64 cpu_usage = atomic_read(&cluster_info->cpu_usage), gpu_usage = atomic_read(&cluster_info->gpu_usage);
+
+        if (cl_mem_reg_model__class_over_budget(cpu_usage, cluster_info->cpu_reservation, gpu_usage,
+                                                cluster_info->gpu_reservation, cur_shared_pool(cluster_info)))
+            STATS_ADD(stats, cpu_over_periods, 1);
+        if (cl_mem_reg_model__class_over_budget(gpu_usage, cluster_info->gpu_reservation, cpu_usage,
+                                                cluster_info->cpu_reservation, cur_shared_pool(cluster_info)))
+            STATS_ADD(stats, gpu_over_periods, 1);
+    }
+
+    if (throttled) {
+        STATS_ADD(stats, throttled_periods, 1);
+        STATS_ADD(stats, throttled_ns, ktime_to_ns(ktime_sub(ktime_get(), cluster_info->throttled_time)));
+    }
+}
+
+static void aggregation_period_func(void) {
+    struct core_info *core_info = this_cpu_ptr(_core_info);
+    struct cluster_info *cluster_info = core_info->cluster_info;
+    struct cgroup_budget *cgroup_budget;
+    s64 cur_cpu_bandwidth_usage; // events
+    u64 cur_read; // counted events
+    size_t profiling_info_buf_size = 0;
+    struct timespec64 time;
+    struct task_struct* gpu_profiler_task = NULL;
+    int gpu_profiling_signal;
+
+    if(module_unloading) return;
+
+    ktime_get_real_ts64(&time);
+    
+    /* Profiling CPU memory bandwidth usage, in LLC events at the core's cost */
+    cur_read = get_read_event_used(core_info);
+    core_info->old_read_val += cur_read;
+    cur_cpu_bandwidth_usage = weigh_core_events(core_info, cur_read);
+    if (cur_cpu_bandwidth_usage) {
+        atomic_add(cur_cpu_bandwidth_usage, &cluster_info->bandwidth_usage);
+        atomic_add(cur_cpu_bandwidth_usage, &cluster_info->cpu_usage);
+    }
+    STATS_ADD(&core_info->stats, events, cur_cpu_bandwidth_usage);
+    cgroup_budget = charge_cgroup(cluster_info, cur_cpu_bandwidth_usage);
+
+    trace_cl_mem_reg_aggregation(core_info->cpu, cluster_info->id, cur_cpu_bandwidth_usage,
+                                 atomic_read(&cluster_info->bandwidth_usage), cluster_info->cur_bandwidth_budget);
+
+    update_live_core(core_info);
+    if (core_info->cpu == READ_ONCE(cluster_info->leader_core))
+        update_live_cluster(cluster_info);
+
+    /* Profiling GPU memory bandwidth usage */
+    if (core_info->profile_gpu_bandwidth) {
+
+        if(core_info->cpu < 4) {
+            gpu_profiler_task = gpu_profiler_task_cl1;
+            gpu_profiling_signal = GPU_PROFILING_SIGNAL_CL1;
+        }
+        else{
+            gpu_profiler_task = gpu_profiler_task_cl2;
+            gpu_profiling_signal = GPU_PROFILING_SIGNAL_CL2;
+        }
+
+        if(gpu_profiler_task && pid_alive(gpu_profiler_task)) {
+            /* Request GPU memory bandwidth profiling */
+            request_gpu_sample(gpu_profiler_task, gpu_profiling_signal);
+        }
+    }
+
+    /* Logging (CPU) */
+    if (g_logging == LOGGING_BINARY && g_cpu_log_writers[core_info->cpu]) {
+        struct cl_mem_reg_log_record record = {
+            .period = cluster_info->regulation_period_cnt,
+            .ts_ns = timespec64_to_ns(&time),
+            .events = cur_cpu_bandwidth_usage,
+            .usage = atomic_read(&cluster_info->cpu_usage),
+            .throttled = cluster_info->is_throttled,
+        };
+
+        log_writer_append(g_cpu_log_writers[core_info->cpu], &record);
+    }
+    else if(g_logging && g_cpu_logging_files[core_info->cpu]) {
+        struct logging_work* logging_work_data;
+
+        logging_work_data = kmalloc(sizeof(struct logging_work), GFP_ATOMIC);
+        if(!logging_work_data) {
+            pr_err("Failed to allocate memory for logging work");
+            return;
+        }
+
+        INIT_WORK(&logging_work_data->work, logging_work_func);
+
+        logging_work_data->file = g_cpu_logging_files[core_info->cpu];
+        profiling_info_buf_size = snprintf(logging_work_data->buf, LOGGING_BUF_SIZE, "%llu,%lld.%09ld,%llu,%d,%d\n", cluster_info->regulation_period_cnt, (long long)time.tv_sec, time.tv_nsec, cur_cpu_bandwidth_usage, atomic_read(&cluster_info->cpu_usage), cluster_info->is_throttled);
+        profiling_info_buf_size = profiling_info_buf_size > LOGGING_BUF_SIZE ? LOGGING_BUF_SIZE : profiling_info_buf_size;
+        
+        queue_work_on(core_info->cpu, g_logging_workqueue, &logging_work_data->work);
+    }
+
+
+    /* Check if the core is throttled (until the end of the period) */
+    if (core_info->throttled_task != NULL && !READ_ONCE(core_info->throttle_until)) {
+        return;
+    }
+
+    /* The running cgroup used up its own share: stall this core only */
+    if (cgroup_budget && atomic_read(&cgroup_budget->over[cluster_info->id - 1])) {
+        throttle_core(core_info);
+        return;
+    }
+
+
+    /* Already broadcast: a core that was spared (critical task, exempt) stalls here if it no longer is */
+    if (g_coordinated_regulation && atomic_read(&cluster_info->throttle_requested)) {
+        if (core_info->cpu == cluster_info->leader_core) cluster_info->is_throttled = 1;
+        throttle_core(core_info);
+        return;
+    }
+
+    /* Throttle core if the read usage exceeds the current budget */
+    if (cpu_over_budget(cluster_info)) {
+        if (core_info->cpu == cluster_info->leader_core) cluster_info->is_throttled = 1;
+        throttle_cluster(cluster_info);
+    }
+    else if (g_throttle_mode == THROTTLE_MODE_DUTY) {
+        duty_cycle_throttle(core_info, cur_cpu_bandwidth_usage);
+    }
+
+    g_debug_cnt++;
+
+    return;
+}
+
+static int gpu_beats_receiver_thread_func_cl1(void* arg) {
+    struct sched_param param;
+    struct cluster_info *cluster_info;
+    int* gpu_beats = NULL;
+    s64 cur_gpu_bandwidth_usage = 0;        // events
+    int profiling_info_buf_size = 0;
+    struct timespec64 time;
+
+    /* Get proper cluster info */
+    cluster_info = &_cluster_info_cl1;
+
+    /* Set higher priority than throttle_thread */
+    param.sched_priority = MAX_RT_PRIO - 1; 
+    sched_setscheduler(current, SCHED_FIFO, &param);
+
+    gpu_beats = (int*)gpu_beats_memory_cl1;
+
+    while (!kthread_should_stop()) {
+        /* Wait for GPU beats to be ready */
+        wait_event_interruptible(gpu_beats_receiver_waitqueue_cl1, gpu_beats_ready_cl1 || kthread_should_stop());
+
+        ktime_get_real_ts64(&time);
+
+        /* Bytes per beat: cost_table (default: 16) */
+        cur_gpu_bandwidth_usage = weigh_gpu_beats(cluster_info, gpu_beats[GPU_RD_BEATS_IDX], gpu_beats[GPU_WR_BEATS_IDX]);
+        atomic_add(cur_gpu_bandwidth_usage, &cluster_info->bandwidth_usage);
+        atomic_add(cur_gpu_bandwidth_usage, &cluster_info->gpu_usage);
+        STATS_ADD(&cluster_info->stats, gpu_events, cur_gpu_bandwidth_usage);
+
+        trace_cl_mem_reg_gpu_beats(cluster_info->id, gpu_beats[GPU_RD_BEATS_IDX], gpu_beats[GPU_WR_BEATS_IDX],
+                                   cur_gpu_bandwidth_usage, atomic_read(&cluster_info->bandwidth_usage));
+
+        /* Logging (GPU) */
+        if (g_logging == LOGGING_BINARY && g_gpu_log_writer_cl1) {
+            struct cl_mem_reg_log_record record = {
+                .period = cluster_info->regulation_period_cnt,
+                .ts_ns = timespec64_to_ns(&time),
+                .events = cur_gpu_bandwidth_usage,
+                .usage = atomic_read(&cluster_info->gpu_usage),
+                .rd_beats = gpu_beats[GPU_RD_BEATS_IDX],
+                .wr_beats = gpu_beats[GPU_WR_BEATS_IDX],
+                .throttled = cluster_info->is_throttled,
+            };
+
+            log_writer_append(g_gpu_log_writer_cl1, &record);
+        }
+        else if(g_logging && g_gpu_logging_file_cl1) {
+            struct logging_work* logging_work_data;
+
+            logging_work_data = kmalloc(sizeof(struct logging_work), GFP_ATOMIC);
+            if(!logging_work_data) {
+                pr_err("Failed to allocate memory for logging work");
+                return -1;
+            }
+
+            INIT_WORK(&logging_work_data->work, logging_work_func);
+            logging_work_data->file = g_gpu_logging_file_cl1;
+            profiling_info_buf_size = snprintf(logging_work_data->buf, LOGGING_BUF_SIZE, "%llu,%lld.%09ld,%llu,%llu,%llu,%d,%d\n", cluster_info->regulation_period_cnt, (long long)time.tv_sec, time.tv_nsec, cur_gpu_bandwidth_usage, (uint64_t)gpu_beats[GPU_RD_BEATS_IDX], (uint64_t)gpu_beats[GPU_WR_BEATS_IDX], atomic_read(&cluster_info->gpu_usage), cluster_info->is_throttled);
+            profiling_info_buf_size = profiling_info_buf_size > LOGGING_BUF_SIZE ? LOGGING_BUF_SIZE : profiling_info_buf_size;
+            logging_work_data->buf[profiling_info_buf_size] = '\0';
+            
+            queue_work(g_logging_workqueue, &logging_work_data->work);
+        }
+
+        gpu_beats[GPU_RD_BEATS_IDX] = GPU_BEATS_CLEANED;
+        gpu_beats[GPU_WR_BEATS_IDX] = GPU_BEATS_CLEANED;
+
+        gpu_beats_ready_cl1 = 0;
+
+        /* Throttle (or report) if the GPU exceeds its share */
+        gpu_over_budget(cluster_info);
+    }
+
+    return 0;
+}
+
+static int gpu_beats_receiver_thread_func_cl2(void* arg) {
+    struct sched_param param;
+    struct cluster_info *cluster_info;
+    int* gpu_beats = NULL;
+    s64 cur_gpu_bandwidth_usage = 0;        // events
+    int profiling_info_buf_size = 0;
+    struct timespec64 time;
+
+    /* Get proper cluster info */
+    cluster_info = &_cluster_info_cl2;
+
+    /* Set higher priority than throttle_thread */
+    param.sched_priority = MAX_RT_PRIO - 1; 
+    sched_setscheduler(current, SCHED_FIFO, &param);
+
+    gpu_beats = (int*)gpu_beats_memory_cl2;
+
+    while (!kthread_should_stop()) {
+        /* Wait for GPU beats to be ready */
+        wait_event_interruptible(gpu_beats_receiver_waitqueue_cl2, gpu_beats_ready_cl2 || kthread_should_stop());
+
+        ktime_get_real_ts64(&time);
+
+        /* Bytes per beat: cost_table (default: 16) */
+        cur_gpu_bandwidth_usage = weigh_gpu_beats(cluster_info, gpu_beats[GPU_RD_BEATS_IDX], gpu_beats[GPU_WR_BEATS_IDX]);
+        atomic_add(cur_gpu_bandwidth_usage, &cluster_info->bandwidth_usage);
+        atomic_add(cur_gpu_bandwidth_usage, &cluster_info->gpu_usage);
+        STATS_ADD(&cluster_info->stats, gpu_events, cur_gpu_bandwidth_usage);
+
+        trace_cl_mem_reg_gpu_beats(cluster_info->id, gpu_beats[GPU_RD_BEATS_IDX], gpu_beats[GPU_WR_BEATS_IDX],
+                                   cur_gpu_bandwidth_usage, atomic_read(&cluster_info->bandwidth_usage));
+
+        /* Logging (GPU) */
+        if (g_logging == LOGGING_BINARY && g_gpu_log_writer_cl2) {
+            struct cl_mem_reg_log_record record = {
+                .period = cluster_info->regulation_period_cnt,
+                .ts_ns = timespec64_to_ns(&time),
+                .events = cur_gpu_bandwidth_usage,
+                .usage = atomic_read(&cluster_info->gpu_usage),
+                .rd_beats = gpu_beats[GPU_RD_BEATS_IDX],
+                .wr_beats = gpu_beats[GPU_WR_BEATS_IDX],
+                .throttled = cluster_info->is_throttled,
+            };
+
+            log_writer_append(g_gpu_log_writer_cl2, &record);
+        }
+        else if(g_logging && g_gpu_logging_file_cl2) {
+            struct logging_work* logging_work_data;
+
+            logging_work_data = kmalloc(sizeof(struct logging_work), GFP_ATOMIC);
+            if(!logging_work_data) {
+                pr_err("Failed to allocate memory for logging work");
+                return -1;
+            }
+
+            INIT_WORK(&logging_work_data->work, logging_work_func);
+            logging_work_data->file = g_gpu_logging_file_cl2;
+            profiling_info_buf_size = snprintf(logging_work_data->buf, LOGGING_BUF_SIZE, "%llu,%lld.%09ld,%llu,%llu,%llu,%d,%d\n", cluster_info->regulation_period_cnt, (long long)time.tv_sec, time.tv_nsec, cur_gpu_bandwidth_usage, (uint64_t)gpu_beats[GPU_RD_BEATS_IDX], (uint64_t)gpu_beats[GPU_WR_BEATS_IDX], atomic_read(&cluster_info->gpu_usage), cluster_info->is_throttled);
+            profiling_info_buf_size = profiling_info_buf_size > LOGGING_BUF_SIZE ? LOGGING_BUF_SIZE : profiling_info_buf_size;
+            logging_work_data->buf[profiling_info_buf_size] = '\0';
+            
+            queue_work(g_logging_workqueue, &logging_work_data->work);
+        }
+
+        gpu_beats[GPU_RD_BEATS_IDX] = GPU_BEATS_CLEANED;
+        gpu_beats[GPU_WR_BEATS_IDX] = GPU_BEATS_CLEANED;
+
+        gpu_beats_ready_cl2 = 0;
+
+        /* Throttle (or report) if the GPU exceeds its share */
+        gpu_over_budget(cluster_info);
+    }
+
+    return 0;
+}
+
+static inline void logging_work_func(struct work_struct* work) {
+    struct logging_work *logging_work_data = container_of(work, struct logging_work, work);
+    loff_t pos = 0;
+    mm_segment_t old_fs;
+
+    if (!logging_work_data->file) {
+        pr_debug("File pointer is NULL in logging_work_func");
+        kfree(logging_work_data);
+        return;
+    }
+
+    pos = vfs_llseek(logging_work_data->file, 0, SEEK_END);
+
+    old_fs = get_fs();
+    set_fs(KERNEL_DS);
+
+    kernel_write(logging_work_data->file, logging_work_data->buf, strlen(logging_work_data->buf), &pos);
+
+    set_fs(old_fs);
+
+    kfree(logging_work_data);
+}
+
+static void log_writer_flush_func(struct work_struct *work) {
+    struct log_writer *writer = container_of(work, struct log_writer, work);
+
+    kernel_write(writer->file, writer->flush_buf, writer->flush_len, &writer->pos);
+    atomic_set_release(&writer->flushing, 0);
+}
+
+/* Only ever called by the file's producer, so the active buffer needs no lock */
+static void log_writer_append(struct log_writer *writer, const struct cl_mem_reg_log_record *record) {
+    if (writer->len + CL_MEM_REG_LOG_MAX_RECORD > LOG_WRITER_BUF_SIZE) {
+        /* Both buffers full: the writeback is behind */
+        if (atomic_read_acquire(&writer->flushing)) {
+            writer->dropped++;
+            return;
+        }
+
+        writer->flush_buf = writer->buf[writer->active];
+        writer->flush_len = writer->len;
+        writer->active ^= 1;
+        writer->len = 0;
+        atomic_set(&writer->flushing, 1);
+
+        if (writer->cpu >= 0)
+            queue_work_on(writer->cpu, g_logging_workqueue, &writer->work);
+        else
+            queue_work(g_logging_workqueue, &writer->work);
+    }
+
+    writer->len += cl_mem_reg_log__encode(&writer->state, writer->source, record, writer->buf[writer->active] + writer->len);
+}
+
+/* Creates 'path' and writes the header: T_A, T_R, budgets and cluster layout at the time logging starts */
+static struct log_writer *log_writer_open(const char *path, int source, int id, struct cluster_info *cluster_info, int cpu) {
+    struct cluster_info *clusters[NUMBER_OF_CLUSTERS] = {&_cluster_info_cl1, &_cluster_info_cl2};
+    struct cl_mem_reg_log_header header = {
+        .magic = CL_MEM_REG_LOG_MAGIC,
+        .version = CL_MEM_REG_LOG_VERSION,
+        .source = source,
+        .id = id,
+        .cluster = cluster_info->id,
+        .nr_clusters = NUMBER_OF_CLUSTERS,
+        .aggregation_period_us = g_aggregation_period_us,
+        .regulation_period_us = g_regulation_period_us,
+        .start_ns = ktime_get_real_ns(),
+    };
+    struct log_writer *writer;
+    int c;
+
+    for (c = 0; c < NUMBER_OF_CLUSTERS; c++) {
+        header.budget_mb[c] = convert_events_to_mb(clusters[c]->bandwidth_budget);
+        header.cluster_mask[c] = cpumask_bits(clusters[c]->member_mask)[0];
+    }
+
+    writer = kzalloc(sizeof(*writer), GFP_KERNEL);
+    if (!writer)
+        return NULL;
+
+    writer->buf[0] = vmalloc(LOG_WRITER_BUF_SIZE);
+    writer->buf[1] = vmalloc(LOG_WRITER_BUF_SIZE);
+    if (!writer->buf[0] || !writer->buf[1])
+        goto err;
+
+    writer->file = filp_open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (IS_ERR(writer->file)) {
+        pr_err("Failed to open file %s: %ld", path, PTR_ERR(writer->file));
+        goto err;
+    }
+
+    writer->source = source;
+    writer->cpu = cpu;
+    atomic_set(&writer->flushing, 0);
+    INIT_WORK(&writer->work, log_writer_flush_func);
+
+    kernel_write(writer->file, &header, sizeof(header), &writer->pos);
+
+    return writer;
+
+err:
+    vfree(writer->buf[0]);
+    vfree(writer->buf[1]);
+    kfree(writer);
+    return NULL;
+}
+
+/* After the producer stopped: writes what is left and closes the file */
+static void log_writer_close(struct log_writer *writer) {
+    if (!writer)
+        return;
+
+    flush_work(&writer->work);
+    if (writer->len)
+        kernel_write(writer->file, writer->buf[writer->active], writer->len, &writer->pos);
+    if (writer->dropped)
+        pr_warn("%llu log records dropped (cpu%d)", writer->dropped, writer->cpu);
+
+    filp_close(writer->file, NULL);
+    vfree(writer->buf[0]);
+    vfree(writer->buf[1]);
+    kfree(writer);
+}
+
+static void timer_callback_slave(struct core_info *core_info) {
+    /* setup an interrupt */
+    if (core_info->read_event)
+        local64_set(&core_info->read_event->hw.period_left, convert_mb_to_events(DEFAULT_RD_BUDGET_MB));
+}
+
+static struct perf_event *init_counter(int cpu, int budget, u32 type, u64 config, void *callback) {
+    struct perf_event *event = NULL;
+    struct perf_event_attr sched_perf_hw_attr = {
+        .type = type,
+        .size = sizeof(struct perf_event_attr),
+        .pinned = 1,
+        .disabled = 1,
+        .config = config,
+        .sample_period = budget,
+        .exclude_kernel = 0,           // 1 mean, no kernel mode counting
+        .exclude_hv = 0,               // don't count hypervisor
+        .exclude_idle = 0,             // don't count when idle
+        .exclude_host = 0,             // don't count in host
+        .exclude_guest = 0,            // don't count in guest
+        .exclude_callchain_kernel = 0, // exclude kernel callchains
+        .exclude_callchain_user = 0,
+    };
+
+    /* Try to register using hardware perf events */
+    event = perf_event_create_kernel_counter(&sched_perf_hw_attr, cpu, NULL, callback
+#if LINUX_VERSION_CODE > KERNEL_VERSION(3, 2, 0)
+                                             ,
+                                             NULL
+#endif
+    );
+
+    if (!event)
+        return NULL;
+
+    if (IS_ERR(event)) {
+        /* vary the KERN level based on the returned errno */
+        if (PTR_ERR(event) == -EOPNOTSUPP)
+            pr_info("cpu%d. not supported\n", cpu);
+        else if (PTR_ERR(event) == -ENOENT)
+            pr_info("cpu%d. not h/w event\n", cpu);
+        else
+            pr_err("cpu%d. unable to create perf event: %ld\n", cpu, PTR_ERR(event));
+        return NULL;
+    }
+
+    /* success path */
+    pr_info("cpu%d enabled counter type %u config 0x%llx\n", cpu, type, (unsigned long long)config);
+
+    return event;
+}
+
+/** Perf sources: a per-core PMU event, read without overflow interrupts */
+static int perf_counter_init(struct core_info *core_info, u32 type, u64 config) {
+    core_info->read_event = init_counter(core_info->cpu, INT_MAX, type, config, NULL);
+    if (!core_info->read_event)
+        return -ENODEV;
+
+    perf_event_enable(core_info->read_event);
+
+    return 0;
+}
+
+static int raw_counter_init(struct core_info *core_info) { return perf_counter_init(core_info, PERF_TYPE_RAW, g_read_counter_id); }
+static int cache_misses_counter_init(struct core_info *core_info) { return perf_counter_init(core_info, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES); }
+
+static void perf_counter_release(struct core_info *core_info) {
+    perf_event_disable(core_info->read_event);
+    perf_event_release_kernel(core_info->read_event);
+    core_info->read_event = NULL;
+}
+
+static void perf_counter_stop(struct core_info *core_info) { core_info->read_event->pmu->stop(core_info->read_event, PERF_EF_UPDATE); }
+static void perf_counter_start(struct core_info *core_info) { core_info->read_event->pmu->start(core_info->read_event, PERF_EF_RELOAD); }
+static u64 perf_counter_read(struct core_info *core_info) { return perf_event_count(core_info->read_event); }
+
+/**
+ * Synthetic source: events at a per-core rate set through debugfs
+ * (synthetic_rate), for VMs and CI machines without a usable PMU.
+ * A throttled core generates no events, as a stalled core would.
+ */
+static void synthetic_counter_update(struct core_info *core_info) {
+    ktime_t now = ktime_get();
+    u64 elapsed = ktime_to_ns(ktime_sub(now, core_info->synthetic_last));
+    u64 events_per_sec = (u64)READ_ONCE(core_info->synthetic_rate_mb) * 1024 * 1024 / CL_MEM_REG_CACHE_LINE_SIZE;
+
+    core_info->synthetic_last = now;
+    if (core_info->throttled_task)
+        return;
+
+    /* Bound the product; a tick is never a second late */
+    if (elapsed > NSEC_PER_SEC)
+        elapsed = NSEC_PER_SEC;
+
+    core_info->synthetic_count += div64_u64_rem(events_per_sec * elapsed + core_info->synthetic_rem, NSEC_PER_SEC,
+                                                &core_info->synthetic_rem);
+}
+
+static int synthetic_counter_init(struct core_info *core_info) {
+    core_info->synthetic_rate_mb = g_synthetic_rate_mb;
+    core_info->synthetic_count = 0;
+    core_info->synthetic_rem = 0;
+    core_info->synthetic_last = ktime_get();
+
+    return 0;
+}
+
+static void synthetic_counter_release(struct core_info *core_info) { }
+static void synthetic_counter_stop(struct core_info *core_info) { synthetic_counter_update(core_info); }
+static void synthetic_counter_start(struct core_info *core_info) { }
+
+static u64 synthetic_counter_read(struct core_info *core_info) {
+    synthetic_counter_update(core_info);
+
+    return core_info->synthetic_count;
+}
+
+/**
+ * Cluster source: the cluster's PMU counter (DSU L3/bus, x86 uncore) counts
+ * the traffic of every core, including prefetch and write-back traffic that
+ * per-core refill counters miss. Only the core the PMU driver bound the
+ * event to reads it; the cluster's events are charged to that core.
+ */
+static void cluster_counter_nop(struct core_info *core_info) { }
+
+static u64 cluster_counter_read(struct core_info *core_info) {
+    struct cluster_info *cluster_info = core_info->cluster_info;
+    u64 value;
+
+    if (core_info->cpu != cluster_info->cluster_event_cpu)
+        return 0;
+
+    if (perf_event_read_local(cluster_info->cluster_event, &value, NULL, NULL))
+        return core_info->old_read_val;
+
+    return value;
+}
+
+static const struct counter_source cluster_counter_source = {
+    .name = "cluster",
+    .release = cluster_counter_nop,
+    .stop = cluster_counter_nop,
+    .start = cluster_counter_nop,
+    .read = cluster_counter_read,
+};
+
+static void init_cluster_counter(struct cluster_info *cluster_info, int type, u64 config) {
+    struct perf_event *event;
+    unsigned int cpu;
+
+    if (type < 0)
+        return;
+
+    /* Counting only: uncore PMUs reject sampling events. Read by a regulated core (at load: any online one) */
+    cpu = cpumask_empty(cluster_info->cpu_mask) ? cpumask_any_and(cluster_info->member_mask, cpu_online_mask) :
+        cpumask_first(cluster_info->cpu_mask);
+    if (cpu >= nr_cpu_ids)
+        return;
+
+    event = init_counter(cpu, 0, type, config, NULL);
+    if (!event) {
+        pr_warn("cluster%d: cluster PMU unavailable, summing per-core counters\n", cluster_info->id);
+        return;
+    }
+
+    /* The PMU driver may move the event to its own reader CPU */
+    if (!cpumask_test_cpu(event->cpu, cluster_info->member_mask) || !cpu_online(event->cpu)) {
+        pr_warn("cluster%d: cluster PMU bound to cpu%d outside the cluster, summing per-core counters\n",
+                cluster_info->id, event->cpu);
+        perf_event_release_kernel(event);
+        return;
+    }
+
+    perf_event_enable(event);
+    cluster_info->cluster_event = event;
+    cluster_info->cluster_event_cpu = event->cpu;
+    pr_info("cluster%d: cluster PMU type %d config 0x%llx read by cpu%d\n", cluster_info->id, type,
+            (unsigned long long)config, event->cpu);
+}
+
+static void release_cluster_counter(struct cluster_info *cluster_info) {
+    if (!cluster_info->cluster_event)
+        return;
+
+    perf_event_disable(cluster_info->cluster_event);
+    perf_event_release_kernel(cluster_info->cluster_event);
+    cluster_info->cluster_event = NULL;
+}
+
+/* In 'auto' fallback order */
+static const struct counter_source counter_sources[] = {
+    {
+        .name = "raw",
+        .init = raw_counter_init,
+        .release = perf_counter_release,
+        .stop = perf_counter_stop,
+        .start = perf_counter_start,
+        .read = perf_counter_read,
+    },
+    {
+        .name = "cache_misses",
+        .init = cache_misses_counter_init,
+        .release = perf_counter_release,
+        .stop = perf_counter_stop,
+        .start = perf_counter_start,
+        .read = perf_counter_read,
+    },
+    {
+        .name = "synthetic",
+        .init = synthetic_counter_init,
+        .release = synthetic_counter_release,
+        .stop = synthetic_counter_stop,
+        .start = synthetic_counter_start,
+        .read = synthetic_counter_read,
+    },
+};
+
+/* g_counter_source, or with 'auto' the first source that works on this core */
+static int init_counter_source(struct core_info *core_info) {
+    int auto_select = !strcmp(g_counter_source, "auto");
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(counter_sources); i++) {
+        const struct counter_source *source = &counter_sources[i];
+
+        if (!auto_select && strcmp(g_counter_source, source->name))
+            continue;
+
+        if (source->init(core_info) == 0) {
+            core_info->counter_source = source;
+            pr_info("cpu%d counter source: %s\n", core_info->cpu, source->name);
+            return 0;
+        }
+
+        if (!auto_select)
+            break;
+        pr_warn("cpu%d counter source %s unavailable, falling back\n", core_info->cpu, source->name);
+    }
+
+    pr_err("cpu%d no counter source (g_counter_source=%s)\n", core_info->cpu, g_counter_source);
+
+    return -ENODEV;
+}
+
+static void __start_counter(void *info) {
+
+    struct global_info *global = &global_info;
+    struct core_info *core_info = this_cpu_ptr(_core_info);
+    struct cluster_info *cluster_info;
+    int cpu, min_cpu, max_cpu;
+    
+    cpu = smp_processor_id();
+    cluster_info = core_info->cluster_info;
+    core_info->start_time = global->start_time;
+
+    if (!cpumask_test_cpu(cpu, cluster_info->cpu_mask)) {
+        g_hrtimer_start[cpu] = KTIME_MAX;
+        return;
+    }
+
+    if(cpu < 4) {
+        cluster_info = &_cluster_info_cl1;
+        min_cpu = 0;
+        max_cpu = 3;
+    }
+    else{
+        cluster_info = &_cluster_info_cl2;
+        min_cpu = 4;
+        max_cpu = 7;
+    }
+    
+
+    BUG_ON(!core_info->counter_source);
+
+    /* start timer (initialized by cl_mem_reg_cpu_online) */
+    hrtimer_start(&core_info->hr_timer, global->start_time, HRTIMER_MODE_ABS_PINNED);
+    g_hrtimer_start[cpu] = ktime_get();
+    for(cpu = min_cpu; cpu < max_cpu + 1; cpu++) {
+        ktime_t* leader_hrtimer_start;
+
+        if (!cpumask_test_cpu(core_info->cpu, cluster_info->cpu_mask)) {
+            continue;
+        }
+
+        if(cpu < 4) {
+            leader_hrtimer_start = &g_leader_hrtimer_start_cl1;
+        }
+        else{
+            leader_hrtimer_start = &g_leader_hrtimer_start_cl2;
+        }
+
+        if (g_hrtimer_start[cpu] < *leader_hrtimer_start) {
+            *leader_hrtimer_start = g_hrtimer_start[cpu];
+            cluster_info->leader_core = cpu;
+        }
+    }
+
+    pr_debug("LEADER CORE: %d", cluster_info->leader_core);
+
+    core_info->aggregation_period_cnt = 0;
+    core_info->next_tick_cnt = 1;
+    core_info->throttled_task = NULL;
+
+    return;
+}
+
+static void __stop_counter(void *info) {
+
+    struct core_info *core_info = this_cpu_ptr(_core_info);
+    struct cluster_info *cluster_info;
+
+    cluster_info = core_info->cluster_info;
+
+    if (!cpumask_test_cpu(core_info->cpu, cluster_info->cpu_mask)) {
+        return;
+    }
+
+    pr_debug("stop counter - cpu: %d", core_info->cpu);
+
+    cluster_info = core_info->cluster_info;
+
+    BUG_ON(!core_info->counter_source);
+
+    /* stop the throttled thread */
+    core_info->throttled_task = NULL;
+    core_info->aggregation_period_cnt = -1;
+
+    /* stop the counter */
+    core_info->counter_source->stop(core_info);
+
+    /* stop timer */
+    hrtimer_cancel(&core_info->hr_timer);
+
+    pr_debug("##  End of stop counter");
+
+    return;
+}
+
+/* Cluster of a core, NULL if the core is not regulated */
+static inline struct cluster_info *cpu_cluster(unsigned int cpu) {
+    if (cpumask_test_cpu(cpu, _cluster_info_cl1.member_mask))
+        return &_cluster_info_cl1;
+    if (cpumask_test_cpu(cpu, _cluster_info_cl2.member_mask))
+        return &_cluster_info_cl2;
+
+    return NULL;
+}
+
+/* Core configured to sample the cluster's GPU, -1: no GPU profiling */
+static inline int gpu_profiling_core(struct cluster_info *cluster_info) {
+    if (cluster_info->id == 1)
+        return g_gpu_profiling_cl1 ? g_gpu_profiling_core_cl1 : -1;
+
+    return g_gpu_profiling_cl2 ? g_gpu_profiling_core_cl2 : -1;
+}
+
+/* Hand the GPU sampling role of a cluster's regulated cores to 'cpu' (hotplug, serialized) */
+static void move_gpu_sampling(struct cluster_info *cluster_info, unsigned int cpu) {
+    unsigned int other;
+
+    for_each_cpu(other, cluster_info->cpu_mask) {
+        if (other != cpu && per_cpu_ptr(_core_info, other)->profile_gpu_bandwidth) {
+            WRITE_ONCE(per_cpu_ptr(_core_info, other)->profile_gpu_bandwidth, 0);
+            break;
+        }
+    }
+    WRITE_ONCE(per_cpu_ptr(_core_info, cpu)->profile_gpu_bandwidth, 1);
+    pr_info("cluster%d: GPU sampling moved to cpu%u\n", cluster_info->id, cpu);
+}
+
+/*
+ * CPU hotplug: regulate a core of a cluster as it comes online (at load,
+ * every online core). Runs on the core. Once loaded, the core joins the
+ * current regulation period at the next T_A boundary.
+ */
+static int cl_mem_reg_cpu_online(unsigned int cpu) {
+    struct core_info *core_info = per_cpu_ptr(_core_info, cpu);
+    struct cluster_info *cluster_info = cpu_cluster(cpu);
+    struct task_struct *thread;
+
+    core_info->cpu = cpu;
+    if (!cluster_info)
+        return 0;
+
+    core_info->cluster_info = cluster_info;
+    core_info->throttled_task = NULL;
+    core_info->throttled_time = ktime_set(0, 0);
+    core_info->throttle_until = ktime_set(0, 0);
+    core_info->duty = 0;
+    core_info->parked = 0;
+    core_info->old_read_val = 0;
+
+    if (cluster_info->cluster_event) {
+        core_info->counter_source = &cluster_counter_source;
+    }
+    else if (init_counter_source(core_info) < 0) {
+        /* Keep the core usable: it is just not regulated */
+        if (!module_loaded)
+            return -ENODEV;
+        pr_err("cpu%u: no counter source, the core is not regulated\n", cpu);
+        return 0;
+    }
+
+    /* create and wake-up throttle threads */
+    init_waitqueue_head(&core_info->throttle_evt);
+    init_irq_work(&core_info->unpark_work, unpark_core);
+
+    thread = kthread_create_on_node(throttle_thread_func, (void *)((unsigned long)cpu), cpu_to_node(cpu), "kthrottle/%d", cpu);
+    if (IS_ERR(thread)) {
+        core_info->counter_source->release(core_info);
+        core_info->counter_source = NULL;
+        return PTR_ERR(thread);
+    }
+    kthread_bind(thread, cpu); // Bind thread to specific core
+    core_info->throttle_thread = thread;
+    wake_up_process(thread);
+    pr_info("# cpu: %u, throttle_thread's pid: %d", cpu, (int)thread->pid);
+
+    /* initialize hr timer */
+    hrtimer_init(&core_info->hr_timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS_PINNED); // HRTIMER_MODE_REL_PINNED: Run timer on specific cpu core
+    core_info->hr_timer.function = &timer_callback_master;
+    core_info->start_time = global_info.start_time;
+
+    cpumask_set_cpu(cpu, cluster_info->cpu_mask);
+    WRITE_ONCE(cluster_info->size, cluster_info->size + 1);
+    if (cluster_info->leader_core < 0)
+        WRITE_ONCE(cluster_info->leader_core, cpu);
+
+    /* The configured GPU sampling core is back: take the role over again */
+    if (module_loaded && !module_unloading && (int)cpu == gpu_profiling_core(cluster_info))
+        move_gpu_sampling(cluster_info, cpu);
+
+    if (module_loaded && !module_unloading)
+        start_timer_at_next_tick(core_info, ktime_get());
+
+    return 0;
+}
+
+/* The reader of the cluster PMU counter went offline: read it from another regulated core */
+static void move_cluster_counter(struct cluster_info *cluster_info) {
+    WRITE_ONCE(cluster_info->cluster_event_cpu, -1);
+    release_cluster_counter(cluster_info);
+    if (cpumask_empty(cluster_info->cpu_mask))
+        return;
+
+    if (cluster_info->id == 1)
+        init_cluster_counter(cluster_info, g_cluster_pmu_type_cl1, (u32)g_cluster_pmu_config_cl1);
+    else
+        init_cluster_counter(cluster_info, g_cluster_pmu_type_cl2, (u32)g_cluster_pmu_config_cl2);
+
+    if (!cluster_info->cluster_event)
+        pr_err("cluster%d: cluster PMU lost, the cluster's cores are no longer charged\n", cluster_info->id);
+}
+
+/*
+ * CPU hotplug: stop regulating a core going offline (and every core at
+ * unload). Runs on the core. What it used since its last tick stays
+ * charged to the current period, and another core takes over its roles
+ * in the cluster (leader, GPU sampling, cluster PMU reader).
+ */
+static int cl_mem_reg_cpu_offline(unsigned int cpu) {
+    struct core_info *core_info = per_cpu_ptr(_core_info, cpu);
+    struct cluster_info *cluster_info = cpu_cluster(cpu);
+    unsigned int leader;
+    s64 events;
+
+    if (!cluster_info || !cpumask_test_cpu(cpu, cluster_info->cpu_mask))
+        return 0;
+
+    /* No more IPIs from the cluster from here on */
+    cpumask_clear_cpu(cpu, cluster_info->cpu_mask);
+    WRITE_ONCE(cluster_info->size, cluster_info->size - 1);
+
+    hrtimer_cancel(&core_info->hr_timer);
+    irq_work_sync(&core_info->unpark_work);
+    WRITE_ONCE(core_info->parked, 0);
+    cpumask_clear_cpu(cpu, cluster_info->parked_mask);
+
+    core_info->throttled_task = NULL;
+    kthread_stop(core_info->throttle_thread);
+    core_info->throttle_thread = NULL;
+
+    local_irq_disable();
+    core_info->counter_source->stop(core_info);
+    events = weigh_core_events(core_info, get_read_event_used(core_info));
+    local_irq_enable();
+    if (events > 0) {
+        atomic_add(events, &cluster_info->bandwidth_usage);
+        atomic_add(events, &cluster_info->cpu_usage);
+        STATS_ADD(&core_info->stats, events, events);
+    }
+
+    core_info->counter_source->release(core_info);
+    core_info->counter_source = NULL;
+    if (module_unloading)
+        return 0;
+
+    if (cluster_info->cluster_event && cluster_info->cluster_event_cpu == cpu)
+        move_cluster_counter(cluster_info);
+
+    leader = cpumask_first(cluster_info->cpu_mask);
+    if (cluster_info->leader_core == cpu)
+        WRITE_ONCE(cluster_info->leader_core, leader < nr_cpu_ids ? (int)leader : -1);
+    if (core_info->profile_gpu_bandwidth && leader < nr_cpu_ids) {
+        WRITE_ONCE(core_info->profile_gpu_bandwidth, 0);
+        move_gpu_sampling(cluster_info, leader);
+    }
+
+    return 0;
+}
+
+static int cl_mem_reg_config_show(struct seq_file *m, void *v) {
+    struct cluster_info *cluster_info_cl1 = &_cluster_info_cl1;
+    struct cluster_info *cluster_info_cl2 = &_cluster_info_cl2;
+    int i;
+    seq_printf(m, "=== Cluster-level Memory Access Regulation Module ===\n");
+    /* Cluster 1 info */
+    if (g_system_budget > 0) {
+        seq_printf(m, " - System budget (MB/s): %d, guaranteed cluster1 %d, cluster2 %d\n", g_system_budget,
+                   g_cluster_min_cl1, g_cluster_min_cl2);
+        seq_printf(m, " - Cluster1 share (MB/s): %d, predicted demand %d\n", cluster_info_cl1->share_mb,
+                   convert_events_to_mb(max_t(s64, cluster_info_cl1->demand_ewma, 0)));
+    }
+    else
+        seq_printf(m, " - Cluster1 budget (MB/s): %d\n", g_bandwidth_budget_cl1);
+    seq_printf(m, " - Cluster1 leader core: %d\n", cluster_info_cl1->leader_core);
+    seq_printf(m, " - Cluster1 regulated cores: %*pbl\n", cpumask_pr_args(cluster_info_cl1->cpu_mask));
+    for(i = 0; i < 4; i++) {
+        seq_printf(m, "    - Core%d hrtimer start time (ns): %lld\n", i, (long long int)ktime_to_ns(g_hrtimer_start[i]));    
+    }
+    if (cluster_info_cl1->sub_budgets) {
+        seq_printf(m, " - Cluster1 reservations (MB/s): CPU %d, GPU %d, shared pool %d\n", g_cpu_reservation_cl1,
+                   g_gpu_reservation_cl1, convert_events_to_mb(cluster_info_cl1->shared_pool));
+    }
+    if(g_gpu_profiling_cl1) {
+        seq_printf(m, " - Cluster 1 GPU profiling: Activated (GPU profiler at CPU %d)\n", g_gpu_profiling_core_cl1);
+    }
+    seq_printf(m, "\n");
 
-    return;
-}
+    /* Cluster 2 info */
+    if (g_system_budget > 0)
+        seq_printf(m, " - Cluster2 share (MB/s): %d, predicted demand %d\n", cluster_info_cl2->share_mb,
+                   convert_events_to_mb(max_t(s64, cluster_info_cl2->demand_ewma, 0)));
+    else
+        seq_printf(m, " - Cluster2 budget (MB/s): %d\n", g_bandwidth_budget_cl2);
+    seq_printf(m, " - Cluster2 leader core: %d\n", cluster_info_cl2->leader_core);
+    seq_printf(m, " - Cluster2 regulated cores: %*pbl\n", cpumask_pr_args(cluster_info_cl2->cpu_mask));
+    for(i = 4; i < 8; i++) {
+        seq_printf(m, "    - Core%d hrtimer start time (ns): %lld\n", i, (long long int)ktime_to_ns(g_hrtimer_start[i]));    
+    }
+    if (cluster_info_cl2->sub_budgets) {
+        seq_printf(m, " - Cluster2 reservations (MB/s): CPU %d, GPU %d, shared pool %d\n", g_cpu_reservation_cl2,
+                   g_gpu_reservation_cl2, convert_events_to_mb(cluster_info_cl2->shared_pool));
+    }
+    if(g_gpu_profiling_cl2) {
+        seq_printf(m, " - Cluster2 GPU profiling: Activated (GPU profiler at CPU %d)\n", g_gpu_profiling_core_cl2);
+    }
+    seq_printf(m, "\n");
 
-static int gpu_beats_receiver_thread_func_cl1(void* arg) {
-    int cpunr = (unsigned long)arg;
-    struct sched_param param;
-    struct cluster_info *cluster_info;
-    int* gpu_beats = NULL;
-    int cur_gpu_bandwidth_usage_bytes = 0;  // MB/s
-    s64 cur_gpu_bandwidth_usage = 0;        // events
-    int profiling_info_buf_size = 0;
-    struct timespec64 time;
+    /* T_R and T_A */
+    seq_printf(m, " - Throttle policy: %s", g_throttle_policy == THROTTLE_POLICY_BE ? "best effort (SCHED_FIFO 1)" : "core");
+    if (g_exempt_cpus)
+        seq_printf(m, ", exempt cpus 0x%x", g_exempt_cpus);
+    if (critical_cgroup)
+        seq_printf(m, ", critical cgroup %s", g_critical_cgroup);
+    seq_printf(m, "\n");
+    seq_printf(m, " - Throttle mode: %s\n", g_throttle_mode == THROTTLE_MODE_DUTY ? "duty cycle" : "period");
+    seq_printf(m, " - Period boundaries and throttling: %s\n", g_coordinated_regulation ? "coordinated by the leader" : "per core");
+    seq_printf(m, " - Idle ticking: %s\n", g_nohz_idle ? "idle cores stop their timer" : "disabled");
+    if (g_carry_over) {
+        seq_printf(m, " - Carry-over: burst cap %d%%, balance (events) cluster1 %lld, cluster2 %lld\n", g_burst_cap_pct,
+                   (long long)cluster_info_cl1->carry_balance, (long long)cluster_info_cl2->carry_balance);
+    }
+    seq_printf(m, " - Regulation period (us): %d\n", g_regulation_period_us);
+    seq_printf(m, " - Aggregation period (us): %d\n", g_aggregation_period_us);
+    if (g_adaptive_aggregation) {
+        seq_printf(m, " - Adaptive aggregation period: enabled (up to %d us)\n", g_aggregation_period_max_us);
+    }
+    seq_printf(m, "\n");
 
-    /* Get proper cluster info */
-    cluster_info = &_cluster_info_cl1;
+    /* Accounting */
+    seq_printf(m, " - Counter source (requested: %s):", g_counter_source);
+    for_each_online_cpu(i) {
+        struct core_info *core_info = per_cpu_ptr(_core_info, i);
 
-    /* Set higher priority than throttle_thread */
-    param.sched_priority = MAX_RT_PRIO - 1; 
-    sched_setscheduler(current, SCHED_FIFO, &param);
+        if (core_info->counter_source)
+            seq_printf(m, " cpu%d=%s", i, core_info->counter_source->name);
+    }
+    seq_printf(m, "\n");
+    if (cluster_info_cl1->cluster_event)
+        seq_printf(m, " - Cluster1 PMU: type %d config 0x%x (cpu%d)\n", g_cluster_pmu_type_cl1, g_cluster_pmu_config_cl1,
+                   cluster_info_cl1->cluster_event_cpu);
+    if (cluster_info_cl2->cluster_event)
+        seq_printf(m, " - Cluster2 PMU: type %d config 0x%x (cpu%d)\n", g_cluster_pmu_type_cl2, g_cluster_pmu_config_cl2,
+                   cluster_info_cl2->cluster_event_cpu);
+    seq_printf(m, "\n");
 
-    gpu_beats = (int*)gpu_beats_memory_cl1;
+    /* Logging */
+    if (g_logging == LOGGING_BINARY) {
+        seq_printf(m, " - Logging: enabled (binary)");
+    }
+    else if (g_logging) {
+        seq_printf(m, " - Logging: enabled");
+    }
+    else{
+        seq_printf(m, " - Logging: disabled");
+    }
+    seq_printf(m, "\n");
+    
+    seq_printf(m, "===============\n");
 
-    while (!kthread_should_stop() && cpu_online(cpunr)) {
-        /* Wait for GPU beats to be ready */
-        wait_event_interruptible(gpu_beats_receiver_waitqueue_cl1, gpu_beats_ready_cl1 || kthread_should_stop());
+    return 0;
+}
 
-        ktime_get_real_ts64(&time);
+static int cl_mem_reg_config_open(struct inode *inode, struct file *filp) { return single_open(filp, cl_mem_reg_config_show, NULL); }
 
-        /* Size of a GPU beat = 16 bytes */ 
-        cur_gpu_bandwidth_usage_bytes = (gpu_beats[GPU_RD_BEATS_IDX] * 16 + gpu_beats[GPU_WR_BEATS_IDX] * 16);
-        cur_gpu_bandwidth_usage = convert_bytes_to_events(cur_gpu_bandwidth_usage_bytes);
-        atomic_add(cur_gpu_bandwidth_usage, &cluster_info->bandwidth_usage);
+static inline void tick_hist_add(struct tick_hist *hist, u64 value) {
+    int bucket = value ? fls64(value) - 1 : 0;
 
-        /* Logging (GPU) */
-        if(g_logging && g_gpu_logging_file_cl1) {
-            struct logging_work* logging_work_data;
+    if (bucket >= TICK_HIST_BUCKETS)
+        bucket = TICK_HIST_BUCKETS - 1;
 
-            logging_work_data = kmalloc(sizeof(struct logging_work), GFP_ATOMIC);
-            if(!logging_work_data) {
-                pr_err("Failed to allocate memory for logging work");
-                return -1;
-            }
+    hist->buckets[bucket]++;
+    hist->count++;
+    hist->sum += value;
+    if (value > hist->max)
+        hist->max = value;
+}
 
-            INIT_WORK(&logging_work_data->work, logging_work_func);
-            logging_work_data->file = g_gpu_logging_file_cl1;
-            profiling_info_buf_size = snprintf(logging_work_data->buf, LOGGING_BUF_SIZE, "%llu,%lld.%09ld,%llu,%llu,%llu,%d\n", cluster_info->regulation_period_cnt, (long long)time.tv_sec, time.tv_nsec, cur_gpu_bandwidth_usage, (uint64_t)gpu_beats[GPU_RD_BEATS_IDX], (uint64_t)gpu_beats[GPU_WR_BEATS_IDX], cluster_info->is_throttled);
-            profiling_info_buf_size = profiling_info_buf_size > LOGGING_BUF_SIZE ? LOGGING_BUF_SIZE : profiling_info_buf_size;
-            logging_work_data->buf[profiling_info_buf_size] = '\0';
-            
-            queue_work(g_logging_workqueue, &logging_work_data->work);
-        }
+static void tick_hist_show(struct seq_file *m, const char *name, struct tick_hist *hist) {
+    int i;
 
-        gpu_beats[GPU_RD_BEATS_IDX] = GPU_BEATS_CLEANED;
-        gpu_beats[GPU_WR_BEATS_IDX] = GPU_BEATS_CLEANED;
+    seq_printf(m, "  %-14s count=%llu mean=%llu max=%llu |", name, hist->count,
+               hist->count ? div64_u64(hist->sum, hist->count) : 0, hist->max);
+    for (i = 0; i < TICK_HIST_BUCKETS; i++) {
+        if (hist->buckets[i])
+            seq_printf(m, " %d:%llu", i, hist->buckets[i]);
+    }
+    seq_printf(m, "\n");
+}
 
-        gpu_beats_ready_cl1 = 0;
+static int cl_mem_reg_tick_profile_show(struct seq_file *m, void *v) {
+    int i, phase;
+
+    seq_printf(m, "=== Regulation tick profile (T_A: %d us, profiling: %s) ===\n", g_aggregation_period_us,
+               g_tick_profiling ? "enabled" : "disabled");
+    seq_printf(m, "# phases in get_cycles() units, lateness in ns, histograms as log2_bucket:count\n");
+
+    for_each_online_cpu(i) {
+        struct core_info *core_info = per_cpu_ptr(_core_info, i);
+        struct tick_profile *profile = &core_info->tick_profile;
+
+        if (!cpumask_test_cpu(i, _cluster_info_cl1.cpu_mask) && !cpumask_test_cpu(i, _cluster_info_cl2.cpu_mask)) {
+            continue;
+        }
 
-        /* Throttle core if the read usage exceeds the current budget */
-        if (atomic_read(&cluster_info->bandwidth_usage) > cluster_info->cur_bandwidth_budget) {
-            cl_mem_reg_on_each_cpu_mask(cluster_info->cpu_mask, __throttle_core, NULL, 0);
+        seq_printf(m, "cpu%d\n", i);
+        for (phase = 0; phase < NR_TICK_PHASES; phase++) {
+            tick_hist_show(m, tick_phase_names[phase], &profile->phase_cycles[phase]);
         }
+        tick_hist_show(m, "lateness_ns", &profile->lateness_ns);
     }
 
     return 0;
 }
 
-static int gpu_beats_receiver_thread_func_cl2(void* arg) {
-    int cpunr = (unsigned long)arg;
-    struct sched_param param;
-    struct cluster_info *cluster_info;
-    int* gpu_beats = NULL;
-    int cur_gpu_bandwidth_usage_bytes = 0;  // MB/s
-    s64 cur_gpu_bandwidth_usage = 0;        // events
-    int profiling_info_buf_size = 0;
-    struct timespec64 time;
+static int cl_mem_reg_tick_profile_open(struct inode *inode, struct file *filp) { return single_open(filp, cl_mem_reg_tick_profile_show, NULL); }
 
-    /* Get proper cluster info */
-    cluster_info = &_cluster_info_cl2;
+/* Each core resets its own profile with IRQs disabled, so no tick races with it */
+static void __reset_tick_profile(void *info) {
+    struct core_info *core_info = this_cpu_ptr(_core_info);
 
-    /* Set higher priority than throttle_thread */
-    param.sched_priority = MAX_RT_PRIO - 1; 
-    sched_setscheduler(current, SCHED_FIFO, &param);
+    memset(&core_info->tick_profile, 0, sizeof(struct tick_profile));
+}
 
-    gpu_beats = (int*)gpu_beats_memory_cl2;
+/* Any write resets the profile */
+static ssize_t cl_mem_reg_tick_profile_write(struct file *filp, const char __user *ubuf, size_t cnt, loff_t *ppos) {
+    on_each_cpu(__reset_tick_profile, NULL, 1);
 
-    while (!kthread_should_stop() && cpu_online(cpunr)) {
-        /* Wait for GPU beats to be ready */
-        wait_event_interruptible(gpu_beats_receiver_waitqueue_cl2, gpu_beats_ready_cl2 || kthread_should_stop());
+    return cnt;
+}
 
-        ktime_get_real_ts64(&time);
+static void fill_stats_snapshot(struct cl_mem_reg_stats_snapshot *snapshot) {
+    struct cluster_info *clusters[CL_MEM_REG_STATS_MAX_CLUSTERS] = {&_cluster_info_cl1, &_cluster_info_cl2};
+    int i, c;
+
+    memset(snapshot, 0, sizeof(*snapshot));
+    snapshot->magic = CL_MEM_REG_STATS_MAGIC;
+    snapshot->version = CL_MEM_REG_STATS_VERSION;
+    snapshot->nr_cores = CL_MEM_REG_STATS_MAX_CORES;
+    snapshot->nr_clusters = CL_MEM_REG_STATS_MAX_CLUSTERS;
+    snapshot->timestamp_ns = ktime_get_ns();
+    snapshot->regulation_period_ns = (u64)g_manage_period_interval * g_aggregation_period_us * 1000;
+    snapshot->window_periods = g_stats_window_periods;
+
+    for (c = 0; c < CL_MEM_REG_STATS_MAX_CLUSTERS; c++) {
+        snapshot->cluster_total[c] = clusters[c]->stats.total;
+        snapshot->cluster_window[c] = clusters[c]->stats.last_window;
+    }
 
-        /* Size of a GPU beat = 16 bytes */ 
-        cur_gpu_bandwidth_usage_bytes = (gpu_beats[GPU_RD_BEATS_IDX] * 16 + gpu_beats[GPU_WR_BEATS_IDX] * 16);
-        cur_gpu_bandwidth_usage = convert_bytes_to_events(cur_gpu_bandwidth_usage_bytes);
-        atomic_add(cur_gpu_bandwidth_usage, &cluster_info->bandwidth_usage);
+    for_each_online_cpu(i) {
+        struct core_info *core_info = per_cpu_ptr(_core_info, i);
 
-        /* Logging (GPU) */
-        if(g_logging && g_gpu_logging_file_cl2) {
-            struct logging_work* logging_work_data;
+        if (i >= CL_MEM_REG_STATS_MAX_CORES)
+            break;
 
-            logging_work_data = kmalloc(sizeof(struct logging_work), GFP_ATOMIC);
-            if(!logging_work_data) {
-                pr_err("Failed to allocate memory for logging work");
-                return -1;
-            }
+        for (c = 0; c < CL_MEM_REG_STATS_MAX_CLUSTERS; c++) {
+            if (!cpumask_test_cpu(i, clusters[c]->cpu_mask))
+                continue;
 
-            INIT_WORK(&logging_work_data->work, logging_work_func);
-            logging_work_data->file = g_gpu_logging_file_cl2;
-            profiling_info_buf_size = snprintf(logging_work_data->buf, LOGGING_BUF_SIZE, "%llu,%lld.%09ld,%llu,%llu,%llu,%d\n", cluster_info->regulation_period_cnt, (long long)time.tv_sec, time.tv_nsec, cur_gpu_bandwidth_usage, (uint64_t)gpu_beats[GPU_RD_BEATS_IDX], (uint64_t)gpu_beats[GPU_WR_BEATS_IDX], cluster_info->is_throttled);
-            profiling_info_buf_size = profiling_info_buf_size > LOGGING_BUF_SIZE ? LOGGING_BUF_SIZE : profiling_info_buf_size;
-            logging_work_data->buf[profiling_info_buf_size] = '\0';
-            
-            queue_work(g_logging_workqueue, &logging_work_data->work);
+            snapshot->cpu_mask |= 1ULL << i;
+            snapshot->core_total[i] = core_info->stats.total;
+            snapshot->core_window[i] = core_info->stats.last_window;
+
+            /* CPU share of the cluster */
+            snapshot->cluster_total[c].cpu_events += core_info->stats.total.events;
+            snapshot->cluster_window[c].cpu_events += core_info->stats.last_window.events;
         }
+    }
+}
 
-        gpu_beats[GPU_RD_BEATS_IDX] = GPU_BEATS_CLEANED;
-        gpu_beats[GPU_WR_BEATS_IDX] = GPU_BEATS_CLEANED;
+/* Sequence count of a live page entry: odd while the entry is rewritten */
+static inline void live_write_begin(u32 *seq) {
+    WRITE_ONCE(*seq, *seq + 1);
+    smp_wmb();
+}
 
-        gpu_beats_ready_cl2 = 0;
+static inline void live_write_end(u32 *seq) {
+    smp_wmb();
+    WRITE_ONCE(*seq, *seq + 1);
+}
 
-        /* Throttle core if the read usage exceeds the current budget */
-        if (atomic_read(&cluster_info->bandwidth_usage) > cluster_info->cur_bandwidth_budget) {
-            cl_mem_reg_on_each_cpu_mask(cluster_info->cpu_mask, __throttle_core, NULL, 0);
-        }
+/* At every tick of the core, on the core: its entry has no other writer */
+static void update_live_core(struct core_info *core_info) {
+    struct cl_mem_reg_core_stats *stats = &core_info->stats.total;
+    struct cl_mem_reg_live_core *live;
+
+    if (!live_page || core_info->cpu >= CL_MEM_REG_LIVE_MAX_CORES)
+        return;
+
+    live = &live_page->core[core_info->cpu];
+    live_write_begin(&live->seq);
+    live->ts_ns = ktime_get_ns();
+    live->throttled = core_info->throttled_task != NULL;
+    live->ticks = stats->ticks;
+    live->events = stats->events;
+    live->throttle_count = stats->throttle_count;
+    live->throttled_ns = stats->throttled_ns;
+    live->throttle_latency_sum_ns = stats->throttle_latency_sum_ns;
+    live->throttle_latency_max_ns = stats->throttle_latency_max_ns;
+    live->parked_ns = stats->parked_ns;
+    live_write_end(&live->seq);
+}
+
+/* At the leader's ticks and at period starts; skipped rather than waited for if both race */
+static void update_live_cluster(struct cluster_info *cluster_info) {
+    struct cl_mem_reg_cluster_stats *stats = &cluster_info->stats.total;
+    struct cl_mem_reg_live_cluster *live;
+    u64 cpu_events = 0;
+    int cpu;
+
+    if (!live_page || !spin_trylock(&cluster_info->live_lock))
+        return;
+
+    /* Offline members included: what they used stays charged */
+    for_each_cpu(cpu, cluster_info->member_mask)
+        cpu_events += READ_ONCE(per_cpu_ptr(_core_info, cpu)->stats.total.events);
+
+    live = &live_page->cluster[cluster_info->id - 1];
+    live_write_begin(&live->seq);
+    live->ts_ns = ktime_get_ns();
+    live->throttled = atomic_read(&cluster_info->throttle_requested) || cluster_info->is_throttled;
+    live->cpu_mask = cpumask_bits(cluster_info->cpu_mask)[0];
+    live->budget_events = max(cluster_info->cur_bandwidth_budget, 0);
+    live->usage_events = max(atomic_read(&cluster_info->bandwidth_usage), 0);
+    live->cpu_events = cpu_events;
+    live->gpu_events = stats->gpu_events;
+    live->periods = stats->periods;
+    live->throttled_periods = stats->throttled_periods;
+    live->throttled_ns = stats->throttled_ns;
+    live->used_events = stats->used_events;
+    live->period_budget_events = stats->budget_events;
+    live_write_end(&live->seq);
+
+    spin_unlock(&cluster_info->live_lock);
+}
+
+static int cl_mem_reg_live_mmap(struct file *filp, struct vm_area_struct *vma) {
+    if (vma->vm_flags & VM_WRITE)
+        return -EPERM;
+    if (vma->vm_pgoff || vma->vm_end - vma->vm_start > CL_MEM_REG_LIVE_SIZE)
+        return -EINVAL;
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 3, 0)
+    vm_flags_clear(vma, VM_MAYWRITE);
+#else
+    vma->vm_flags &= ~VM_MAYWRITE;
+#endif
+    return remap_vmalloc_range(vma, live_page, 0);
+}
+
+static struct cl_mem_reg_live_page *alloc_live_page(void) {
+    struct cl_mem_reg_live_page *page;
+
+    BUILD_BUG_ON(sizeof(struct cl_mem_reg_live_page) > CL_MEM_REG_LIVE_SIZE);
+
+    page = vmalloc_user(CL_MEM_REG_LIVE_SIZE);
+    if (!page)
+        return NULL;
+
+    page->magic = CL_MEM_REG_LIVE_MAGIC;
+    page->version = CL_MEM_REG_LIVE_VERSION;
+    page->nr_cores = CL_MEM_REG_LIVE_MAX_CORES;
+    page->nr_clusters = CL_MEM_REG_LIVE_MAX_CLUSTERS;
+    page->regulation_period_ns = (u64)g_manage_period_interval * g_aggregation_period_us * 1000;
+    page->aggregation_period_ns = (u64)g_aggregation_period_us * 1000;
+
+    return page;
+}
+
+static void core_stats_show(struct seq_file *m, int cpu, const char *scope, struct cl_mem_reg_core_stats *stats) {
+    seq_printf(m, "cpu%d scope=%s ticks=%llu events=%llu throttled_periods=%llu throttle_count=%llu throttled_ns=%llu"
+               " throttle_latency_mean_ns=%llu throttle_latency_max_ns=%llu stall_max_ns=%llu parks=%llu parked_ns=%llu\n",
+               cpu, scope, stats->ticks, stats->events, stats->throttled_periods, stats->throttle_count, stats->throttled_ns,
+               stats->throttle_count ? div64_u64(stats->throttle_latency_sum_ns, stats->throttle_count) : 0,
+               stats->throttle_latency_max_ns, stats->stall_max_ns, stats->parks, stats->parked_ns);
+}
+
+static void cluster_stats_show(struct seq_file *m, int cluster, const char *scope, struct cl_mem_reg_cluster_stats *stats) {
+    u64 events = stats->cpu_events + stats->gpu_events;
+
+    /* utilization and GPU share in 0.01% */
+    seq_printf(m, "cluster%d scope=%s periods=%llu throttled_periods=%llu throttled_ns=%llu cpu_events=%llu gpu_events=%llu"
+               " gpu_share_bp=%llu used_events=%llu budget_events=%llu utilization_bp=%llu overrun_periods=%llu"
+               " overshoot_events=%llu overshoot_max_events=%llu cpu_over_periods=%llu gpu_over_periods=%llu"
+               " credit_periods=%llu debt_periods=%llu throttle_broadcasts=%llu duplicate_throttle_requests=%llu"
+               " release_skew_mean_ns=%llu release_skew_max_ns=%llu idle_periods=%llu\n",
+               cluster, scope, stats->periods, stats->throttled_periods, stats->throttled_ns, stats->cpu_events, stats->gpu_events,
+               events ? div64_u64(stats->gpu_events * 10000, events) : 0,
+               stats->used_events, stats->budget_events,
+               stats->budget_events ? div64_u64(stats->used_events * 10000, stats->budget_events) : 0,
+               stats->overrun_periods, stats->overshoot_events, stats->overshoot_max_events,
+               stats->cpu_over_periods, stats->gpu_over_periods, stats->credit_periods, stats->debt_periods,
+               stats->throttle_broadcasts, stats->duplicate_throttle_requests,
+               stats->release_skews ? div64_u64(stats->release_skew_sum_ns, stats->release_skews) : 0, stats->release_skew_max_ns,
+               stats->idle_periods);
+}
+
+/* One record per line, 'key=value' fields */
+static int cl_mem_reg_stats_show(struct seq_file *m, void *v) {
+    struct cl_mem_reg_stats_snapshot *snapshot;
+    int i;
+
+    snapshot = kmalloc(sizeof(*snapshot), GFP_KERNEL);
+    if (!snapshot)
+        return -ENOMEM;
+
+    fill_stats_snapshot(snapshot);
+
+    seq_printf(m, "# version=%u timestamp_ns=%llu regulation_period_ns=%llu window_periods=%llu\n", snapshot->version,
+               snapshot->timestamp_ns, snapshot->regulation_period_ns, snapshot->window_periods);
+
+    for (i = 0; i < snapshot->nr_cores; i++) {
+        if (!(snapshot->cpu_mask & (1ULL << i)))
+            continue;
+        core_stats_show(m, i, "total", &snapshot->core_total[i]);
+        core_stats_show(m, i, "window", &snapshot->core_window[i]);
+    }
+
+    for (i = 0; i < snapshot->nr_clusters; i++) {
+        cluster_stats_show(m, i + 1, "total", &snapshot->cluster_total[i]);
+        cluster_stats_show(m, i + 1, "window", &snapshot->cluster_window[i]);
     }
 
+    kfree(snapshot);
+
     return 0;
 }
 
-static inline void logging_work_func(struct work_struct* work) {
-    struct logging_work *logging_work_data = container_of(work, struct logging_work, work);
-    loff_t pos = 0;
-    mm_segment_t old_fs;
+static int cl_mem_reg_stats_open(struct inode *inode, struct file *filp) { return single_open(filp, cl_mem_reg_stats_show, NULL); }
 
-    if (!logging_work_data->file) {
-        pr_debug("File pointer is NULL in logging_work_func");
-        kfree(logging_work_data);
-        return;
+/* struct cl_mem_reg_stats_snapshot; a fresh snapshot is taken at offset 0 */
+static ssize_t cl_mem_reg_stats_bin_read(struct file *filp, char __user *ubuf, size_t cnt, loff_t *ppos) {
+    struct cl_mem_reg_stats_snapshot *snapshot;
+    ssize_t ret;
+
+    snapshot = kmalloc(sizeof(*snapshot), GFP_KERNEL);
+    if (!snapshot)
+        return -ENOMEM;
+
+    fill_stats_snapshot(snapshot);
+    ret = simple_read_from_buffer(ubuf, cnt, ppos, snapshot, sizeof(*snapshot));
+
+    kfree(snapshot);
+
+    return ret;
+}
+
+static int cl_mem_reg_synthetic_rate_show(struct seq_file *m, void *v) {
+    int i;
+
+    for_each_online_cpu(i) {
+        struct core_info *core_info = per_cpu_ptr(_core_info, i);
+
+        if (core_info->counter_source)
+            seq_printf(m, "cpu%d %d\n", i, READ_ONCE(core_info->synthetic_rate_mb));
     }
 
-    pos = vfs_llseek(logging_work_data->file, 0, SEEK_END);
+    return 0;
+}
 
-    old_fs = get_fs();
-    set_fs(KERNEL_DS);
+static int cl_mem_reg_synthetic_rate_open(struct inode *inode, struct file *filp) { return single_open(filp, cl_mem_reg_synthetic_rate_show, NULL); }
 
-    kernel_write(logging_work_data->file, logging_work_data->buf, strlen(logging_work_data->buf), &pos);
+/* "<cpu> <MB/s>" or "all <MB/s>"; only cores on the synthetic source generate events */
+static ssize_t cl_mem_reg_synthetic_rate_write(struct file *filp, const char __user *ubuf, size_t cnt, loff_t *ppos) {
+    char buf[32];
+    int cpu, mb, i;
 
-    set_fs(old_fs);
+    if (cnt >= sizeof(buf))
+        return -EINVAL;
+    if (copy_from_user(buf, ubuf, cnt))
+        return -EFAULT;
+    buf[cnt] = '\0';
 
-    kfree(logging_work_data);
+    if (sscanf(buf, "all %d", &mb) == 1) {
+        cpu = -1;
+    }
+    else if (sscanf(buf, "%d %d", &cpu, &mb) != 2 || cpu < 0 || cpu >= nr_cpu_ids) {
+        return -EINVAL;
+    }
+
+    if (mb < 0)
+        return -EINVAL;
+
+    for_each_online_cpu(i) {
+        struct core_info *core_info = per_cpu_ptr(_core_info, i);
+
+        if ((cpu < 0 || cpu == i) && core_info->counter_source)
+            WRITE_ONCE(core_info->synthetic_rate_mb, mb);
+    }
+
+    return cnt;
 }
 
-static void timer_callback_slave(struct core_info *core_info) {
-    /* setup an interrupt */
-    local64_set(&core_info->read_event->hw.period_left, convert_mb_to_events(DEFAULT_RD_BUDGET_MB));
+/* In the format cost_table takes */
+static int cl_mem_reg_cost_table_show(struct seq_file *m, void *v) {
+    struct cluster_info *clusters[NUMBER_OF_CLUSTERS] = {&_cluster_info_cl1, &_cluster_info_cl2};
+    int c, i;
+
+    for (c = 0; c < NUMBER_OF_CLUSTERS; c++) {
+        struct cluster_info *cluster_info = clusters[c];
+
+        for_each_cpu(i, cluster_info->member_mask)
+            seq_printf(m, "cpu%d %llu\n", i, READ_ONCE(per_cpu_ptr(_core_info, i)->cost.bytes));
+        seq_printf(m, "cluster%d %llu\n", cluster_info->id, READ_ONCE(cluster_info->cluster_cost.bytes));
+        seq_printf(m, "gpu%d %llu %llu\n", cluster_info->id, READ_ONCE(cluster_info->gpu_rd_cost.bytes),
+                   READ_ONCE(cluster_info->gpu_wr_cost.bytes));
+    }
+
+    return 0;
 }
 
-static struct perf_event *init_counter(int cpu, int budget, int counter_id, void *callback) {
-    struct perf_event *event = NULL;
-    struct perf_event_attr sched_perf_hw_attr = {
-        .type = PERF_TYPE_RAW,
-        .size = sizeof(struct perf_event_attr),
-        .pinned = 1,
-        .disabled = 1,
-        .config = counter_id,
-        .sample_period = budget,
-        .exclude_kernel = 0,           // 1 mean, no kernel mode counting
-        .exclude_hv = 0,               // don't count hypervisor
-        .exclude_idle = 0,             // don't count when idle
-        .exclude_host = 0,             // don't count in host
-        .exclude_guest = 0,            // don't count in guest
-        .exclude_callchain_kernel = 0, // exclude kernel callchains
-        .exclude_callchain_user = 0,
-    };
+static int cl_mem_reg_cost_table_open(struct inode *inode, struct file *filp) { return single_open(filp, cl_mem_reg_cost_table_show, NULL); }
 
-    /* Try to register using hardware perf events */
-    event = perf_event_create_kernel_counter(&sched_perf_hw_attr, cpu, NULL, callback
-#if LINUX_VERSION_CODE > KERNEL_VERSION(3, 2, 0)
-                                             ,
-                                             NULL
-#endif
-    );
+static inline int valid_event_bytes(int bytes) { return bytes > 0 && bytes <= MAX_EVENT_BYTES; }
 
-    if (!event)
-        return NULL;
+/* "cpu<N>[-<M>] <B>", "all <B>", "cluster<N> <B>" or "gpu<N> <read B> [<write B>]", per counted event (beat) */
+static int set_cost_entry(const char *line) {
+    int first, last, id, bytes, wr_bytes, n, i;
 
-    if (IS_ERR(event)) {
-        /* vary the KERN level based on the returned errno */
-        if (PTR_ERR(event) == -EOPNOTSUPP)
-            pr_info("cpu%d. not supported\n", cpu);
-        else if (PTR_ERR(event) == -ENOENT)
-            pr_info("cpu%d. not h/w event\n", cpu);
-        else
-            pr_err("cpu%d. unable to create perf event: %ld\n", cpu, PTR_ERR(event));
-        return NULL;
+    n = sscanf(line, "gpu%d %d %d", &id, &bytes, &wr_bytes);
+    if (n >= 2) {
+        struct cluster_info *cluster_info = id == 1 ? &_cluster_info_cl1 : &_cluster_info_cl2;
+
+        if (n == 2)
+            wr_bytes = bytes;
+        if (id < 1 || id > NUMBER_OF_CLUSTERS || !valid_event_bytes(bytes) || !valid_event_bytes(wr_bytes))
+            return -EINVAL;
+
+        set_event_cost(&cluster_info->gpu_rd_cost, bytes);
+        set_event_cost(&cluster_info->gpu_wr_cost, wr_bytes);
+        return 0;
+    }
+
+    if (sscanf(line, "cluster%d %d", &id, &bytes) == 2) {
+        if (id < 1 || id > NUMBER_OF_CLUSTERS || !valid_event_bytes(bytes))
+            return -EINVAL;
+
+        set_event_cost(id == 1 ? &_cluster_info_cl1.cluster_cost : &_cluster_info_cl2.cluster_cost, bytes);
+        return 0;
     }
 
-    /* success path */
-    pr_info("cpu%d enabled counter 0x%x\n", cpu, counter_id);
+    if (sscanf(line, "all %d", &bytes) == 1) {
+        first = 0;
+        last = nr_cpu_ids - 1;
+    }
+    else if (sscanf(line, "cpu%d-%d %d", &first, &last, &bytes) != 3) {
+        if (sscanf(line, "cpu%d %d", &first, &bytes) != 2)
+            return -EINVAL;
+        last = first;
+    }
 
-    return event;
+    if (first < 0 || last < first || last >= nr_cpu_ids || !valid_event_bytes(bytes))
+        return -EINVAL;
+
+    for (i = first; i <= last; i++)
+        set_event_cost(&per_cpu_ptr(_core_info, i)->cost, bytes);
+
+    return 0;
 }
 
-static void __start_counter(void *info) {
+/* One entry per line; takes effect at the next tick of each core */
+static ssize_t cl_mem_reg_cost_table_write(struct file *filp, const char __user *ubuf, size_t cnt, loff_t *ppos) {
+    char buf[512], *p = buf, *line;
+    int ret;
 
-    struct global_info *global = &global_info;
-    struct core_info *core_info = this_cpu_ptr(_core_info);
-    struct cluster_info *cluster_info;
-    int cpu, min_cpu, max_cpu;
-    
-    cpu = smp_processor_id();
-    cluster_info = core_info->cluster_info;
-    core_info->start_time = global->start_time;
+    if (cnt >= sizeof(buf))
+        return -EINVAL;
+    if (copy_from_user(buf, ubuf, cnt))
+        return -EFAULT;
+    buf[cnt] = '\0';
 
-    if (!cpumask_test_cpu(cpu, cluster_info->cpu_mask)) {
-        g_hrtimer_start[cpu] = KTIME_MAX;
-        return;
-    }
+    while ((line = strsep(&p, "\n")) != NULL) {
+        if (!*line)
+            continue;
 
-    if(cpu < 4) {
-        cluster_info = &_cluster_info_cl1;
-        min_cpu = 0;
-        max_cpu = 3;
-    }
-    else{
-        cluster_info = &_cluster_info_cl2;
-        min_cpu = 4;
-        max_cpu = 7;
+        ret = set_cost_entry(line);
+        if (ret)
+            return ret;
     }
-    
 
-    BUG_ON(!core_info->read_event);
+    return cnt;
+}
 
-    /* initialize hr timer */
-    hrtimer_init(&core_info->hr_timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS_PINNED); // HRTIMER_MODE_REL_PINNED: Run timer on specific cpu core
-    core_info->hr_timer.function = &timer_callback_master;
+static int cl_mem_reg_cgroups_show(struct seq_file *m, void *v) {
+    int i, c;
 
-    /* start timer */
-    hrtimer_start(&core_info->hr_timer, global->start_time, HRTIMER_MODE_ABS_PINNED);
-    g_hrtimer_start[cpu] = ktime_get();
-    for(cpu = min_cpu; cpu < max_cpu + 1; cpu++) {
-        ktime_t* leader_hrtimer_start;
+    mutex_lock(&g_mutex_cgroups);
+    for (i = 0; i < MAX_CGROUP_BUDGETS; i++) {
+        struct cgroup_budget *budget = &cgroup_budgets[i];
 
-        if (!cpumask_test_cpu(core_info->cpu, cluster_info->cpu_mask)) {
+        if (!budget->active)
             continue;
-        }
-
-        if(cpu < 4) {
-            leader_hrtimer_start = &g_leader_hrtimer_start_cl1;
-        }
-        else{
-            leader_hrtimer_start = &g_leader_hrtimer_start_cl2;
-        }
 
-        if (g_hrtimer_start[cpu] < *leader_hrtimer_start) {
-            *leader_hrtimer_start = g_hrtimer_start[cpu];
-            cluster_info->leader_core = cpu;
+        seq_printf(m, "%s budget_mb=%d", budget->path, budget->budget_mb);
+        for (c = 0; c < NUMBER_OF_CLUSTERS; c++) {
+            seq_printf(m, " cl%d_events=%d cl%d_total_events=%lld cl%d_over_periods=%llu", c + 1,
+                       atomic_read(&budget->usage[c]), c + 1, (long long)atomic64_read(&budget->total_events[c]),
+                       c + 1, (u64)atomic64_read(&budget->over_periods[c]));
         }
+        seq_printf(m, "\n");
     }
+    mutex_unlock(&g_mutex_cgroups);
 
-    pr_info("LEADER CORE: %d", cluster_info->leader_core);
+    return 0;
+}
 
-    core_info->aggregation_period_cnt = 0;
-    core_info->throttled_task = NULL;
+static int cl_mem_reg_cgroups_open(struct inode *inode, struct file *filp) { return single_open(filp, cl_mem_reg_cgroups_show, NULL); }
 
-    return;
-}
+/* One line per cluster and window; the regulation period is the shortest one */
+static int cl_mem_reg_windows_show(struct seq_file *m, void *v) {
+    struct cluster_info *clusters[NUMBER_OF_CLUSTERS] = {&_cluster_info_cl1, &_cluster_info_cl2};
+    int c, i;
 
-static void __stop_counter(void *info) {
+    for (c = 0; c < NUMBER_OF_CLUSTERS; c++) {
+        struct cluster_info *cluster_info = clusters[c];
+        struct cl_mem_reg_cluster_stats *stats = &cluster_info->stats.total;
 
-    struct core_info *core_info = this_cpu_ptr(_core_info);
-    struct cluster_info *cluster_info;
+        seq_printf(m, "cluster%d window_us=%d budget_mb=%d usage_pct=%llu periods=%llu overrun_periods=%llu\n",
+                   cluster_info->id, g_regulation_period_us, convert_events_to_mb(cluster_info->bandwidth_budget),
+                   stats->budget_events ? div64_u64(stats->used_events * 100, stats->budget_events) : 0,
+                   stats->periods, stats->overrun_periods);
 
-    cluster_info = core_info->cluster_info;
+        for (i = 0; i < cluster_info->nr_windows; i++) {
+            struct budget_window *window = &cluster_info->windows[i];
 
-    if (!cpumask_test_cpu(core_info->cpu, cluster_info->cpu_mask)) {
-        return;
+            seq_printf(m, "cluster%d window_us=%lld budget_mb=%d usage_pct=%lld elapsed_periods=%d/%d windows=%llu"
+                       " exhausted_windows=%llu limiting_periods=%llu last_usage_pct=%d max_usage_pct=%d\n",
+                       cluster_info->id, (long long)window->periods * g_regulation_period_us, window->budget_mb,
+                       window->budget_events ? div64_s64(window->usage * 100, window->budget_events) : 0,
+                       window->elapsed, window->periods, window->completed, window->exhausted_windows,
+                       window->limiting_periods, window->last_util_pct, window->max_util_pct);
+        }
     }
 
-    pr_info("stop counter - cpu: %d", core_info->cpu);
+    return 0;
+}
 
-    cluster_info = core_info->cluster_info;
+static int cl_mem_reg_windows_open(struct inode *inode, struct file *filp) { return single_open(filp, cl_mem_reg_windows_show, NULL); }
 
-    BUG_ON(!core_info->read_event);
+/* "<cgroup v2 path> <MB/s>" adds or updates a budget, "<path> -1" removes it */
+static ssize_t cl_mem_reg_cgroups_write(struct file *filp, const char __user *ubuf, size_t cnt, loff_t *ppos) {
+    char buf[BUF_SIZE + 16], path[BUF_SIZE];
+    struct cgroup_budget *budget = NULL, *free_slot = NULL;
+    struct cgroup *cgrp;
+    int mb, i, ret = cnt;
 
-    /* stop the throttled thread */
-    core_info->throttled_task = NULL;
-    core_info->aggregation_period_cnt = -1;
+    if (cnt >= sizeof(buf))
+        return -EINVAL;
+    if (copy_from_user(buf, ubuf, cnt))
+        return -EFAULT;
+    buf[cnt] = '\0';
 
-    /* stop the perf counter */
-    core_info->read_event->pmu->stop(core_info->read_event, PERF_EF_UPDATE);
+    if (sscanf(buf, "%255s %d", path, &mb) != 2)
+        return -EINVAL;
 
-    /* stop timer */
-    hrtimer_cancel(&core_info->hr_timer);
+    mutex_lock(&g_mutex_cgroups);
 
-    pr_info("##  End of stop counter");
+    for (i = 0; i < MAX_CGROUP_BUDGETS; i++) {
+        if (cgroup_budgets[i].active && !strcmp(cgroup_budgets[i].path, path))
+            budget = &cgroup_budgets[i];
+        else if (!cgroup_budgets[i].active && !free_slot)
+            free_slot = &cgroup_budgets[i];
+    }
 
-    return;
-}
+    if (mb < 0) {
+        if (!budget) {
+            ret = -ENOENT;
+            goto out;
+        }
 
-static int cl_mem_reg_config_show(struct seq_file *m, void *v) {
-    struct cluster_info *cluster_info_cl1 = &_cluster_info_cl1;
-    struct cluster_info *cluster_info_cl2 = &_cluster_info_cl2;
-    int i;
-    seq_printf(m, "=== Cluster-level Memory Access Regulation Module ===\n");
-    /* Cluster 1 info */
-    seq_printf(m, " - Cluster1 budget (MB/s): %d\n", g_bandwidth_budget_cl1);
-    seq_printf(m, " - Cluster1 leader core: %d\n", cluster_info_cl1->leader_core);
-    for(i = 0; i < 4; i++) {
-        seq_printf(m, "    - Core%d hrtimer start time (ns): %lld\n", i, (long long int)ktime_to_ns(g_hrtimer_start[i]));    
+        /* Ticks run in hard IRQ context: after a grace period none uses the slot */
+        smp_store_release(&budget->active, 0);
+        WRITE_ONCE(nr_cgroup_budgets, nr_cgroup_budgets - 1);
+        synchronize_rcu();
+        cgroup_put(budget->cgrp);
+        budget->cgrp = NULL;
+        goto out;
     }
-    if(g_gpu_profiling_cl1) {
-        seq_printf(m, " - Cluster 1 GPU profiling: Activated (GPU profiler at CPU %d)\n", g_gpu_profiling_core_cl1);
-    }
-    seq_printf(m, "\n");
 
-    /* Cluster 2 info */
-    seq_printf(m, " - Cluster2 budget (MB/s): %d\n", g_bandwidth_budget_cl2);
-    seq_printf(m, " - Cluster2 leader core: %d\n", cluster_info_cl2->leader_core);
-    for(i = 4; i < 8; i++) {
-        seq_printf(m, "    - Core%d hrtimer start time (ns): %lld\n", i, (long long int)ktime_to_ns(g_hrtimer_start[i]));    
+    if (mb == 0) {
+        ret = -EINVAL;
+        goto out;
     }
-    if(g_gpu_profiling_cl2) {
-        seq_printf(m, " - Cluster2 GPU profiling: Activated (GPU profiler at CPU %d)\n", g_gpu_profiling_core_cl2);
-    }
-    seq_printf(m, "\n");
 
-    /* T_R and T_A */
-    seq_printf(m, " - Regulation period (us): %d\n", g_regulation_period_us);
-    seq_printf(m, " - Aggregation period (us): %d\n", g_aggregation_period_us);
-    seq_printf(m, "\n");
+    if (budget) {
+        budget->budget_mb = mb;
+        WRITE_ONCE(budget->budget_events, convert_mb_to_events(mb));
+        goto out;
+    }
 
-    /* Logging */
-    if (g_logging) {
-        seq_printf(m, " - Logging: enabled");
+    if (!free_slot) {
+        ret = -ENOSPC;
+        goto out;
     }
-    else{
-        seq_printf(m, " - Logging: disabled");
+
+    cgrp = cgroup_get_from_path(path);
+    if (IS_ERR(cgrp)) {
+        ret = PTR_ERR(cgrp);
+        goto out;
     }
-    seq_printf(m, "\n");
-    
-    seq_printf(m, "===============\n");
 
-    return 0;
-}
+    memset(free_slot, 0, sizeof(*free_slot));
+    strscpy(free_slot->path, path, sizeof(free_slot->path));
+    free_slot->cgrp = cgrp;
+    free_slot->budget_mb = mb;
+    free_slot->budget_events = convert_mb_to_events(mb);
+    smp_store_release(&free_slot->active, 1);
+    WRITE_ONCE(nr_cgroup_budgets, nr_cgroup_budgets + 1);
 
-static int cl_mem_reg_config_open(struct inode *inode, struct file *filp) { return single_open(filp, cl_mem_reg_config_show, NULL); }
+out:
+    mutex_unlock(&g_mutex_cgroups);
+
+    return ret;
+}
 
 static int cl_mem_reg_config_debugfs_init(void) {
     cl_mem_reg_dir = debugfs_create_dir(THIS_MODULE->name, NULL);
     BUG_ON(!cl_mem_reg_dir);
 
     debugfs_create_file("config", 0444, cl_mem_reg_dir, NULL, &cl_mem_reg_config_fops);
+    debugfs_create_file("tick_profile", 0644, cl_mem_reg_dir, NULL, &cl_mem_reg_tick_profile_fops);
+    debugfs_create_file("stats", 0444, cl_mem_reg_dir, NULL, &cl_mem_reg_stats_fops);
+    debugfs_create_file("stats_bin", 0444, cl_mem_reg_dir, NULL, &cl_mem_reg_stats_bin_fops);
+    if (live_page)
+        /* The full proxy of debugfs_create_file() does not forward mmap */
+        debugfs_create_file_unsafe("live", 0444, cl_mem_reg_dir, NULL, &cl_mem_reg_live_fops);
+    debugfs_create_file("synthetic_rate", 0644, cl_mem_reg_dir, NULL, &cl_mem_reg_synthetic_rate_fops);
+    debugfs_create_file("cgroups", 0644, cl_mem_reg_dir, NULL, &cl_mem_reg_cgroups_fops);
+    debugfs_create_file("windows", 0444, cl_mem_reg_dir, NULL, &cl_mem_reg_windows_fops);
+    debugfs_create_file("cost_table", 0644, cl_mem_reg_dir, NULL, &cl_mem_reg_cost_table_fops);
 
     return 0;
 }
@@ -904,26 +3332,28 @@ static int cl_mem_reg_config_debugfs_init(void) {
 static int throttle_thread_func(void *arg) {
     int cpunr = (unsigned long)arg;
     struct core_info *core_info = per_cpu_ptr(_core_info, cpunr);
+    ktime_t throttle_start;
+    u64 latency, stall;
 
+    /* Best-effort policy: lowest RT priority, so critical RT tasks preempt the stall */
 #if LINUX_VERSION_CODE > KERNEL_VERSION(5, 9, 0)
-    sched_set_fifo(current);
+    if (g_throttle_policy == THROTTLE_POLICY_BE)
+        sched_set_fifo_low(current);
+    else
+        sched_set_fifo(current);
 #else
-    static const struct sched_param param = {
-        .sched_priority = MAX_USER_RT_PRIO / 2,
+    struct sched_param param = {
+        .sched_priority = g_throttle_policy == THROTTLE_POLICY_BE ? 1 : MAX_USER_RT_PRIO / 2,
     };
 
     sched_setscheduler(current, SCHED_FIFO, &param);
 #endif
 
-    while (!kthread_should_stop() && cpu_online(cpunr)) {
-
-        DEBUG(trace_printk("wait an event\n"));
+    while (!kthread_should_stop()) {
 
         /* Desc.: Wake up when throttled_task is registered */
         wait_event_interruptible(core_info->throttle_evt, core_info->throttled_task || kthread_should_stop());
 
-        DEBUG(trace_printk("got an event\n"));
-
         if (kthread_should_stop())
             break;
 
@@ -931,13 +3361,33 @@ static int throttle_thread_func(void *arg) {
         pr_info("Start throttle at CPU %d (period_id: %d)", smp_processor_id(), debug_period_id);
 #endif
 
+        throttle_start = ktime_get();
+        latency = ktime_to_ns(ktime_sub(throttle_start, core_info->throttled_time));
+        STATS_ADD(&core_info->stats, throttle_count, 1);
+        STATS_ADD(&core_info->stats, throttle_latency_sum_ns, latency);
+        STATS_MAX(&core_info->stats, throttle_latency_max_ns, latency);
+
         while (core_info->throttled_task && !kthread_should_stop()) {
             smp_mb();    // Desc.: Prepare to use memory (To avoid memory collision between cores)
             cpu_relax(); // Desc.: Excute nop operation
+
+            /* End of a duty-cycle stall; irqs off so that a period-long request (IPI, tick) cannot slip in between */
+            if (READ_ONCE(core_info->throttle_until)) {
+                local_irq_disable();
+                if (core_info->throttle_until && ktime_after(ktime_get(), core_info->throttle_until))
+                    core_info->throttled_task = NULL;
+                local_irq_enable();
+            }
         }
+
+        stall = ktime_to_ns(ktime_sub(ktime_get(), throttle_start));
+        STATS_ADD(&core_info->stats, throttled_ns, stall);
+        STATS_MAX(&core_info->stats, stall_max_ns, stall);
+
+        trace_cl_mem_reg_throttle_end(cpunr, core_info->cluster_info->id,
+                                      ktime_to_ns(ktime_sub(ktime_get(), core_info->throttled_time)));
     }
 
-    DEBUG(trace_printk("exit\n"));
     return 0;
 }
 
@@ -992,6 +3442,12 @@ static void start_logging(void) {
             continue;
         }
 
+        if (g_logging == LOGGING_BINARY) {
+            snprintf(file_name, sizeof(file_name), "/tmp/cl_mem_reg_log_cpu%d.bin", i);
+            g_cpu_log_writers[i] = log_writer_open(file_name, CL_MEM_REG_LOG_CPU, i, cpu_cluster(i), i);
+            continue;
+        }
+
         snprintf(file_name, sizeof(file_name), "/tmp/cl_mem_reg_log_cpu%d.csv", i);
         g_cpu_logging_files[i] = filp_open(file_name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
         if (IS_ERR(g_cpu_logging_files[i])) {
@@ -1002,6 +3458,15 @@ static void start_logging(void) {
     }
 
     /* Logging (GPU) */
+    if (g_logging == LOGGING_BINARY) {
+        if (g_gpu_profiling_cl1)
+            g_gpu_log_writer_cl1 = log_writer_open("/tmp/cl_mem_reg_log_gpu_cl1.bin", CL_MEM_REG_LOG_GPU, 1, cluster_info_cl1, -1);
+        if (g_gpu_profiling_cl2)
+            g_gpu_log_writer_cl2 = log_writer_open("/tmp/cl_mem_reg_log_gpu_cl2.bin", CL_MEM_REG_LOG_GPU, 2, cluster_info_cl2, -1);
+
+        return;
+    }
+
     if(g_gpu_profiling_cl1) {
         g_gpu_logging_file_cl1 = filp_open("/tmp/cl_mem_reg_log_gpu_cl1.csv", O_WRONLY | O_CREAT | O_TRUNC, 0644);
         if (IS_ERR(g_gpu_logging_file_cl1)) {
@@ -1036,24 +3501,80 @@ static void stop_logging(void) {
         filp_close(g_cpu_logging_files[i], NULL);
     }
 
-    if(g_gpu_profiling_cl1)
+    if(g_gpu_profiling_cl1 && g_gpu_logging_file_cl1)
         filp_close(g_gpu_logging_file_cl1, NULL);
-    if(g_gpu_profiling_cl2)
+    if(g_gpu_profiling_cl2 && g_gpu_logging_file_cl2)
         filp_close(g_gpu_logging_file_cl2, NULL);
 
-    return;
-}
+    /* Binary logs (cores that went offline included) */
+    for (i = 0; i < NUMBER_OF_CORES; i++) {
+        log_writer_close(g_cpu_log_writers[i]);
+        g_cpu_log_writers[i] = NULL;
+    }
+    log_writer_close(g_gpu_log_writer_cl1);
+    log_writer_close(g_gpu_log_writer_cl2);
+    g_gpu_log_writer_cl1 = g_gpu_log_writer_cl2 = NULL;
 
-int ceiling(int a, int b) {
-    return (a + b - 1) / b;
+    return;
 }
 
 /**************************************************************************
  * Main Module
  **************************************************************************/
 
+static void free_cluster_masks(struct cluster_info *cluster_info) {
+    free_cpumask_var(cluster_info->member_mask);
+    free_cpumask_var(cluster_info->cpu_mask);
+    free_cpumask_var(cluster_info->parked_mask);
+    free_cpumask_var(cluster_info->release_mask);
+}
+
+static void stop_gpu_beats_receivers(void) {
+    if(gpu_beats_receiver_thread_cl1) {
+        gpu_beats_ready_cl1 = 1;
+        wake_up_interruptible(&gpu_beats_receiver_waitqueue_cl1);
+        kthread_stop(gpu_beats_receiver_thread_cl1);
+        gpu_beats_receiver_thread_cl1 = NULL;
+    }
+
+    if(gpu_beats_receiver_thread_cl2) {
+        gpu_beats_ready_cl2 = 1;
+        wake_up_interruptible(&gpu_beats_receiver_waitqueue_cl2);
+        kthread_stop(gpu_beats_receiver_thread_cl2);
+        gpu_beats_receiver_thread_cl2 = NULL;
+    }
+}
+
+/* sysfs file, device file and GPU beats buffer of one cluster; also undoes a partial setup */
+static void remove_gpu_profiling_files_of(struct kobject **kobj, struct kobj_attribute *attr, struct class **class,
+                                          struct device **device, int *major, const char *name, void **beats_memory) {
+    if (*kobj) {
+        sysfs_remove_file(*kobj, &attr->attr);
+        kobject_put(*kobj);
+        *kobj = NULL;
+    }
+    if (!IS_ERR_OR_NULL(*device))
+        device_destroy(*class, MKDEV(*major, 0));
+    *device = NULL;
+    if (!IS_ERR_OR_NULL(*class))
+        class_destroy(*class);
+    *class = NULL;
+    if (*major > 0)
+        unregister_chrdev(*major, name);
+    *major = 0;
+    kfree(*beats_memory);
+    *beats_memory = NULL;
+}
+
+static void remove_gpu_profiling_files(void) {
+    remove_gpu_profiling_files_of(&kobj_cl1, &cl_mem_reg_sysfs_attribute_cl1, &cl_mem_reg_class_cl1,
+                                  &cl_mem_reg_device_cl1, &major_cl1, "cl_mem_reg_cl1", &gpu_beats_memory_cl1);
+    remove_gpu_profiling_files_of(&kobj_cl2, &cl_mem_reg_sysfs_attribute_cl2, &cl_mem_reg_class_cl2,
+                                  &cl_mem_reg_device_cl2, &major_cl2, "cl_mem_reg_cl2", &gpu_beats_memory_cl2);
+}
+
 static int __init cl_mem_reg_init(void) {
-    int i;
+    int i, ret;
     struct global_info *global = &global_info;
     struct cluster_info *cluster_info_cl1, *cluster_info_cl2;
 
@@ -1083,14 +3604,61 @@ static int __init cl_mem_reg_init(void) {
     pr_info("g_gpu_profiling_cl1: %d", g_gpu_profiling_cl1);
     pr_info("g_gpu_profiling_cl2: %d", g_gpu_profiling_cl2);
 
+    if (g_throttle_policy != THROTTLE_POLICY_CORE && g_throttle_policy != THROTTLE_POLICY_BE) {
+        pr_err("Invalid g_throttle_policy: %d", g_throttle_policy);
+        return -EINVAL;
+    }
+
+    if (g_throttle_mode != THROTTLE_MODE_PERIOD && g_throttle_mode != THROTTLE_MODE_DUTY) {
+        pr_err("Invalid g_throttle_mode: %d", g_throttle_mode);
+        return -EINVAL;
+    }
+
+    if (g_system_budget > 0 && (g_cluster_min_cl1 < 0 || g_cluster_min_cl2 < 0 ||
+                                g_cluster_min_cl1 + g_cluster_min_cl2 > g_system_budget)) {
+        pr_err("Invalid guaranteed shares: %d + %d MB/s (system budget: %d MB/s)", g_cluster_min_cl1, g_cluster_min_cl2,
+               g_system_budget);
+        return -EINVAL;
+    }
+
+    if (g_demand_ewma_shift < 0 || g_demand_ewma_shift > 16) {
+        pr_err("Invalid g_demand_ewma_shift: %d", g_demand_ewma_shift);
+        return -EINVAL;
+    }
+
+    for (i = 0; i < g_nr_long_windows; i++) {
+        if (g_long_window_ms[i] * 1000 <= g_regulation_period_us) {
+            pr_err("Invalid g_long_window_ms: %d (must be longer than the regulation period)", g_long_window_ms[i]);
+            return -EINVAL;
+        }
+    }
+
+    /* One budget per window, or none for a cluster without long windows */
+    if ((g_nr_long_window_budgets_cl1 && g_nr_long_window_budgets_cl1 != g_nr_long_windows) ||
+        (g_nr_long_window_budgets_cl2 && g_nr_long_window_budgets_cl2 != g_nr_long_windows)) {
+        pr_err("Invalid long window budgets: %d and %d budgets for %d windows", g_nr_long_window_budgets_cl1,
+               g_nr_long_window_budgets_cl2, g_nr_long_windows);
+        return -EINVAL;
+    }
+
+    if (g_critical_cgroup && g_critical_cgroup[0]) {
+        critical_cgroup = cgroup_get_from_path(g_critical_cgroup);
+        if (IS_ERR(critical_cgroup)) {
+            pr_err("Invalid g_critical_cgroup: %s", g_critical_cgroup);
+            critical_cgroup = NULL;
+            return -EINVAL;
+        }
+    }
+
     /* initialized global_info structure */
     memset(global, 0, sizeof(struct global_info));
     if (g_regulation_period_us < 0 || g_regulation_period_us > 1000000) {
         printk(KERN_INFO "Must be 0 < period < 1 sec\n");
-        return -ENODEV;
+        ret = -ENODEV;
+        goto err_cgroup;
     }
 
-    g_manage_period_interval = ceiling(g_regulation_period_us, g_aggregation_period_us);
+    g_manage_period_interval = cl_mem_reg_model__manage_period_interval(g_regulation_period_us, g_aggregation_period_us);
 
     for(i = 0; i < NUMBER_OF_CORES; i++)
         g_hrtimer_start[i] = KTIME_MAX;
@@ -1100,97 +3668,135 @@ static int __init cl_mem_reg_init(void) {
     cluster_info_cl2 = &_cluster_info_cl2;
     memset(cluster_info_cl1, 0, sizeof(struct cluster_info));
     memset(cluster_info_cl2, 0, sizeof(struct cluster_info));
+    zalloc_cpumask_var(&cluster_info_cl1->member_mask, GFP_NOWAIT);
+    zalloc_cpumask_var(&cluster_info_cl2->member_mask, GFP_NOWAIT);
     zalloc_cpumask_var(&cluster_info_cl1->cpu_mask, GFP_NOWAIT);
     zalloc_cpumask_var(&cluster_info_cl2->cpu_mask, GFP_NOWAIT);
+    zalloc_cpumask_var(&cluster_info_cl1->parked_mask, GFP_NOWAIT);
+    zalloc_cpumask_var(&cluster_info_cl2->parked_mask, GFP_NOWAIT);
+    zalloc_cpumask_var(&cluster_info_cl1->release_mask, GFP_NOWAIT);
+    zalloc_cpumask_var(&cluster_info_cl2->release_mask, GFP_NOWAIT);
 
     /* Initialize cluster1 info */
+    cluster_info_cl1->id = 1;
     cluster_info_cl1->size = 0;
     cluster_info_cl1->regulation_period_cnt = 0;
     cluster_info_cl1->cur_bandwidth_budget = cluster_info_cl1->bandwidth_budget =
         convert_mb_to_events(g_bandwidth_budget_cl1);
 
     cluster_info_cl1->bandwidth_usage = (atomic_t) {(0)};
+    set_sub_budgets(cluster_info_cl1, g_cpu_reservation_cl1, g_gpu_reservation_cl1);
+    init_long_windows(cluster_info_cl1, g_long_window_budget_cl1, g_nr_long_window_budgets_cl1);
 
     cluster_info_cl1->throttled_time = ktime_set(0, 0);
+    spin_lock_init(&cluster_info_cl1->release_lock);
+    spin_lock_init(&cluster_info_cl1->live_lock);
+    cluster_info_cl1->release_skew_ns = -1;
     cluster_info_cl1->leader_core = -1;
+    atomic64_set(&cluster_info_cl1->reset_period, -1);
 
+    /* cpu_mask and size follow the cores online (cl_mem_reg_cpu_online) */
     for(i = 0; i <4; i++) {
-        cpumask_set_cpu(i, cluster_info_cl1->cpu_mask);
+        cpumask_set_cpu(i, cluster_info_cl1->member_mask);
     }
-    cluster_info_cl1->size = 4;
     cluster_info_cl1->is_throttled = 0;
 
     /* Initialize cluster2 info */
+    cluster_info_cl2->id = 2;
     cluster_info_cl2->size = 0;
     cluster_info_cl2->regulation_period_cnt = 0;
     cluster_info_cl2->cur_bandwidth_budget = cluster_info_cl2->bandwidth_budget =
         convert_mb_to_events(g_bandwidth_budget_cl2);
 
     cluster_info_cl2->bandwidth_usage = (atomic_t) {(0)};
+    set_sub_budgets(cluster_info_cl2, g_cpu_reservation_cl2, g_gpu_reservation_cl2);
+    init_long_windows(cluster_info_cl2, g_long_window_budget_cl2, g_nr_long_window_budgets_cl2);
+
+    if (g_system_budget > 0)
+        init_system_budget();
 
     cluster_info_cl2->throttled_time = ktime_set(0, 0);
+    spin_lock_init(&cluster_info_cl2->release_lock);
+    spin_lock_init(&cluster_info_cl2->live_lock);
+    cluster_info_cl2->release_skew_ns = -1;
     cluster_info_cl2->leader_core = -1;
+    atomic64_set(&cluster_info_cl2->reset_period, -1);
 
     for(i = 4; i <8; i++) {
-        cpumask_set_cpu(i, cluster_info_cl2->cpu_mask);
+        cpumask_set_cpu(i, cluster_info_cl2->member_mask);
     }
-    cluster_info_cl2->size = 4;
     cluster_info_cl2->is_throttled = 0;
 
     global->period_in_ktime = ktime_set(0, g_aggregation_period_us * 1000);
 
+    /* Per-core data; counter sources are set up as each core comes online (cl_mem_reg_cpu_online) */
+    _core_info = alloc_percpu(struct core_info);
+    if (!_core_info) {
+        ret = -ENOMEM;
+        goto err_cluster_masks;
+    }
+
+    /* Unweighted until a cost table is loaded: one counted event is one cache line */
+    for_each_possible_cpu(i)
+        set_event_cost(&per_cpu_ptr(_core_info, i)->cost, CACHE_LINE_SIZE);
+    set_event_cost(&cluster_info_cl1->cluster_cost, CACHE_LINE_SIZE);
+    set_event_cost(&cluster_info_cl2->cluster_cost, CACHE_LINE_SIZE);
+    set_event_cost(&cluster_info_cl1->gpu_rd_cost, CL_MEM_REG_GPU_BEAT_SIZE);
+    set_event_cost(&cluster_info_cl1->gpu_wr_cost, CL_MEM_REG_GPU_BEAT_SIZE);
+    set_event_cost(&cluster_info_cl2->gpu_rd_cost, CL_MEM_REG_GPU_BEAT_SIZE);
+    set_event_cost(&cluster_info_cl2->gpu_wr_cost, CL_MEM_REG_GPU_BEAT_SIZE);
+
     /* sysfs */
     if(g_gpu_profiling_cl1) {
         kobj_cl1 = kobject_create_and_add("cl_mem_reg_cl1", kernel_kobj);
         if(!kobj_cl1) {
             pr_err("Cannot create sysfs for cluster1.");
-            return -ENOMEM;
+            ret = -ENOMEM;
+            goto err_gpu_files;
         }
 
         if(sysfs_create_file(kobj_cl1, &cl_mem_reg_sysfs_attribute_cl1.attr)) {
-            kobject_put(kobj_cl1);
-            return -ENOMEM;
+            ret = -ENOMEM;
+            goto err_gpu_files;
         }
 
         /* Find gpu profiler task */
         gpu_profiler_task_cl1 = pid_task(find_vpid(g_gpu_profiler_pid_cl1), PIDTYPE_PID);
         if (!gpu_profiler_task_cl1) {
             pr_err("Failed to find gpu profiler task of cluster 1 by PID %d", g_gpu_profiler_pid_cl1);
-            return -ESRCH;
+            ret = -ESRCH;
+            goto err_gpu_files;
         }
 
         /* Init shared memory */
         gpu_beats_memory_cl1 = kmalloc(sizeof(double)*2, GFP_KERNEL);
         if (!gpu_beats_memory_cl1) {
             pr_err("Failed to allocate shared memory for cluster 1\n");
-            return -ENOMEM;
+            ret = -ENOMEM;
+            goto err_gpu_files;
         }
 
         /* Create cl_mem_reg device file */
         major_cl1 = register_chrdev(0, "cl_mem_reg_cl1", &gpu_bandwidth_profiling_fops_cl1);
         if (major_cl1 < 0) {
             pr_err("Failed to register cl_mem_reg cl1 device file: %d\n", major_cl1);
-            return major_cl1;
+            ret = major_cl1;
+            goto err_gpu_files;
         }
         printk(KERN_INFO "New device registered: /dev/cl_mem_reg_cl1 with major %d\n", major_cl1);
 
         cl_mem_reg_class_cl1 = class_create(THIS_MODULE, "cl_mem_reg_cl1");
         if (IS_ERR(cl_mem_reg_class_cl1)) {
-            unregister_chrdev(major_cl1, "cl_mem_reg_cl1");
             pr_err("Failed to create class\n");
-            kfree(gpu_beats_memory_cl1);
-            kfree(gpu_beats_memory_cl2);
-            return PTR_ERR(cl_mem_reg_class_cl1);
+            ret = PTR_ERR(cl_mem_reg_class_cl1);
+            goto err_gpu_files;
         }
 
         cl_mem_reg_device_cl1 = device_create(cl_mem_reg_class_cl1, NULL, MKDEV(major_cl1, 0), NULL, "cl_mem_reg_cl1");
         if (IS_ERR(cl_mem_reg_device_cl1)) {
-            class_destroy(cl_mem_reg_class_cl1);
-            unregister_chrdev(major_cl1, "cl_mem_reg_cl1");
             pr_err("Failed to create device\n");
-            kfree(gpu_beats_memory_cl1);
-            kfree(gpu_beats_memory_cl2);
-            return PTR_ERR(cl_mem_reg_device_cl1);
+            ret = PTR_ERR(cl_mem_reg_device_cl1);
+            goto err_gpu_files;
         }
     }
 
@@ -1198,53 +3804,52 @@ static int __init cl_mem_reg_init(void) {
         kobj_cl2 = kobject_create_and_add("cl_mem_reg_cl2", kernel_kobj);
         if(!kobj_cl2) {
             pr_err("Cannot create sysfs for cluster2.");
-            return -ENOMEM;
+            ret = -ENOMEM;
+            goto err_gpu_files;
         }
 
         if(sysfs_create_file(kobj_cl2, &cl_mem_reg_sysfs_attribute_cl2.attr)) {
-            kobject_put(kobj_cl2);
-            return -ENOMEM;
+            ret = -ENOMEM;
+            goto err_gpu_files;
         }
 
         /* Find gpu profiler task */
         gpu_profiler_task_cl2 = pid_task(find_vpid(g_gpu_profiler_pid_cl2), PIDTYPE_PID);
         if (!gpu_profiler_task_cl2) {
             pr_err("Failed to find gpu profiler task of cluster 2 by PID %d", g_gpu_profiler_pid_cl2);
-            return -ESRCH;
+            ret = -ESRCH;
+            goto err_gpu_files;
         }
 
         /* Init shared memory */
         gpu_beats_memory_cl2 = kmalloc(sizeof(double)*2, GFP_KERNEL);
         if (!gpu_beats_memory_cl2) {
             pr_err("Failed to allocate shared memory for cluster 2\n");
-            return -ENOMEM;
+            ret = -ENOMEM;
+            goto err_gpu_files;
         }
 
         /* Create cl_mem_reg device file */
         major_cl2 = register_chrdev(0, "cl_mem_reg_cl2", &gpu_bandwidth_profiling_fops_cl2);
         if (major_cl2 < 0) {
             pr_err("Failed to register cl_mem_reg cl2 device file: %d\n", major_cl2);
-            return major_cl2;
+            ret = major_cl2;
+            goto err_gpu_files;
         }
         printk(KERN_INFO "New device registered: /dev/cl_mem_reg_cl2 with major %d\n", major_cl2);
 
         cl_mem_reg_class_cl2 = class_create(THIS_MODULE, "cl_mem_reg_cl2");
         if (IS_ERR(cl_mem_reg_class_cl2)) {
-            unregister_chrdev(major_cl2, "cl_mem_reg_cl2");
             pr_err("Failed to create class\n");
-            kfree(gpu_beats_memory_cl1);
-            kfree(gpu_beats_memory_cl2);
-            return PTR_ERR(cl_mem_reg_class_cl2);
+            ret = PTR_ERR(cl_mem_reg_class_cl2);
+            goto err_gpu_files;
         }
 
         cl_mem_reg_device_cl2 = device_create(cl_mem_reg_class_cl2, NULL, MKDEV(major_cl2, 0), NULL, "cl_mem_reg_cl2");
         if (IS_ERR(cl_mem_reg_device_cl2)) {
-            class_destroy(cl_mem_reg_class_cl2);
-            unregister_chrdev(major_cl2, "cl_mem_reg_cl2");
             pr_err("Failed to create device\n");
-            kfree(gpu_beats_memory_cl1);
-            kfree(gpu_beats_memory_cl2);
-            return PTR_ERR(cl_mem_reg_device_cl2);
+            ret = PTR_ERR(cl_mem_reg_device_cl2);
+            goto err_gpu_files;
         }
     }
 
@@ -1254,44 +3859,24 @@ static int __init cl_mem_reg_init(void) {
         pr_info("RAW HW READ COUNTER ID: 0x%x\n", g_read_counter_id);
     pr_info("HZ=%d, g_regulation_period_us=%d, g_aggregation_period_us=%d\n", HZ, g_regulation_period_us, g_aggregation_period_us);
 
-    _core_info = alloc_percpu(struct core_info);
+    /* Per-core setup (counter source, throttle thread, timer), at load and whenever a core comes online */
+    init_cluster_counter(cluster_info_cl1, g_cluster_pmu_type_cl1, (u32)g_cluster_pmu_config_cl1);
+    init_cluster_counter(cluster_info_cl2, g_cluster_pmu_type_cl2, (u32)g_cluster_pmu_config_cl2);
+
+    cl_mem_reg_hp_state = cpuhp_setup_state(CPUHP_AP_ONLINE_DYN, "cl_mem_reg:online", cl_mem_reg_cpu_online,
+                                            cl_mem_reg_cpu_offline);
+    if (cl_mem_reg_hp_state < 0) {
+        ret = cl_mem_reg_hp_state;
+        goto err_cluster_counters;
+    }
 
     for_each_online_cpu(i) {
         struct core_info *core_info = per_cpu_ptr(_core_info, i);
 
-        /* initialize per-core data structure */
-        memset(core_info, 0, sizeof(struct core_info));
-        core_info->cpu = i;
-
-        /* throttled task pointer */
-        core_info->throttled_task = NULL;
-
-        /* update local period information */
-        core_info->aggregation_period_cnt = 0;
-
-        if (!cpumask_test_cpu(core_info->cpu, cluster_info_cl1->cpu_mask) && !cpumask_test_cpu(core_info->cpu, cluster_info_cl2->cpu_mask)) {
+        if (!cpumask_test_cpu(i, cluster_info_cl1->cpu_mask) && !cpumask_test_cpu(i, cluster_info_cl2->cpu_mask)) {
             continue;
         }
 
-        /* create performance counter without overflow */
-        core_info->read_event = init_counter(i, INT_MAX, g_read_counter_id, NULL);
-
-        /* initialize statistics */
-        core_info->throttled_time = ktime_set(0, 0);
-
-        /* create and wake-up throttle threads */
-        init_waitqueue_head(&core_info->throttle_evt);
-
-        core_info->throttle_thread = kthread_create_on_node(throttle_thread_func, (void *)((unsigned long)i), cpu_to_node(i), "kthrottle/%d", i);
-
-        pr_info("# cpu: %d, throttle_thread's pid: %d", i, (int)(core_info->throttle_thread->pid));
-
-        perf_event_enable(core_info->read_event);
-
-        BUG_ON(IS_ERR(core_info->throttle_thread));
-        kthread_bind(core_info->throttle_thread, i); // Bind thread to specific core i
-        wake_up_process(core_info->throttle_thread); // Desc.: Put in to the wait queue (Change task state to the TASK_RUNNING)
-
         /* Setup GPU profiling */
         if(i == g_gpu_profiling_core_cl1 && g_gpu_profiling_cl1) {
             core_info->profile_gpu_bandwidth = 1;
@@ -1316,13 +3901,6 @@ static int __init cl_mem_reg_init(void) {
         else{
             core_info->profile_gpu_bandwidth = 0;
         }
-
-        if(i < 4) {
-            core_info->cluster_info = cluster_info_cl1;
-        }
-        else{
-            core_info->cluster_info = cluster_info_cl2;
-        }
     }
 
     /* Initialize workqueue for profiling */
@@ -1330,14 +3908,18 @@ static int __init cl_mem_reg_init(void) {
         g_logging_workqueue = create_workqueue("cl_mem_reg_logging_workqueue");
         if(!g_logging_workqueue) {
             pr_err("Failed to create logging workqueue");
-            kfree(gpu_beats_memory_cl1);
-            kfree(gpu_beats_memory_cl2);
-            return -ENOMEM;
+            ret = -ENOMEM;
+            goto err_gpu_receivers;
         }
     }
 
     pr_info("Workqueue created successfully\n");
 
+    /* Live statistics page (debugfs live); regulation runs without it */
+    live_page = alloc_live_page();
+    if (!live_page)
+        pr_warn("Failed to allocate the live statistics page");
+
     cl_mem_reg_config_debugfs_init();
 
     g_leader_hrtimer_start_cl1 = KTIME_MAX;
@@ -1353,10 +3935,44 @@ static int __init cl_mem_reg_init(void) {
 
 
 
+    /* Idle ticking needs to know when a parked core runs a task again */
+    if (g_nohz_idle) {
+        for_each_kernel_tracepoint(find_sched_switch, &sched_switch_tp);
+        if (!sched_switch_tp || tracepoint_probe_register(sched_switch_tp, cl_mem_reg_sched_switch, NULL)) {
+            pr_err("Cannot attach to sched_switch, idle cores keep ticking");
+            sched_switch_tp = NULL;
+            g_nohz_idle = 0;
+        }
+    }
+
     start_logging();
     on_each_cpu(__start_counter, NULL, 0);
 
+    module_loaded = 1;
+
     return 0;
+
+    /* Unwind in reverse order of setup */
+err_gpu_receivers:
+    stop_gpu_beats_receivers();
+    cpuhp_remove_state(cl_mem_reg_hp_state);
+err_cluster_counters:
+    release_cluster_counter(cluster_info_cl1);
+    release_cluster_counter(cluster_info_cl2);
+err_gpu_files:
+    remove_gpu_profiling_files();
+    free_percpu(_core_info);
+    _core_info = NULL;
+err_cluster_masks:
+    free_cluster_masks(cluster_info_cl1);
+    free_cluster_masks(cluster_info_cl2);
+err_cgroup:
+    if (critical_cgroup) {
+        cgroup_put(critical_cgroup);
+        critical_cgroup = NULL;
+    }
+
+    return ret;
 }
 
 static void __exit cl_mem_reg_exit(void)
@@ -1375,6 +3991,12 @@ static void __exit cl_mem_reg_exit(void)
     g_logging = 0;
     module_unloading = 1;
 
+    /* Parked timers stay stopped from here on */
+    if (sched_switch_tp) {
+        tracepoint_probe_unregister(sched_switch_tp, cl_mem_reg_sched_switch, NULL);
+        tracepoint_synchronize_unregister();
+    }
+
     /* Stop timers and performance event counters */
     on_each_cpu(__stop_counter, NULL, 1);
     pr_info("LLC bandwidth throttling disabled\n");
@@ -1387,85 +4009,41 @@ static void __exit cl_mem_reg_exit(void)
     }
 
     /* Terminate GPU profiling threads */
-    if(g_gpu_profiling_cl1 && gpu_beats_receiver_thread_cl1) {
-        gpu_beats_ready_cl1 = 1;
-        wake_up_interruptible(&gpu_beats_receiver_waitqueue_cl1);
-        kthread_stop(gpu_beats_receiver_thread_cl1);
-        gpu_beats_receiver_thread_cl1 = NULL;
-    }
-
-    if(g_gpu_profiling_cl2 && gpu_beats_receiver_thread_cl2) {
-        gpu_beats_ready_cl2 = 1;
-        wake_up_interruptible(&gpu_beats_receiver_waitqueue_cl2);
-        kthread_stop(gpu_beats_receiver_thread_cl2);
-        gpu_beats_receiver_thread_cl2 = NULL;
-    }
+    stop_gpu_beats_receivers();
 
     /* Close log files */
     if (close_log_file)
         stop_logging();
 
-    /* Cleanup remaining resources */
-    for_each_online_cpu(i) {
-        struct core_info *core_info = per_cpu_ptr(_core_info, i);
-        
-        if (!cpumask_test_cpu(i, cluster_info_cl1->cpu_mask) && !cpumask_test_cpu(i, cluster_info_cl2->cpu_mask)) {
-            continue;
-        }
+    /* Cleanup remaining resources: throttle threads and counters of every regulated core */
+    cpuhp_remove_state(cl_mem_reg_hp_state);
 
-        pr_info("Stopping kthrottle/%d\n", i);
-        kthread_stop(core_info->throttle_thread);
-        perf_event_disable(core_info->read_event);
-        perf_event_release_kernel(core_info->read_event);
-        core_info->read_event = NULL;
+    release_cluster_counter(cluster_info_cl1);
+    release_cluster_counter(cluster_info_cl2);
+
+    if (critical_cgroup) {
+        cgroup_put(critical_cgroup);
+        critical_cgroup = NULL;
     }
 
-    cluster_info_cl1 = NULL;
-    cluster_info_cl2 = NULL;
+    for (i = 0; i < MAX_CGROUP_BUDGETS; i++) {
+        if (cgroup_budgets[i].active)
+            cgroup_put(cgroup_budgets[i].cgrp);
+    }
 
     debugfs_remove_recursive(cl_mem_reg_dir);
     free_percpu(_core_info);
+    free_cluster_masks(cluster_info_cl1);
+    free_cluster_masks(cluster_info_cl2);
+    cluster_info_cl1 = NULL;
+    cluster_info_cl2 = NULL;
 
-    /* Remove sysfs and device files */
-    if(g_gpu_profiling_cl1) {
-        if(kobj_cl1) {
-            sysfs_remove_file(kobj_cl1, &cl_mem_reg_sysfs_attribute_cl1.attr);
-            kobject_put(kobj_cl1);
-            kobj_cl1 = NULL;
-        }
-
-        if (!IS_ERR(cl_mem_reg_device_cl1)) {
-            device_destroy(cl_mem_reg_class_cl1, MKDEV(major_cl1, 0));
-            cl_mem_reg_device_cl1 = NULL;
-        }
-        if (!IS_ERR(cl_mem_reg_class_cl1)) {
-            class_destroy(cl_mem_reg_class_cl1);
-            cl_mem_reg_class_cl1 = NULL;
-        }
-        unregister_chrdev(major_cl1, "cl_mem_reg_cl1");
-
-        kfree(gpu_beats_memory_cl1);
-    }
-
-    if(g_gpu_profiling_cl2) {
-        if(kobj_cl2) {
-            sysfs_remove_file(kobj_cl2, &cl_mem_reg_sysfs_attribute_cl2.attr);
-            kobject_put(kobj_cl2);
-            kobj_cl2 = NULL;
-        }
-
-        if (!IS_ERR(cl_mem_reg_device_cl2)) {
-            device_destroy(cl_mem_reg_class_cl2, MKDEV(major_cl2, 0));
-            cl_mem_reg_device_cl2 = NULL;
-        }
-        if (!IS_ERR(cl_mem_reg_class_cl2)) {
-            class_destroy(cl_mem_reg_class_cl2);
-            cl_mem_reg_class_cl2 = NULL;
-        }
-        unregister_chrdev(major_cl2, "cl_mem_reg_cl2");
+    /* Pages still mapped by a reader are kept until it unmaps them */
+    vfree(live_page);
+    live_page = NULL;
 
-        kfree(gpu_beats_memory_cl2);
-    }
+    /* Remove sysfs and device files */
+    remove_gpu_profiling_files();
 }
 
 
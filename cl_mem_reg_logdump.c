@@ -0,0 +1,429 @@
+/*
+ * Reader of cl_mem_reg binary logs (g_logging=2, include/cl_mem_reg_log.h).
+ *
+ * Converts /tmp/cl_mem_reg_log_cpuN.bin and /tmp/cl_mem_reg_log_gpu_clN.bin
+ * back to the CSV of g_logging=1 (so cl_mem_reg_replay can read them), to
+ * one raw column file per field, or to a per-period summary. Files are
+ * mapped and decoded in one pass; output goes through large buffers with
+ * no stdio formatting on the hot path.
+ *
+ * Usage: ./cl_mem_reg_logdump [-f csv|columns|summary] [-o <dir>] [-H] <log>...
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <libgen.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "cl_mem_reg_log.h"
+
+#define LOGDUMP_IO_BUF_SIZE (1 << 20)
+#define LOGDUMP_COLUMNS 7
+#define PATH_SIZE 512
+
+#define NS_PER_SEC 1000000000LL
+
+enum logdump_format {
+    LOGDUMP_CSV,
+    LOGDUMP_COLUMNS_FORMAT,
+    LOGDUMP_SUMMARY,
+};
+
+/* Buffered output file */
+struct out_buf {
+    int fd;
+    char *buf;
+    size_t len;
+};
+
+/* One mapped log */
+struct log_file {
+    const char *path;
+    const __u8 *data;
+    size_t size;
+    struct cl_mem_reg_log_header header;
+};
+
+/* Regulation period being summarized */
+struct period_summary {
+    __u64 period;
+    __s64 start_ns;
+    __s64 end_ns;
+    __u64 records;
+    __u64 events;
+    __s64 max_usage;
+    __u64 throttled_records;
+    __u64 rd_beats;
+    __u64 wr_beats;
+};
+
+static const char *column_names[LOGDUMP_COLUMNS] = {"period", "ts_ns", "events", "usage", "rd_beats", "wr_beats", "throttled"};
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [options] <log>...\n"
+            "  -f csv       the CSV of g_logging=1 (default)\n"
+            "  -f columns   one file of little-endian 64-bit values per field: <dir>/<log>.<field>\n"
+            "  -f summary   one CSV row per log and regulation period\n"
+            "  -o <dir>     output directory, <log>.csv per log (default: stdout; required for columns)\n"
+            "  -H           print the headers to stderr\n",
+            prog);
+}
+
+static int out_buf__open(struct out_buf *out, const char *path) {
+    out->fd = path ? open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644) : STDOUT_FILENO;
+    if (out->fd < 0) {
+        perror(path);
+        return -1;
+    }
+    out->buf = malloc(LOGDUMP_IO_BUF_SIZE);
+    out->len = 0;
+    if (!out->buf) {
+        fprintf(stderr, "Out of memory\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+static void out_buf__flush(struct out_buf *out) {
+    size_t done = 0;
+
+    while (done < out->len) {
+        ssize_t n = write(out->fd, out->buf + done, out->len - done);
+
+        if (n <= 0) {
+            perror("write");
+            break;
+        }
+        done += n;
+    }
+    out->len = 0;
+}
+
+static void out_buf__close(struct out_buf *out) {
+    out_buf__flush(out);
+    if (out->fd != STDOUT_FILENO)
+        close(out->fd);
+    free(out->buf);
+}
+
+/* Room for one more line or value */
+static inline void out_buf__reserve(struct out_buf *out, size_t len) {
+    if (out->len + len > LOGDUMP_IO_BUF_SIZE)
+        out_buf__flush(out);
+}
+
+static inline void out_buf__char(struct out_buf *out, char c) { out->buf[out->len++] = c; }
+
+static const char digit_pairs[201] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+/* Two digits per division */
+static inline void out_buf__u64(struct out_buf *out, __u64 v) {
+    char digits[20];
+    int n = 20, len;
+
+    while (v >= 100) {
+        n -= 2;
+        memcpy(digits + n, digit_pairs + (v % 100) * 2, 2);
+        v /= 100;
+    }
+    if (v >= 10) {
+        n -= 2;
+        memcpy(digits + n, digit_pairs + v * 2, 2);
+    }
+    else {
+        digits[--n] = '0' + v;
+    }
+
+    len = 20 - n;
+    memcpy(out->buf + out->len, digits + n, len);
+    out->len += len;
+}
+
+static inline void out_buf__s64(struct out_buf *out, __s64 v) {
+    if (v < 0) {
+        out_buf__char(out, '-');
+        out_buf__u64(out, -(__u64)v);
+        return;
+    }
+    out_buf__u64(out, v);
+}
+
+/* Zero-padded to 'width' digits */
+static inline void out_buf__u64_padded(struct out_buf *out, __u64 v, int width) {
+    int i;
+
+    for (i = width - 1; i >= 0; i--) {
+        out->buf[out->len + i] = '0' + v % 10;
+        v /= 10;
+    }
+    out->len += width;
+}
+
+static inline void out_buf__raw(struct out_buf *out, const void *p, size_t len) {
+    memcpy(out->buf + out->len, p, len);
+    out->len += len;
+}
+
+static int log_file__open(struct log_file *log, const char *path) {
+    struct stat st;
+    int fd;
+
+    memset(log, 0, sizeof(*log));
+    log->path = path;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        perror(path);
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+
+    if ((size_t)st.st_size < sizeof(log->header)) {
+        fprintf(stderr, "%s: too short for a header\n", path);
+        close(fd);
+        return -1;
+    }
+
+    log->size = st.st_size;
+    log->data = mmap(NULL, log->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (log->data == MAP_FAILED) {
+        perror(path);
+        return -1;
+    }
+    madvise((void *)log->data, log->size, MADV_SEQUENTIAL);
+
+    memcpy(&log->header, log->data, sizeof(log->header));
+    if (log->header.magic != CL_MEM_REG_LOG_MAGIC || log->header.version != CL_MEM_REG_LOG_VERSION) {
+        fprintf(stderr, "%s: not a cl_mem_reg log (or version %u)\n", path, log->header.version);
+        munmap((void *)log->data, log->size);
+        return -1;
+    }
+
+    return 0;
+}
+
+static void log_file__close(struct log_file *log) { munmap((void *)log->data, log->size); }
+
+static void log_file__print_header(const struct log_file *log) {
+    const struct cl_mem_reg_log_header *h = &log->header;
+    __u32 c;
+
+    fprintf(stderr, "%s: %s %u cluster=%u T_A=%uus T_R=%uus start=%lld.%09lld", log->path,
+            h->source == CL_MEM_REG_LOG_GPU ? "gpu" : "cpu", h->id, h->cluster, h->aggregation_period_us,
+            h->regulation_period_us, (long long)(h->start_ns / NS_PER_SEC), (long long)(h->start_ns % NS_PER_SEC));
+    for (c = 0; c < h->nr_clusters && c < CL_MEM_REG_LOG_MAX_CLUSTERS; c++)
+        fprintf(stderr, " cluster%u=0x%llx:%uMB/s", c + 1, (unsigned long long)h->cluster_mask[c], h->budget_mb[c]);
+    fprintf(stderr, "\n");
+}
+
+/* Same line as the kernel's CSV logger */
+static inline void write_csv_record(struct out_buf *out, int source, const struct cl_mem_reg_log_record *r) {
+    __s64 sec = r->ts_ns / NS_PER_SEC, nsec = r->ts_ns % NS_PER_SEC;
+
+    out_buf__reserve(out, 160);
+    out_buf__u64(out, r->period);
+    out_buf__char(out, ',');
+    out_buf__s64(out, sec);
+    out_buf__char(out, '.');
+    out_buf__u64_padded(out, nsec, 9);
+    out_buf__char(out, ',');
+    out_buf__u64(out, r->events);
+    out_buf__char(out, ',');
+    if (source == CL_MEM_REG_LOG_GPU) {
+        out_buf__u64(out, r->rd_beats);
+        out_buf__char(out, ',');
+        out_buf__u64(out, r->wr_beats);
+        out_buf__char(out, ',');
+    }
+    out_buf__s64(out, r->usage);
+    out_buf__char(out, ',');
+    out_buf__char(out, r->throttled ? '1' : '0');
+    out_buf__char(out, '\n');
+}
+
+static void write_summary(struct out_buf *out, const struct log_file *log, const struct period_summary *s) {
+    out_buf__reserve(out, 256);
+    out_buf__raw(out, log->header.source == CL_MEM_REG_LOG_GPU ? "gpu," : "cpu,", 4);
+    out_buf__u64(out, log->header.id);
+    out_buf__char(out, ',');
+    out_buf__u64(out, s->period);
+    out_buf__char(out, ',');
+    out_buf__s64(out, s->start_ns);
+    out_buf__char(out, ',');
+    out_buf__s64(out, s->end_ns - s->start_ns);
+    out_buf__char(out, ',');
+    out_buf__u64(out, s->records);
+    out_buf__char(out, ',');
+    out_buf__u64(out, s->events);
+    out_buf__char(out, ',');
+    out_buf__s64(out, s->max_usage);
+    out_buf__char(out, ',');
+    out_buf__u64(out, s->rd_beats);
+    out_buf__char(out, ',');
+    out_buf__u64(out, s->wr_beats);
+    out_buf__char(out, ',');
+    out_buf__u64(out, s->throttled_records);
+    out_buf__char(out, '\n');
+}
+
+/* Decodes every record of 'log' into the chosen output; returns the record count */
+static long dump_log(const struct log_file *log, enum logdump_format format, struct out_buf *out,
+                     struct out_buf *columns) {
+    const __u8 *p = log->data + sizeof(log->header), *end = log->data + log->size;
+    struct cl_mem_reg_log_state state = {0, 0};
+    struct cl_mem_reg_log_record r;
+    struct period_summary s;
+    int source = log->header.source;
+    long records = 0;
+    int n;
+
+    memset(&s, 0, sizeof(s));
+
+    while ((n = cl_mem_reg_log__decode(&state, source, p, end, &r)) > 0) {
+        p += n;
+        records++;
+
+        switch (format) {
+        case LOGDUMP_CSV:
+            write_csv_record(out, source, &r);
+            break;
+        case LOGDUMP_COLUMNS_FORMAT: {
+            __u64 values[LOGDUMP_COLUMNS] = {r.period, r.ts_ns, r.events, r.usage, r.rd_beats, r.wr_beats, r.throttled};
+            int i;
+
+            for (i = 0; i < LOGDUMP_COLUMNS; i++) {
+                out_buf__reserve(&columns[i], sizeof(__u64));
+                out_buf__raw(&columns[i], &values[i], sizeof(__u64));
+            }
+            break;
+        }
+        case LOGDUMP_SUMMARY:
+            if (s.records && r.period != s.period) {
+                write_summary(out, log, &s);
+                memset(&s, 0, sizeof(s));
+            }
+            if (!s.records) {
+                s.period = r.period;
+                s.start_ns = r.ts_ns;
+            }
+            s.end_ns = r.ts_ns;
+            s.records++;
+            s.events += r.events;
+            s.rd_beats += r.rd_beats;
+            s.wr_beats += r.wr_beats;
+            s.throttled_records += r.throttled;
+            if (r.usage > s.max_usage)
+                s.max_usage = r.usage;
+            break;
+        }
+    }
+
+    if (format == LOGDUMP_SUMMARY && s.records)
+        write_summary(out, log, &s);
+
+    /* A log copied while the module was writing it ends mid-record */
+    if (p != end)
+        fprintf(stderr, "%s: %ld trailing bytes ignored\n", log->path, (long)(end - p));
+
+    return records;
+}
+
+int main(int argc, char *argv[]) {
+    enum logdump_format format = LOGDUMP_CSV;
+    const char *out_dir = NULL;
+    int print_header = 0, opt, i, ret = 0;
+    struct out_buf out;
+
+    while ((opt = getopt(argc, argv, "f:o:Hh")) != -1) {
+        switch (opt) {
+        case 'f':
+            if (strcmp(optarg, "csv") == 0) format = LOGDUMP_CSV;
+            else if (strcmp(optarg, "columns") == 0) format = LOGDUMP_COLUMNS_FORMAT;
+            else if (strcmp(optarg, "summary") == 0) format = LOGDUMP_SUMMARY;
+            else {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'o': out_dir = optarg; break;
+        case 'H': print_header = 1; break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    if (optind >= argc || (format == LOGDUMP_COLUMNS_FORMAT && !out_dir)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    /* Without -o, every log goes to stdout */
+    if (!out_dir || format == LOGDUMP_SUMMARY) {
+        if (out_buf__open(&out, NULL) < 0)
+            return 1;
+        if (format == LOGDUMP_SUMMARY)
+            printf("source,id,period,start_ns,duration_ns,records,events,max_usage,rd_beats,wr_beats,throttled_records\n");
+        fflush(stdout);
+    }
+
+    for (i = optind; i < argc; i++) {
+        struct out_buf columns[LOGDUMP_COLUMNS];
+        struct log_file log;
+        char path[PATH_SIZE], name[PATH_SIZE], *base;
+        int c;
+
+        if (log_file__open(&log, argv[i]) < 0) {
+            ret = 1;
+            continue;
+        }
+        if (print_header)
+            log_file__print_header(&log);
+
+        /* <log> without its extension */
+        snprintf(name, sizeof(name), "%s", argv[i]);
+        base = basename(name);
+        if (strrchr(base, '.'))
+            *strrchr(base, '.') = '\0';
+
+        if (format == LOGDUMP_COLUMNS_FORMAT) {
+            for (c = 0; c < LOGDUMP_COLUMNS; c++) {
+                snprintf(path, sizeof(path), "%s/%s.%s", out_dir, base, column_names[c]);
+                if (out_buf__open(&columns[c], path) < 0)
+                    return 1;
+            }
+            dump_log(&log, format, NULL, columns);
+            for (c = 0; c < LOGDUMP_COLUMNS; c++)
+                out_buf__close(&columns[c]);
+        }
+        else if (out_dir && format == LOGDUMP_CSV) {
+            struct out_buf file_out;
+
+            snprintf(path, sizeof(path), "%s/%s.csv", out_dir, base);
+            if (out_buf__open(&file_out, path) < 0)
+                return 1;
+            dump_log(&log, format, &file_out, NULL);
+            out_buf__close(&file_out);
+        }
+        else {
+            dump_log(&log, format, &out, NULL);
+        }
+
+        log_file__close(&log);
+    }
+
+    if (!out_dir || format == LOGDUMP_SUMMARY)
+        out_buf__close(&out);
+
+    return ret;
+}
@@ -0,0 +1,416 @@
+/*
+ * Replay of cl_mem_reg CSV logs through the regulation model.
+ *
+ * Streams /tmp/cl_mem_reg_log_cpuN.csv and /tmp/cl_mem_reg_log_gpu_clN.csv
+ * (g_logging=1) of each cluster in timestamp order and answers "what would
+ * have happened with budget X / periods Y": the accounting and throttle
+ * decisions of include/cl_mem_reg_model.h are applied to the recorded
+ * demand, and the predicted throttle time is printed per regulation period.
+ *
+ * Samples recorded while the cluster was throttled only show what the core
+ * could do before it was stopped, so their demand is reconstructed from an
+ * EWMA of the core's unthrottled samples.
+ *
+ * Usage: ./cl_mem_reg_replay [options]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include "cl_mem_reg_model.h"
+
+#define NUMBER_OF_CLUSTERS 2
+#define CORES_PER_CLUSTER 4
+#define REPLAY_MAX_BUDGETS 16
+#define REPLAY_STREAMS (CORES_PER_CLUSTER + 1) /* cores + GPU */
+#define REPLAY_IO_BUF_SIZE (1 << 20)
+#define LINE_SIZE 256
+
+#define NS_PER_US 1000LL
+#define NS_PER_SEC 1000000000LL
+
+#define CPU_LOG_FORMAT "%s/cl_mem_reg_log_cpu%d.csv"
+#define GPU_LOG_FORMAT "%s/cl_mem_reg_log_gpu_cl%d.csv"
+
+/* One log file, read one sample ahead */
+struct log_stream {
+    FILE *fp;
+    char *io_buf;
+    int is_gpu;
+    int core;                   /* index in the cluster */
+    int valid;                  /* 'sample' holds an unread sample */
+
+    /* current sample */
+    int64_t ts_ns;
+    u64 events;
+    int throttled;
+
+    /* demand reconstruction */
+    double ewma;
+    int ewma_valid;
+};
+
+/* Regulation state for one budget */
+struct replay_state {
+    s64 budget;                 /* events per regulation period */
+    s64 usage;
+    double pending;             /* CPU events waiting for the next aggregation tick */
+    int throttled;
+    int64_t throttle_start_ns;
+
+    /* current period */
+    double demand;              /* reconstructed CPU + GPU demand */
+    double gpu;
+    double deferred;            /* CPU demand that the throttle would have held back */
+    int recorded_throttled;
+
+    /* summary */
+    long periods;
+    long throttled_periods;
+    long recorded_throttled_periods;
+    double throttled_ns;
+    double total_demand;
+    double total_deferred;
+};
+
+struct replay_config {
+    const char *dir;
+    int recorded_aggregation_period_us;
+    int regulation_period_us;
+    int aggregation_period_us;
+    int budgets[REPLAY_MAX_BUDGETS];
+    int num_budgets;
+    int cluster;                /* 0: all */
+    int quiet;
+    double ewma_weight;
+};
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -d <dir>              log directory (default: /tmp)\n"
+            "  -a <us>               recorded aggregation period T_A (default: 200)\n"
+            "  -r <us>               regulation period T_R to replay (default: 6600)\n"
+            "  -A <us>               aggregation period to replay, a multiple of -a (default: -a)\n"
+            "  -b <MB/s>[,<MB/s>...] budgets to replay (default: 7500)\n"
+            "  -c <cluster>          replay only cluster 1 or 2 (default: both)\n"
+            "  -e <weight>           EWMA weight of demand reconstruction (default: 0.25)\n"
+            "  -q                    print the summary only\n"
+            "Per-period CSV goes to stdout, the summary to stderr.\n",
+            prog);
+}
+
+/* Parse "<period>,<sec>.<nsec>,<events>,...,<throttled>" with strtoll instead of sscanf */
+static int parse_sample(struct log_stream *stream, char *line) {
+    char *p = line, *end;
+    long long sec, nsec;
+    int digits;
+
+    strtoull(p, &end, 10);                      /* regulation period count */
+    if (*end != ',') return -1;
+    p = end + 1;
+
+    sec = strtoll(p, &end, 10);
+    if (*end != '.') return -1;
+    p = end + 1;
+    nsec = strtoll(p, &end, 10);
+    digits = end - p;
+    while (digits++ < 9) nsec *= 10;
+    if (*end != ',') return -1;
+    p = end + 1;
+    stream->ts_ns = sec * NS_PER_SEC + nsec;
+
+    stream->events = strtoull(p, &end, 10);
+    if (*end != ',') return -1;
+
+    /* The throttled flag is the last field */
+    p = strrchr(end, ',');
+    stream->throttled = atoi(p + 1);
+
+    return 0;
+}
+
+static void log_stream__next(struct log_stream *stream) {
+    char line[LINE_SIZE];
+
+    stream->valid = 0;
+    while (fgets(line, sizeof(line), stream->fp)) {
+        if (parse_sample(stream, line) == 0) {
+            stream->valid = 1;
+            return;
+        }
+    }
+}
+
+static int log_stream__open(struct log_stream *stream, const char *path, int is_gpu, int core) {
+    memset(stream, 0, sizeof(*stream));
+
+    stream->fp = fopen(path, "r");
+    if (!stream->fp)
+        return -1;
+
+    stream->io_buf = malloc(REPLAY_IO_BUF_SIZE);
+    if (stream->io_buf)
+        setvbuf(stream->fp, stream->io_buf, _IOFBF, REPLAY_IO_BUF_SIZE);
+
+    stream->is_gpu = is_gpu;
+    stream->core = core;
+    log_stream__next(stream);
+
+    return 0;
+}
+
+static void log_stream__close(struct log_stream *stream) {
+    if (stream->fp)
+        fclose(stream->fp);
+    free(stream->io_buf);
+}
+
+/* Demand of the current sample (events) */
+static double log_stream__demand(struct log_stream *stream, double weight) {
+    double observed = stream->events;
+
+    /* The GPU is not throttled */
+    if (stream->is_gpu)
+        return observed;
+
+    if (!stream->throttled) {
+        stream->ewma = stream->ewma_valid ? weight * observed + (1 - weight) * stream->ewma : observed;
+        stream->ewma_valid = 1;
+        return observed;
+    }
+
+    return stream->ewma_valid && stream->ewma > observed ? stream->ewma : observed;
+}
+
+static void replay_state__throttle_check(struct replay_state *state, int64_t now_ns) {
+    if (!state->throttled && cl_mem_reg_model__should_throttle(state->usage, state->budget)) {
+        state->throttled = 1;
+        state->throttle_start_ns = now_ns;
+    }
+}
+
+static void replay_state__close_period(struct replay_state *state, const struct replay_config *config, int cluster,
+                                       long period, int64_t start_ns, int64_t end_ns, int budget_mb) {
+    int64_t period_us = (end_ns - start_ns) / NS_PER_US;
+    int64_t throttle_ns = state->throttled ? end_ns - state->throttle_start_ns : 0;
+
+    if (!config->quiet) {
+        printf("%d,%ld,%lld.%06lld,%d,%d,%d,%d,%d,%lld,%d\n", cluster, period,
+               (long long)(start_ns / NS_PER_SEC), (long long)(start_ns % NS_PER_SEC / 1000), budget_mb,
+               cl_mem_reg_model__events_to_mb((u64)state->demand, period_us),
+               cl_mem_reg_model__events_to_mb((u64)state->gpu, period_us),
+               cl_mem_reg_model__events_to_mb((u64)state->usage, period_us),
+               state->throttled, (long long)(throttle_ns / NS_PER_US),
+               state->recorded_throttled);
+    }
+
+    state->periods++;
+    state->throttled_periods += state->throttled;
+    state->recorded_throttled_periods += state->recorded_throttled;
+    state->throttled_ns += throttle_ns;
+    state->total_demand += state->demand;
+    state->total_deferred += state->deferred;
+
+    state->usage = 0;
+    state->throttled = 0;
+    state->demand = 0;
+    state->gpu = 0;
+    state->deferred = 0;
+    state->recorded_throttled = 0;
+}
+
+static int replay_cluster(const struct replay_config *config, int cluster) {
+    struct log_stream streams[REPLAY_STREAMS];
+    struct replay_state states[REPLAY_MAX_BUDGETS];
+    char path[512];
+    int64_t recorded_aggregation_ns = config->recorded_aggregation_period_us * NS_PER_US;
+    int ticks_per_aggregation = config->aggregation_period_us / config->recorded_aggregation_period_us;
+    int interval = cl_mem_reg_model__manage_period_interval(config->regulation_period_us, config->aggregation_period_us);
+    int64_t ticks_per_period = (int64_t)interval * ticks_per_aggregation;
+    int64_t effective_period_us = ticks_per_period * config->recorded_aggregation_period_us;
+    int64_t t0 = 0, tick = -1;
+    int num_streams = 0, i, b;
+
+    for (i = 0; i < CORES_PER_CLUSTER; i++) {
+        snprintf(path, sizeof(path), CPU_LOG_FORMAT, config->dir, (cluster - 1) * CORES_PER_CLUSTER + i);
+        if (log_stream__open(&streams[num_streams], path, 0, i) == 0)
+            num_streams++;
+    }
+    snprintf(path, sizeof(path), GPU_LOG_FORMAT, config->dir, cluster);
+    if (log_stream__open(&streams[num_streams], path, 1, -1) == 0)
+        num_streams++;
+
+    if (num_streams == 0)
+        return 0;
+
+    memset(states, 0, sizeof(states));
+    for (b = 0; b < config->num_budgets; b++)
+        states[b].budget = cl_mem_reg_model__mb_to_events(config->budgets[b], config->regulation_period_us);
+
+    while (1) {
+        struct log_stream *stream = NULL;
+        int64_t sample_tick;
+        double demand;
+
+        /* Oldest pending sample of the cluster */
+        for (i = 0; i < num_streams; i++) {
+            if (streams[i].valid && (!stream || streams[i].ts_ns < stream->ts_ns))
+                stream = &streams[i];
+        }
+        if (!stream)
+            break;
+
+        if (tick < 0) {
+            t0 = stream->ts_ns;
+            tick = 0;
+        }
+
+        /* Recorded tick of the sample (rounded: ticks fire a little late) */
+        sample_tick = (stream->ts_ns - t0 + recorded_aggregation_ns / 2) / recorded_aggregation_ns;
+
+        /* Finish the ticks before this sample */
+        for (; tick < sample_tick; tick++) {
+            int64_t tick_ns = t0 + tick * recorded_aggregation_ns;
+
+            for (b = 0; b < config->num_budgets; b++) {
+                struct replay_state *state = &states[b];
+
+                /* Aggregation tick: the cores' events reach the cluster usage */
+                if (tick % ticks_per_aggregation == 0) {
+                    state->usage += (s64)state->pending;
+                    state->pending -= (s64)state->pending;
+                    replay_state__throttle_check(state, tick_ns);
+                }
+
+                /* Last tick of the period */
+                if ((tick + 1) % ticks_per_period == 0) {
+                    int64_t period = tick / ticks_per_period;
+
+                    replay_state__close_period(state, config, cluster, period,
+                                               t0 + period * ticks_per_period * recorded_aggregation_ns,
+                                               t0 + (period + 1) * ticks_per_period * recorded_aggregation_ns,
+                                               config->budgets[b]);
+                }
+            }
+        }
+
+        demand = log_stream__demand(stream, config->ewma_weight);
+
+        for (b = 0; b < config->num_budgets; b++) {
+            struct replay_state *state = &states[b];
+
+            state->demand += demand;
+            state->recorded_throttled |= stream->throttled;
+
+            if (stream->is_gpu) {
+                /* GPU beats are accounted as soon as they arrive */
+                state->gpu += demand;
+                state->usage += (s64)demand;
+                replay_state__throttle_check(state, stream->ts_ns);
+            }
+            else if (state->throttled) {
+                state->deferred += demand;
+            }
+            else {
+                state->pending += demand;
+            }
+        }
+
+        log_stream__next(stream);
+    }
+
+    for (i = 0; i < num_streams; i++)
+        log_stream__close(&streams[i]);
+
+    for (b = 0; b < config->num_budgets; b++) {
+        struct replay_state *state = &states[b];
+        double seconds = state->periods * effective_period_us / 1e6;
+
+        if (state->periods == 0)
+            continue;
+
+        fprintf(stderr, "cluster%d budget=%d MB/s: periods=%ld throttled_periods=%.2f%% (recorded %.2f%%)"
+                " throttle_ratio=%.4f demand=%.1f MB/s deferred=%.1f MB/s\n",
+                cluster, config->budgets[b], state->periods,
+                100.0 * state->throttled_periods / state->periods,
+                100.0 * state->recorded_throttled_periods / state->periods,
+                state->throttled_ns / (seconds * 1e9),
+                state->total_demand * CL_MEM_REG_CACHE_LINE_SIZE / (1024.0 * 1024.0) / seconds,
+                state->total_deferred * CL_MEM_REG_CACHE_LINE_SIZE / (1024.0 * 1024.0) / seconds);
+    }
+
+    return 1;
+}
+
+int main(int argc, char *argv[]) {
+    struct replay_config config = {
+        .dir = "/tmp",
+        .recorded_aggregation_period_us = 200,
+        .regulation_period_us = 6600,
+        .aggregation_period_us = 0,
+        .budgets = {7500},
+        .num_budgets = 1,
+        .cluster = 0,
+        .quiet = 0,
+        .ewma_weight = 0.25,
+    };
+    int opt, cluster, replayed = 0;
+    char *tok;
+
+    while ((opt = getopt(argc, argv, "d:a:r:A:b:c:e:qh")) != -1) {
+        switch (opt) {
+        case 'd': config.dir = optarg; break;
+        case 'a': config.recorded_aggregation_period_us = atoi(optarg); break;
+        case 'r': config.regulation_period_us = atoi(optarg); break;
+        case 'A': config.aggregation_period_us = atoi(optarg); break;
+        case 'b':
+            config.num_budgets = 0;
+            for (tok = strtok(optarg, ","); tok && config.num_budgets < REPLAY_MAX_BUDGETS; tok = strtok(NULL, ","))
+                config.budgets[config.num_budgets++] = atoi(tok);
+            break;
+        case 'c': config.cluster = atoi(optarg); break;
+        case 'e': config.ewma_weight = atof(optarg); break;
+        case 'q': config.quiet = 1; break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    if (config.aggregation_period_us == 0)
+        config.aggregation_period_us = config.recorded_aggregation_period_us;
+
+    if (config.recorded_aggregation_period_us <= 0 || config.regulation_period_us <= 0 ||
+        config.aggregation_period_us % config.recorded_aggregation_period_us != 0 || config.aggregation_period_us <= 0) {
+        fprintf(stderr, "The replayed T_A must be a multiple of the recorded T_A\n");
+        return 1;
+    }
+    for (opt = 0; opt < config.num_budgets; opt++) {
+        if (config.budgets[opt] <= 0) {
+            fprintf(stderr, "Invalid budget: %d\n", config.budgets[opt]);
+            return 1;
+        }
+    }
+    if (config.num_budgets == 0 || config.cluster < 0 || config.cluster > NUMBER_OF_CLUSTERS || config.ewma_weight <= 0 || config.ewma_weight > 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (!config.quiet)
+        printf("cluster,period,start_s,budget_mb,demand_mb,gpu_mb,used_mb,throttled,throttle_us,recorded_throttled\n");
+
+    for (cluster = 1; cluster <= NUMBER_OF_CLUSTERS; cluster++) {
+        if (config.cluster && config.cluster != cluster)
+            continue;
+        replayed += replay_cluster(&config, cluster);
+    }
+
+    if (!replayed) {
+        fprintf(stderr, "No logs found in %s\n", config.dir);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,603 @@
+/*
+ * Discrete-event simulator of cluster-level memory access regulation.
+ *
+ * Drives the regulation model of cl_mem_reg.ko (include/cl_mem_reg_model.h)
+ * with synthetic or recorded per-core and GPU demand streams, and reports
+ * throttle ratio, overshoot and the bandwidth left to a protected task for
+ * every combination of regulation period, aggregation period and budget.
+ *
+ * Usage: ./cl_mem_reg_sim [options] <stream>...
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include "cl_mem_reg_model.h"
+
+#define SIM_MAX_CORES 8
+#define SIM_MAX_VALUES 64 /* values per swept parameter */
+#define SIM_NO_EVENT INT64_MAX
+
+#define NS_PER_US 1000LL
+#define NS_PER_MS 1000000LL
+
+/* MB/s -> LLC events per ns */
+#define MB_TO_EVENTS_PER_NS(mb) ((mb) * 1024.0 * 1024.0 / CL_MEM_REG_CACHE_LINE_SIZE / 1e9)
+
+/* Demand stream (MB/s) of a core or of the GPU */
+struct stream {
+    int defined;
+
+    /* synthetic: 'mb' while on, 0 while off (on_ns == 0: always on) */
+    double mb;
+    int64_t on_ns;
+    int64_t off_ns;
+
+    /* recorded: step function through (t_ns[i], mb_pts[i]) */
+    int n;
+    int64_t *t_ns;
+    double *mb_pts;
+    int cursor;
+};
+
+struct sim_config {
+    int regulation_period_us;
+    int aggregation_period_us;
+    int budget_mb;
+    int64_t duration_ns;
+    int64_t jitter_ns;
+    int64_t gpu_delay_ns;
+    int gpu_profiling_core;    /* -1: GPU not accounted */
+    int aggregation_period_max_us; /* adaptive T_A bound, 0: fixed T_A */
+    int throttle_mode;         /* 0: until the end of the period, 1: duty cycle */
+    int burst_cap_pct;         /* carry-over credit cap (% of the budget), -1: no carry-over */
+    double capacity_mb;        /* memory bandwidth shared with the protected task */
+    double protected_mb;       /* protected task demand, 0: not modelled */
+};
+
+struct sim_core {
+    int64_t next_tick_ns;
+    int64_t cnt;               /* tick count (aggregation_period_cnt) */
+    int64_t next_cnt;          /* tick count of the next tick */
+    double pending;            /* events since the last tick (PMU counter) */
+    int throttled;
+    int64_t throttled_since_ns;
+    int64_t throttle_until_ns; /* end of a duty-cycle stall, 0: end of the period */
+    int duty;                  /* per mille of the current slot stalled */
+};
+
+struct sim_result {
+    double throttle_ratio;     /* throttled core time / core time */
+    double stall_max_us;       /* longest single stall */
+    double overrun_pct;        /* regulation periods whose traffic exceeded the budget */
+    double overshoot_mean_mb;  /* traffic beyond budget, mean over overrun periods */
+    double overshoot_max_mb;
+    double cpu_mb;
+    double gpu_mb;
+    double protected_mb;       /* mean bandwidth of the protected task */
+    double protected_min_mb;   /* worst regulation period */
+    double ticks_per_s;        /* timer interrupts per core */
+};
+
+static struct stream core_streams[SIM_MAX_CORES];
+static struct stream gpu_stream;
+static int num_cores = 0;
+static unsigned long long rng_state = 1;
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [options] <stream>...\n"
+            "  -r <us>[,<us>...]     regulation period T_R (default: 6600)\n"
+            "  -a <us>[,<us>...]     aggregation period T_A (default: 200)\n"
+            "  -m <us>[,<us>...]     adaptive T_A upper bound, 0: fixed T_A (default: 0)\n"
+            "  -t <mode>[,<mode>...] throttle mode, 0: until the end of the period, 1: duty cycle (default: 0)\n"
+            "  -b <MB/s>[,<MB/s>...] cluster budget (default: 7500)\n"
+            "  -c <%%>                carry credit (capped at this %% of the budget) and debt over periods (default: off)\n"
+            "  -d <ms>               simulated time (default: 1000)\n"
+            "  -j <us>               maximum tick jitter (default: 0)\n"
+            "  -g <us>               GPU sample delay (default: 50)\n"
+            "  -G <cpu>              GPU profiling core (default: last core, -1: no GPU)\n"
+            "  -C <MB/s>             memory bandwidth shared with the protected task (default: 20000)\n"
+            "  -P <MB/s>             protected task demand (default: 0, not modelled)\n"
+            "  -s <seed>             jitter seed (default: 1)\n"
+            "streams:\n"
+            "  cpu<N>=<MB/s>[:<on_us>:<off_us>]   synthetic, optionally on/off bursts\n"
+            "  cpu<N>=@<file>                     recorded, '<time_us>,<MB/s>' lines\n"
+            "  gpu=<MB/s>[:<on_us>:<off_us>] | gpu=@<file>\n"
+            "One CSV row is printed per combination of -r, -a, -m, -t and -b.\n",
+            prog);
+}
+
+static int parse_list(char *arg, int *values) {
+    int n = 0;
+    char *tok;
+
+    for (tok = strtok(arg, ","); tok; tok = strtok(NULL, ",")) {
+        if (n == SIM_MAX_VALUES) {
+            fprintf(stderr, "Too many values: %s\n", tok);
+            return -1;
+        }
+        values[n] = atoi(tok);
+        if (values[n] <= 0) {
+            fprintf(stderr, "Invalid value: %s\n", tok);
+            return -1;
+        }
+        n++;
+    }
+
+    return n;
+}
+
+static int stream__load(struct stream *stream, const char *path) {
+    FILE *fp;
+    long long t_us;
+    double mb;
+    int capacity = 0;
+
+    fp = fopen(path, "r");
+    if (!fp) {
+        perror(path);
+        return -1;
+    }
+
+    while (1) {
+        int ret = fscanf(fp, "%lld,%lf", &t_us, &mb);
+
+        if (ret == EOF)
+            break;
+        if (ret != 2) {
+            /* skip comments and headers */
+            if (fscanf(fp, "%*[^\n]") == EOF)
+                break;
+            continue;
+        }
+
+        if (stream->n == capacity) {
+            capacity = capacity ? capacity * 2 : 1024;
+            stream->t_ns = realloc(stream->t_ns, capacity * sizeof(int64_t));
+            stream->mb_pts = realloc(stream->mb_pts, capacity * sizeof(double));
+            if (!stream->t_ns || !stream->mb_pts) {
+                fprintf(stderr, "Out of memory\n");
+                fclose(fp);
+                return -1;
+            }
+        }
+        stream->t_ns[stream->n] = t_us * NS_PER_US;
+        stream->mb_pts[stream->n] = mb;
+        stream->n++;
+    }
+
+    fclose(fp);
+
+    if (stream->n == 0) {
+        fprintf(stderr, "%s: no samples\n", path);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int stream__parse(struct stream *stream, const char *spec) {
+    long long on_us = 0, off_us = 0;
+
+    memset(stream, 0, sizeof(*stream));
+    stream->defined = 1;
+
+    if (spec[0] == '@')
+        return stream__load(stream, spec + 1);
+
+    if (sscanf(spec, "%lf:%lld:%lld", &stream->mb, &on_us, &off_us) < 1 || stream->mb < 0) {
+        fprintf(stderr, "Invalid stream: %s\n", spec);
+        return -1;
+    }
+    stream->on_ns = on_us * NS_PER_US;
+    stream->off_ns = off_us * NS_PER_US;
+
+    return 0;
+}
+
+/* Recorded streams are read forward only */
+static void stream__seek(struct stream *stream, int64_t t) {
+    while (stream->cursor + 1 < stream->n && stream->t_ns[stream->cursor + 1] <= t)
+        stream->cursor++;
+}
+
+/* Demand at 't' (MB/s) */
+static double stream__rate(struct stream *stream, int64_t t) {
+    if (!stream->defined)
+        return 0;
+
+    if (stream->n) {
+        stream__seek(stream, t);
+        return t < stream->t_ns[0] ? 0 : stream->mb_pts[stream->cursor];
+    }
+
+    if (stream->on_ns == 0 || stream->off_ns == 0)
+        return stream->mb;
+
+    return t % (stream->on_ns + stream->off_ns) < stream->on_ns ? stream->mb : 0;
+}
+
+/* Next time after 't' at which the demand changes */
+static int64_t stream__next_change(struct stream *stream, int64_t t) {
+    int64_t cycle, phase;
+
+    if (!stream->defined)
+        return SIM_NO_EVENT;
+
+    if (stream->n) {
+        stream__seek(stream, t);
+        if (t < stream->t_ns[0])
+            return stream->t_ns[0];
+        return stream->cursor + 1 < stream->n ? stream->t_ns[stream->cursor + 1] : SIM_NO_EVENT;
+    }
+
+    if (stream->on_ns == 0 || stream->off_ns == 0)
+        return SIM_NO_EVENT;
+
+    cycle = stream->on_ns + stream->off_ns;
+    phase = t % cycle;
+
+    return t - phase + (phase < stream->on_ns ? stream->on_ns : cycle);
+}
+
+/* xorshift64*: reproducible jitter */
+static int64_t jitter(int64_t max_ns) {
+    if (max_ns <= 0)
+        return 0;
+
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+
+    return (int64_t)((rng_state * 2685821657736338717ULL) % (unsigned long long)(max_ns + 1));
+}
+
+/* Until the end of the period; a duty-cycle stall is extended */
+static void throttle_cluster(struct sim_core *cores, int64_t t) {
+    int i;
+
+    for (i = 0; i < num_cores; i++) {
+        if (!cores[i].throttled) {
+            cores[i].throttled = 1;
+            cores[i].throttled_since_ns = t;
+        }
+        cores[i].throttle_until_ns = 0;
+    }
+}
+
+static void unthrottle_core(struct sim_core *core, int64_t t, double *throttled_ns, int64_t *stall_max_ns) {
+    if (!core->throttled)
+        return;
+
+    *throttled_ns += t - core->throttled_since_ns;
+    if (t - core->throttled_since_ns > *stall_max_ns)
+        *stall_max_ns = t - core->throttled_since_ns;
+    core->throttled = 0;
+    core->throttle_until_ns = 0;
+}
+
+static void simulate(const struct sim_config *config, struct sim_result *result) {
+    struct sim_core cores[SIM_MAX_CORES];
+    int interval = cl_mem_reg_model__manage_period_interval(config->regulation_period_us, config->aggregation_period_us);
+    int64_t aggregation_ns = config->aggregation_period_us * NS_PER_US;
+    int64_t regulation_ns = interval * aggregation_ns;
+    s64 budget = cl_mem_reg_model__mb_to_events(config->budget_mb, config->regulation_period_us);
+    s64 balance = 0;                    /* carry-over credit or debt */
+    s64 cur_budget = budget;            /* budget of the current period */
+    s64 usage = 0;                      /* accounted usage of the current period */
+    s64 prev_usage = 0;                 /* accounted usage of the previous period */
+    int max_step = config->aggregation_period_max_us / config->aggregation_period_us;
+    long ticks = 0;
+    double period_traffic = 0;          /* real traffic of the current period (events) */
+    double period_protected = 0;        /* protected task traffic of the current period (MB/s * ns) */
+    int64_t period_start_ns = -1;
+    double gpu_pending = 0;
+    int64_t gpu_delivery_ns = SIM_NO_EVENT;
+    double throttled_ns = 0, cpu_events = 0, gpu_events = 0, protected_total = 0;
+    double overshoot_sum = 0, overshoot_max = 0, protected_min = -1;
+    int64_t stall_max_ns = 0;
+    long periods = 0, overrun_periods = 0;
+    int64_t t = 0;
+    int i;
+
+    memset(cores, 0, sizeof(cores));
+    for (i = 0; i < num_cores; i++) {
+        cores[i].next_tick_ns = jitter(config->jitter_ns);
+        cores[i].next_cnt = 1;
+        core_streams[i].cursor = 0;
+    }
+    gpu_stream.cursor = 0;
+
+    while (t < config->duration_ns) {
+        int64_t next = config->duration_ns;
+        double interference = 0, dt;
+
+        /* Next event: core tick, GPU sample delivery or demand change */
+        for (i = 0; i < num_cores; i++) {
+            if (cores[i].next_tick_ns < next) next = cores[i].next_tick_ns;
+            if (stream__next_change(&core_streams[i], t) < next) next = stream__next_change(&core_streams[i], t);
+            if (cores[i].throttle_until_ns && cores[i].throttle_until_ns < next) next = cores[i].throttle_until_ns;
+        }
+        if (gpu_delivery_ns < next) next = gpu_delivery_ns;
+        if (stream__next_change(&gpu_stream, t) < next) next = stream__next_change(&gpu_stream, t);
+
+        /* Consume bandwidth until the next event */
+        dt = next - t;
+        for (i = 0; i < num_cores; i++) {
+            double mb = cores[i].throttled ? 0 : stream__rate(&core_streams[i], t);
+            double events = MB_TO_EVENTS_PER_NS(mb) * dt;
+
+            cores[i].pending += events;
+            cpu_events += events;
+            period_traffic += events;
+            interference += mb;
+        }
+        {
+            double mb = stream__rate(&gpu_stream, t);
+            double events = MB_TO_EVENTS_PER_NS(mb) * dt;
+
+            gpu_pending += events;
+            gpu_events += events;
+            period_traffic += events;
+            interference += mb;
+        }
+        if (config->protected_mb > 0) {
+            double share = config->capacity_mb / (config->protected_mb + interference);
+            double mb = config->protected_mb * (share < 1 ? share : 1);
+
+            protected_total += mb * dt;
+            period_protected += mb * dt;
+        }
+
+        t = next;
+        if (t >= config->duration_ns)
+            break;
+
+        /* End of duty-cycle stalls */
+        for (i = 0; i < num_cores; i++) {
+            if (cores[i].throttle_until_ns && cores[i].throttle_until_ns <= t)
+                unthrottle_core(&cores[i], t, &throttled_ns, &stall_max_ns);
+        }
+
+        /* GPU sample delivered to the beats receiver */
+        if (t == gpu_delivery_ns) {
+            s64 events = (s64)gpu_pending;
+
+            gpu_pending -= events;
+            usage += events;
+            gpu_delivery_ns = SIM_NO_EVENT;
+            if (cl_mem_reg_model__should_throttle(usage, cur_budget))
+                throttle_cluster(cores, t);
+        }
+
+        for (i = 0; i < num_cores; i++) {
+            struct sim_core *core = &cores[i];
+            s64 events, rate;
+            int pos, step = 1;
+
+            if (core->next_tick_ns != t)
+                continue;
+
+            core->cnt = core->next_cnt;
+            ticks++;
+
+            if (cl_mem_reg_model__is_regulation_tick(core->cnt, interval)) {
+                /* Unthrottle core */
+                unthrottle_core(core, t, &throttled_ns, &stall_max_ns);
+                core->duty = 0;
+
+                /* Leader (core 0) closes the period and resets the usage */
+                if (i == 0) {
+                    if (period_start_ns >= 0) {
+                        double overshoot = period_traffic - cur_budget;
+                        double protected_mb = period_protected / (t - period_start_ns);
+
+                        periods++;
+                        if (overshoot > 0) {
+                            overrun_periods++;
+                            overshoot_sum += overshoot;
+                            if (overshoot > overshoot_max) overshoot_max = overshoot;
+                        }
+                        if (config->protected_mb > 0 && (protected_min < 0 || protected_mb < protected_min))
+                            protected_min = protected_mb;
+
+                        if (config->burst_cap_pct >= 0) {
+                            balance = cl_mem_reg_model__carry_over(balance, usage, budget, budget * config->burst_cap_pct / 100);
+                            cur_budget = budget + balance;
+                        }
+                    }
+                    period_start_ns = t;
+                    period_traffic = 0;
+                    period_protected = 0;
+                    prev_usage = usage;
+                    usage = 0;
+                }
+            }
+            else {
+                /* Aggregation tick */
+                events = (s64)core->pending;
+                core->pending -= events;
+                usage += events;
+
+                if (i == config->gpu_profiling_core && gpu_delivery_ns == SIM_NO_EVENT)
+                    gpu_delivery_ns = t + config->gpu_delay_ns;
+
+                /* Same rules as aggregation_period_func() and duty_cycle_throttle() */
+                if (!core->throttled || core->throttle_until_ns) {
+                    if (cl_mem_reg_model__should_throttle(usage, cur_budget)) {
+                        throttle_cluster(cores, t);
+                    }
+                    else if (config->throttle_mode && !core->throttled) {
+                        s64 slot_rate = events;
+
+                        if (core->duty > 0 && core->duty < CL_MEM_REG_DUTY_FULL)
+                            slot_rate = events * CL_MEM_REG_DUTY_FULL / (CL_MEM_REG_DUTY_FULL - core->duty);
+                        core->duty = cl_mem_reg_model__duty_cycle(cur_budget - usage, slot_rate,
+                                                                  interval - cl_mem_reg_model__period_position(core->cnt, interval),
+                                                                  num_cores);
+                        if (core->duty) {
+                            core->throttled = 1;
+                            core->throttled_since_ns = t;
+                            core->throttle_until_ns = t + aggregation_ns * core->duty / CL_MEM_REG_DUTY_FULL;
+                        }
+                    }
+                }
+            }
+
+            /* Next tick (same rule as next_aggregation_step() in the module) */
+            if (config->aggregation_period_max_us) {
+                pos = cl_mem_reg_model__period_position(core->cnt, interval);
+                rate = pos ? usage / pos : prev_usage / interval;
+                step = cl_mem_reg_model__aggregation_step(core->cnt, interval, usage, cur_budget, rate, max_step);
+            }
+            core->next_cnt = core->cnt + step;
+            core->next_tick_ns = (core->next_cnt - 1) * aggregation_ns + jitter(config->jitter_ns);
+        }
+    }
+
+    for (i = 0; i < num_cores; i++)
+        unthrottle_core(&cores[i], config->duration_ns, &throttled_ns, &stall_max_ns);
+
+    /* events per regulation period -> MB/s */
+    result->throttle_ratio = throttled_ns / ((double)num_cores * config->duration_ns);
+    result->stall_max_us = (double)stall_max_ns / NS_PER_US;
+    result->overrun_pct = periods ? 100.0 * overrun_periods / periods : 0;
+    result->overshoot_mean_mb = overrun_periods ?
+        cl_mem_reg_model__events_to_mb((u64)(overshoot_sum / overrun_periods), regulation_ns / NS_PER_US) : 0;
+    result->overshoot_max_mb = cl_mem_reg_model__events_to_mb((u64)overshoot_max, regulation_ns / NS_PER_US);
+    result->cpu_mb = cpu_events * CL_MEM_REG_CACHE_LINE_SIZE / (1024.0 * 1024.0) / (config->duration_ns / 1e9);
+    result->gpu_mb = gpu_events * CL_MEM_REG_CACHE_LINE_SIZE / (1024.0 * 1024.0) / (config->duration_ns / 1e9);
+    result->protected_mb = protected_total / config->duration_ns;
+    result->protected_min_mb = protected_min < 0 ? result->protected_mb : protected_min;
+    result->ticks_per_s = ticks / (double)num_cores / (config->duration_ns / 1e9);
+}
+
+int main(int argc, char *argv[]) {
+    int regulation_periods[SIM_MAX_VALUES] = {6600}, num_regulation_periods = 1;
+    int aggregation_periods[SIM_MAX_VALUES] = {200}, num_aggregation_periods = 1;
+    int budgets[SIM_MAX_VALUES] = {7500}, num_budgets = 1;
+    int max_aggregation_periods[SIM_MAX_VALUES] = {0}, num_max_aggregation_periods = 1;
+    int throttle_modes[SIM_MAX_VALUES] = {0}, num_throttle_modes = 1;
+    struct sim_config config = {
+        .duration_ns = 1000 * NS_PER_MS,
+        .jitter_ns = 0,
+        .gpu_delay_ns = 50 * NS_PER_US,
+        .gpu_profiling_core = -2, /* last core */
+        .capacity_mb = 20000,
+        .protected_mb = 0,
+        .burst_cap_pct = -1,
+    };
+    int opt, r, a, m, tm, b, i;
+    char *tok;
+
+    while ((opt = getopt(argc, argv, "r:a:m:t:b:c:d:j:g:G:C:P:s:h")) != -1) {
+        switch (opt) {
+        case 'r': num_regulation_periods = parse_list(optarg, regulation_periods); break;
+        case 'a': num_aggregation_periods = parse_list(optarg, aggregation_periods); break;
+        case 'b': num_budgets = parse_list(optarg, budgets); break;
+        case 'm':
+            /* 0 (fixed T_A) is allowed here */
+            num_max_aggregation_periods = 0;
+            for (tok = strtok(optarg, ","); tok && num_max_aggregation_periods < SIM_MAX_VALUES; tok = strtok(NULL, ","))
+                max_aggregation_periods[num_max_aggregation_periods++] = atoi(tok);
+            break;
+        case 't':
+            num_throttle_modes = 0;
+            for (tok = strtok(optarg, ","); tok && num_throttle_modes < SIM_MAX_VALUES; tok = strtok(NULL, ",")) {
+                throttle_modes[num_throttle_modes] = atoi(tok);
+                if (throttle_modes[num_throttle_modes] != 0 && throttle_modes[num_throttle_modes] != 1) {
+                    fprintf(stderr, "Invalid throttle mode: %s\n", tok);
+                    return 1;
+                }
+                num_throttle_modes++;
+            }
+            break;
+        case 'c': config.burst_cap_pct = atoi(optarg); break;
+        case 'd': config.duration_ns = atoll(optarg) * NS_PER_MS; break;
+        case 'j': config.jitter_ns = atoll(optarg) * NS_PER_US; break;
+        case 'g': config.gpu_delay_ns = atoll(optarg) * NS_PER_US; break;
+        case 'G': config.gpu_profiling_core = atoi(optarg); break;
+        case 'C': config.capacity_mb = atof(optarg); break;
+        case 'P': config.protected_mb = atof(optarg); break;
+        case 's': rng_state = strtoull(optarg, NULL, 0) | 1; break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+        if (num_regulation_periods < 0 || num_aggregation_periods < 0 || num_budgets < 0)
+            return 1;
+    }
+
+    if (optind == argc || config.duration_ns <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    for (i = optind; i < argc; i++) {
+        int cpu;
+        char *spec = strchr(argv[i], '=');
+
+        if (!spec) {
+            fprintf(stderr, "Invalid stream: %s\n", argv[i]);
+            return 1;
+        }
+        spec++;
+
+        if (strncmp(argv[i], "gpu=", 4) == 0) {
+            if (stream__parse(&gpu_stream, spec) < 0)
+                return 1;
+        }
+        else if (sscanf(argv[i], "cpu%d=", &cpu) == 1 && cpu >= 0 && cpu < SIM_MAX_CORES) {
+            if (stream__parse(&core_streams[cpu], spec) < 0)
+                return 1;
+            if (cpu + 1 > num_cores)
+                num_cores = cpu + 1;
+        }
+        else {
+            fprintf(stderr, "Invalid stream: %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    if (num_cores == 0)
+        num_cores = 1;
+    if (config.gpu_profiling_core == -2)
+        config.gpu_profiling_core = num_cores - 1;
+    if (config.gpu_profiling_core >= num_cores) {
+        fprintf(stderr, "GPU profiling core %d is not in the cluster (%d cores)\n", config.gpu_profiling_core, num_cores);
+        return 1;
+    }
+
+    printf("t_r_us,t_a_us,t_a_max_us,throttle_mode,budget_mb,ticks_per_s,throttle_ratio,stall_max_us,overrun_pct,overshoot_mean_mb,overshoot_max_mb,cpu_mb,gpu_mb,protected_mb,protected_min_mb\n");
+
+    for (r = 0; r < num_regulation_periods; r++) {
+        for (a = 0; a < num_aggregation_periods; a++) {
+            for (m = 0; m < num_max_aggregation_periods; m++) {
+                for (tm = 0; tm < num_throttle_modes; tm++) {
+                    for (b = 0; b < num_budgets; b++) {
+                        struct sim_result result;
+
+                        config.regulation_period_us = regulation_periods[r];
+                        config.aggregation_period_us = aggregation_periods[a];
+                        config.aggregation_period_max_us = max_aggregation_periods[m];
+                        config.throttle_mode = throttle_modes[tm];
+                        config.budget_mb = budgets[b];
+
+                        simulate(&config, &result);
+
+                        printf("%d,%d,%d,%d,%d,%.0f,%.4f,%.0f,%.2f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f\n",
+                               config.regulation_period_us, config.aggregation_period_us, config.aggregation_period_max_us,
+                               config.throttle_mode, config.budget_mb, result.ticks_per_s, result.throttle_ratio,
+                               result.stall_max_us, result.overrun_pct, result.overshoot_mean_mb, result.overshoot_max_mb,
+                               result.cpu_mb, result.gpu_mb, result.protected_mb, result.protected_min_mb);
+                    }
+                }
+            }
+        }
+    }
+
+    return 0;
+}
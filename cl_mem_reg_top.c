@@ -0,0 +1,233 @@
+/*
+ * Live monitor of cl_mem_reg, fed from the live statistics page
+ * (/sys/kernel/debug/cl_mem_reg/live, include/cl_mem_reg_live.h).
+ *
+ * The page is mapped read-only once; every refresh copies its entries under
+ * their sequence counts and derives rates from the previous copy, so the
+ * only syscalls per refresh are the sleep and the terminal write. Shows per
+ * cluster the CPU and GPU bandwidth against the budget and the throttled
+ * time, and per core the bandwidth, throttled time and throttle latency.
+ *
+ * Usage: ./cl_mem_reg_top [-r <Hz>] [-n <refreshes>] [-b]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "cl_mem_reg_model.h"
+#include "cl_mem_reg_live.h"
+
+#define LIVE_PAGE "/sys/kernel/debug/cl_mem_reg/live"
+#define SCREEN_BUF_SIZE 8192
+#define IDLE_TICKS 10               /* a core without an update for this many T_A is idle (parked) */
+
+#define NS_PER_SEC 1000000000LL
+#define MB (1024.0 * 1024.0)
+
+struct top_sample {
+    int64_t now_ns;
+    struct cl_mem_reg_live_cluster cluster[CL_MEM_REG_LIVE_MAX_CLUSTERS];
+    struct cl_mem_reg_live_core core[CL_MEM_REG_LIVE_MAX_CORES];
+};
+
+static volatile int stop_requested = 0;
+
+static void handle_stop(int sig) {
+    (void)sig;
+    stop_requested = 1;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [-r <Hz>] [-n <refreshes>] [-b]\n"
+            "  -r  refresh rate, 1-100 (default: 10)\n"
+            "  -n  stop after this many refreshes (default: until SIGINT)\n"
+            "  -b  batch mode: append every refresh instead of redrawing the screen\n",
+            prog);
+}
+
+static int64_t monotonic_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * NS_PER_SEC + ts.tv_nsec;
+}
+
+/* An entry the writer kept busy keeps its copy from 'prev' (zero without one), so rates never jump */
+static void take_sample(const struct cl_mem_reg_live_page *page, const struct top_sample *prev, struct top_sample *sample) {
+    int i;
+
+    sample->now_ns = monotonic_ns();
+    for (i = 0; i < CL_MEM_REG_LIVE_MAX_CLUSTERS; i++) {
+        if (cl_mem_reg_live__read(&page->cluster[i], &sample->cluster[i], sizeof(sample->cluster[i])) == 0)
+            continue;
+        if (prev)
+            sample->cluster[i] = prev->cluster[i];
+        else
+            memset(&sample->cluster[i], 0, sizeof(sample->cluster[i]));
+    }
+    for (i = 0; i < CL_MEM_REG_LIVE_MAX_CORES; i++) {
+        if (cl_mem_reg_live__read(&page->core[i], &sample->core[i], sizeof(sample->core[i])) == 0)
+            continue;
+        if (prev)
+            sample->core[i] = prev->core[i];
+        else
+            memset(&sample->core[i], 0, sizeof(sample->core[i]));
+    }
+}
+
+static inline double events_mb_s(uint64_t events, double dt) { return events * CL_MEM_REG_CACHE_LINE_SIZE / MB / dt; }
+
+static inline double pct(double part, double whole) { return whole > 0 ? 100.0 * part / whole : 0; }
+
+static int core_cluster(const struct top_sample *sample, int cpu) {
+    int c;
+
+    for (c = 0; c < CL_MEM_REG_LIVE_MAX_CLUSTERS; c++)
+        if (sample->cluster[c].cpu_mask & (1ULL << cpu))
+            return c;
+    return -1;
+}
+
+static const char *core_state(const struct cl_mem_reg_live_page *page, const struct top_sample *cur, int cpu) {
+    const struct cl_mem_reg_live_core *core = &cur->core[cpu];
+
+    if (core_cluster(cur, cpu) < 0)
+        return "off";
+    if (core->throttled)
+        return "THROTTLED";
+    if (cur->now_ns - (int64_t)core->ts_ns > IDLE_TICKS * (int64_t)page->aggregation_period_ns)
+        return "idle";
+    return "run";
+}
+
+/* One screen, into 'buf' */
+static size_t render(const struct cl_mem_reg_live_page *page, const struct top_sample *prev, const struct top_sample *cur,
+                     int hz, int batch, char *buf, size_t size) {
+    double dt = (cur->now_ns - prev->now_ns) / 1e9;
+    int regulation_period_us = page->regulation_period_ns / 1000;
+    size_t len = 0;
+    int c, i;
+
+#define OUT(...) (len += snprintf(buf + len, len < size ? size - len : 0, __VA_ARGS__))
+
+    if (!batch)
+        OUT("\033[H\033[J");
+    OUT("cl_mem_reg_top  T_R=%dus T_A=%lluus  %d Hz\n\n", regulation_period_us,
+        (unsigned long long)page->aggregation_period_ns / 1000, hz);
+
+    OUT("CLUSTER  BUDGET_MB/s  CPU_MB/s  GPU_MB/s  UTIL%%  PERIOD%%  THR_TIME%%  THR_PERIODS%%  STATE\n");
+    for (c = 0; c < CL_MEM_REG_LIVE_MAX_CLUSTERS; c++) {
+        const struct cl_mem_reg_live_cluster *now = &cur->cluster[c], *was = &prev->cluster[c];
+        int budget_mb = regulation_period_us ? cl_mem_reg_model__events_to_mb(now->budget_events, regulation_period_us) : 0;
+        double cpu_mb, gpu_mb;
+
+        cpu_mb = events_mb_s(now->cpu_events - was->cpu_events, dt);
+        gpu_mb = events_mb_s(now->gpu_events - was->gpu_events, dt);
+
+        OUT("%-7d  %11d  %8.0f  %8.0f  %5.1f  %7.1f  %9.1f  %12.1f  %s\n", c + 1, budget_mb, cpu_mb, gpu_mb,
+            pct(cpu_mb + gpu_mb, budget_mb), pct(now->usage_events, now->budget_events),
+            pct((now->throttled_ns - was->throttled_ns) / 1e9, dt),
+            pct(now->throttled_periods - was->throttled_periods, now->periods - was->periods),
+            now->throttled ? "THROTTLED" : "run");
+    }
+
+    OUT("\nCPU  CLUSTER  MB/s  THR_TIME%%  THR/s  LAT_MEAN_us  LAT_MAX_us  IDLE%%  STATE\n");
+    for (i = 0; i < CL_MEM_REG_LIVE_MAX_CORES; i++) {
+        const struct cl_mem_reg_live_core *now = &cur->core[i], *was = &prev->core[i];
+        uint64_t throttles = now->throttle_count - was->throttle_count;
+        int cluster = core_cluster(cur, i);
+
+        if (cluster < 0 && !now->ticks)
+            continue;
+
+        OUT("%-3d  %7d  %4.0f  %9.1f  %5.0f  %11.1f  %10.1f  %5.1f  %s\n", i, cluster + 1,
+            events_mb_s(now->events - was->events, dt), pct((now->throttled_ns - was->throttled_ns) / 1e9, dt),
+            throttles / dt, throttles ? (now->throttle_latency_sum_ns - was->throttle_latency_sum_ns) / 1e3 / throttles : 0,
+            now->throttle_latency_max_ns / 1e3, pct((now->parked_ns - was->parked_ns) / 1e9, dt), core_state(page, cur, i));
+    }
+    if (batch)
+        OUT("\n");
+
+#undef OUT
+
+    return len < size ? len : size - 1;
+}
+
+int main(int argc, char *argv[]) {
+    const struct cl_mem_reg_live_page *page;
+    struct top_sample samples[2];
+    char screen[SCREEN_BUF_SIZE];
+    int hz = 10, batch = 0, opt, fd, cur = 0;
+    long refreshes = -1;
+    struct timespec interval;
+
+    while ((opt = getopt(argc, argv, "r:n:bh")) != -1) {
+        switch (opt) {
+        case 'r': hz = atoi(optarg); break;
+        case 'n': refreshes = atol(optarg); break;
+        case 'b': batch = 1; break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    if (hz < 1 || hz > 100) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    fd = open(LIVE_PAGE, O_RDONLY);
+    if (fd < 0) {
+        perror(LIVE_PAGE);
+        return 1;
+    }
+    page = mmap(NULL, CL_MEM_REG_LIVE_SIZE, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (page == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    if (page->magic != CL_MEM_REG_LIVE_MAGIC || page->version != CL_MEM_REG_LIVE_VERSION) {
+        fprintf(stderr, "%s: unexpected layout (version %u)\n", LIVE_PAGE, page->version);
+        return 1;
+    }
+
+    signal(SIGINT, handle_stop);
+    signal(SIGTERM, handle_stop);
+
+    interval.tv_sec = 0;
+    interval.tv_nsec = NS_PER_SEC / hz;
+    if (hz == 1) {
+        interval.tv_sec = 1;
+        interval.tv_nsec = 0;
+    }
+
+    take_sample(page, NULL, &samples[cur]);
+    while (!stop_requested && refreshes != 0) {
+        size_t len;
+
+        nanosleep(&interval, NULL);
+        if (stop_requested)
+            break;
+
+        take_sample(page, &samples[cur], &samples[cur ^ 1]);
+        len = render(page, &samples[cur], &samples[cur ^ 1], hz, batch, screen, sizeof(screen));
+        if (write(STDOUT_FILENO, screen, len) < 0)
+            break;
+
+        cur ^= 1;
+        if (refreshes > 0)
+            refreshes--;
+    }
+
+    munmap((void *)page, CL_MEM_REG_LIVE_SIZE);
+
+    return 0;
+}
@@ -8,9 +8,12 @@
 #include <signal.h>
 #include <sys/mman.h>
 #include <sys/ioctl.h>
+#include <sys/time.h>
+#include <sys/resource.h>
 #include <time.h>
 #include <pthread.h>
 #include <sched.h>
+#include <sys/syscall.h>
 #include "debug.h"
 #include "gpu.h"
 #include "sampler.h"
@@ -20,84 +23,252 @@
 #define TERMINATED -2
 #define DEBUG_LOG
 #define CL_MEM_REG_FORMAT "/dev/cl_mem_reg_cl%d"
+#define STOP_GPU_PROFILING_FORMAT "/sys/kernel/cl_mem_reg_cl%d/stop_gpu_bandwidth_profiling"
+#define GPU_PROFILER_PID_FILE "/tmp/gpu_profiler_pid"
 #define VINSTR 0
 
 #define MALI_MP12 0
 #define MALI_MP3_1 1
 #define MALI_MP3_2 2
 
-volatile sig_atomic_t interrupt_in_progress = 0;
+#define NUMBER_OF_CLUSTERS 2
 
-static struct gpu gpu;
-static struct sampler_config sc;
-static struct sampler sampler;
-static struct counter_sample sample;
+/* Signal used by cl_mem_reg to request a GPU sample of each cluster */
+#define GPU_PROFILING_SIGNAL_CL1 SIGUSR1
+#define GPU_PROFILING_SIGNAL_CL2 SIGUSR2
+
+/* Sampling thread */
+#define SAMPLING_THREAD_PRIORITY 50
+#define SAMPLING_THREAD_STACK_SIZE (256 * 1024)
+#define SAMPLING_THREAD_STACK_PREFAULT (128 * 1024)
+#define GPU_PROFILER_STOP_SIGNAL SIGRTMIN
+
+#define LATENCY_HIST_BUCKETS 32 /* log2(ns) buckets */
+
+/* log2 histogram of latencies in nanoseconds */
+struct latency_hist {
+    uint64_t buckets[LATENCY_HIST_BUCKETS];
+    uint64_t count;
+    uint64_t sum_ns;
+    uint64_t max_ns;
+};
+
+/* Per-cluster profiling state (one Mali device per cluster) */
+struct gpu_profiling_target {
+    int cluster;
+    int gpu_type;
+    int signal;
+    int fd;
+
+    struct gpu gpu;
+    struct sampler_config sc;
+    struct sampler sampler;
+    struct counter_sample sample;
+
+    /* statistics */
+    uint64_t requests;
+    uint64_t open_errors;
+    uint64_t write_errors;
+    struct latency_hist delivery_latency; /* kernel request -> sampling thread */
+    struct latency_hist service_time;     /* sampling thread -> beats written */
+    struct latency_hist total_latency;    /* kernel request -> beats written */
+};
+
+static struct gpu_profiling_target targets[NUMBER_OF_CLUSTERS];
+static int num_targets = 0;
+static pthread_t sampling_thread;
+static volatile sig_atomic_t stop_requested = 0;
 enum hwcpipe_counter counter1 = MaliExtBusRdBt;
 enum hwcpipe_counter counter2 = MaliExtBusWrBt;
-static int fd = -1;
-
-int target_cluster;
 
 void cleanup();
+void print_overhead_report();
+void print_latency_report();
 
-void profile_gpu_bandwidth(int signal) {
+static struct gpu_profiling_target* find_target_by_signal(int signal) {
+    int i;
 
-    if (signal == SIGUSR1) {
-        if (fd == NOT_STARTED) {
-            /* Device file path */
-            char cl_mem_reg_path[256];
-            snprintf(cl_mem_reg_path, sizeof(cl_mem_reg_path), CL_MEM_REG_FORMAT, target_cluster);
+    for (i = 0; i < num_targets; i++) {
+        if (targets[i].signal == signal)
+            return &targets[i];
+    }
 
-            fd = open(cl_mem_reg_path, O_WRONLY);
-            if (fd < 0) {
-                perror("User - Failed to open cl_mem_reg device");
-                return;
-            }
-        }
-        else if (fd == TERMINATED) {
-            return;
-        }
-        
-        int rd_beats = 0;
-        int wr_beats = 0;
-        
-        sampler__sample_now(&sampler);
-
-        sampler__get_counter_value(&sampler, counter1, &sample);
-        wr_beats = sample.value.uint64;
-
-        sampler__get_counter_value(&sampler, counter2, &sample);
-        rd_beats = sample.value.uint64;
-
-        int gpu_beats[2];
-        gpu_beats[0] = rd_beats;
-        gpu_beats[1] = wr_beats;
-        if (write(fd, gpu_beats, sizeof(int) * 2) != sizeof(int) * 2) {
-            perror("User - Failed to write GPU beats");
+    return NULL;
+}
+
+static int cluster_signal(int cluster) {
+    return cluster == 1 ? GPU_PROFILING_SIGNAL_CL1 : GPU_PROFILING_SIGNAL_CL2;
+}
+
+static inline uint64_t monotonic_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline void latency_hist__add(struct latency_hist* hist, uint64_t ns) {
+    int bucket = ns ? 63 - __builtin_clzll(ns) : 0;
+
+    if (bucket >= LATENCY_HIST_BUCKETS)
+        bucket = LATENCY_HIST_BUCKETS - 1;
+
+    hist->buckets[bucket]++;
+    hist->count++;
+    hist->sum_ns += ns;
+    if (ns > hist->max_ns)
+        hist->max_ns = ns;
+}
+
+/* Upper bound (ns) of the bucket holding the given percentile */
+static uint64_t latency_hist__percentile(struct latency_hist* hist, double percentile) {
+    uint64_t target, seen = 0;
+    int i;
+
+    if (hist->count == 0)
+        return 0;
+
+    target = (uint64_t)(hist->count * percentile / 100.0);
+    for (i = 0; i < LATENCY_HIST_BUCKETS; i++) {
+        seen += hist->buckets[i];
+        if (seen > target)
+            return 2ULL << i;
+    }
+
+    return hist->max_ns;
+}
+
+/* Hot path: runs on the sampling thread, so no stdio here */
+static void sample_target(struct gpu_profiling_target* target, uint32_t request_time) {
+    uint64_t start_ns, end_ns;
+
+    start_ns = monotonic_ns();
+
+    if (target->fd == NOT_STARTED) {
+        /* Device file path */
+        char cl_mem_reg_path[256];
+        snprintf(cl_mem_reg_path, sizeof(cl_mem_reg_path), CL_MEM_REG_FORMAT, target->cluster);
+
+        target->fd = open(cl_mem_reg_path, O_WRONLY);
+        if (target->fd < 0) {
+            target->open_errors++;
+            target->fd = NOT_STARTED;
             return;
         }
     }
-    else if (signal == SIGINT || signal == SIGTERM) {
-        printf("Received termination signal (SIGINT or SIGTERM)\n");
+    else if (target->fd == TERMINATED) {
+        return;
+    }
 
-        if (fd >= 0 && fd != TERMINATED) {
-            close(fd);
-            fd = TERMINATED;
-        }
-        
-        /* Set sysfs path */
-        const char *sysfs_path;
-        if (target_cluster == 1) {
-            sysfs_path = "/sys/kernel/cl_mem_reg_cl1/stop_gpu_bandwidth_profiling";
-        } else if (target_cluster == 2) {
-            sysfs_path = "/sys/kernel/cl_mem_reg_cl2/stop_gpu_bandwidth_profiling";
-        } else {
-            fprintf(stderr, "Invalid target cluster: %d\n", target_cluster);
-            cleanup();
-            exit(EXIT_FAILURE);
-        }
-  
-        FILE *sysfs_file = fopen(sysfs_path, "w");
+    int rd_beats = 0;
+    int wr_beats = 0;
+
+    sampler__sample_now(&target->sampler);
+
+    sampler__get_counter_value(&target->sampler, counter1, &target->sample);
+    wr_beats = target->sample.value.uint64;
+
+    sampler__get_counter_value(&target->sampler, counter2, &target->sample);
+    rd_beats = target->sample.value.uint64;
+
+    int gpu_beats[2];
+    gpu_beats[0] = rd_beats;
+    gpu_beats[1] = wr_beats;
+    target->requests++;
+    if (write(target->fd, gpu_beats, sizeof(int) * 2) != sizeof(int) * 2) {
+        target->write_errors++;
+        return;
+    }
+
+    end_ns = monotonic_ns();
+    latency_hist__add(&target->service_time, end_ns - start_ns);
+
+    /* cl_mem_reg stamps each request with the low 32 bits of CLOCK_MONOTONIC */
+    if (request_time) {
+        latency_hist__add(&target->delivery_latency, (uint32_t)((uint32_t)start_ns - request_time));
+        latency_hist__add(&target->total_latency, (uint32_t)((uint32_t)end_ns - request_time));
+    }
+}
+
+/* Touch the stack up front so the hot path never page-faults */
+static void prefault_stack(void) {
+    volatile unsigned char stack[SAMPLING_THREAD_STACK_PREFAULT];
+    size_t i;
+
+    for (i = 0; i < sizeof(stack); i += 4096)
+        stack[i] = 0;
+}
+
+/*
+ * cl_mem_reg signals one thread (send_sig_info()), not the process, so the
+ * PID handed to it is the sampling thread's TID.
+ */
+static int write_pid_file(void) {
+    FILE* pid_file = fopen(GPU_PROFILER_PID_FILE, "w");
+
+    if (!pid_file) {
+        perror("Failed to open " GPU_PROFILER_PID_FILE);
+        return -1;
+    }
+    /* One daemon serves every cluster, so every cluster gets the same PID */
+    fprintf(pid_file, "%d\n", (int)syscall(SYS_gettid));
+    fclose(pid_file);
+
+    return 0;
+}
+
+static void* sampling_thread_func(void* arg) {
+    sigset_t wait_set;
+    siginfo_t info;
+    int i;
+
+    (void)arg;
+
+    prefault_stack();
+
+    if (write_pid_file() < 0) {
+        kill(getpid(), SIGTERM);
+        return NULL;
+    }
+
+    sigemptyset(&wait_set);
+    for (i = 0; i < num_targets; i++)
+        sigaddset(&wait_set, targets[i].signal);
+    sigaddset(&wait_set, GPU_PROFILER_STOP_SIGNAL);
+
+    while (!stop_requested) {
+        struct gpu_profiling_target* target;
+        uint32_t request_time = 0;
+
+        if (sigwaitinfo(&wait_set, &info) < 0)
+            continue;
+
+        if (info.si_signo == GPU_PROFILER_STOP_SIGNAL)
+            break;
+
+        target = find_target_by_signal(info.si_signo);
+        if (!target)
+            continue;
+
+        if (info.si_code == SI_QUEUE)
+            request_time = (uint32_t)info.si_value.sival_int;
+
+        sample_target(target, request_time);
+    }
+
+    return NULL;
+}
+
+/* Tell cl_mem_reg to stop requesting samples of every served cluster */
+static void stop_gpu_bandwidth_profiling(void) {
+    int i;
+
+    for (i = 0; i < num_targets; i++) {
+        char sysfs_path[256];
+        FILE *sysfs_file;
+
+        snprintf(sysfs_path, sizeof(sysfs_path), STOP_GPU_PROFILING_FORMAT, targets[i].cluster);
+        sysfs_file = fopen(sysfs_path, "w");
         if (sysfs_file == NULL) {
             perror("Failed to open sysfs file");
         } else {
@@ -106,117 +277,230 @@ void profile_gpu_bandwidth(int signal) {
             }
             fclose(sysfs_file);
         }
-        
-        cleanup();
-        exit(EXIT_SUCCESS);
     }
+}
 
-    return;
+void cleanup() {
+    int i;
+
+    for (i = 0; i < num_targets; i++) {
+        if (targets[i].fd >= 0) {
+            close(targets[i].fd);
+        }
+        targets[i].fd = TERMINATED;
+    }
 }
 
-void cleanup() { 
-    if (fd >= 0 && fd != TERMINATED) {
-        close(fd);
-        fd = TERMINATED;
+/* CPU cost of the profiler, to compare against one process per cluster */
+void print_overhead_report() {
+    struct rusage usage;
+    uint64_t total_requests = 0;
+    double cpu_time_us;
+    int i;
+
+    if (getrusage(RUSAGE_SELF, &usage) == -1) {
+        perror("getrusage");
+        return;
+    }
+
+    cpu_time_us = (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1e6
+                + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+
+    printf("=== GPU profiler overhead ===\n");
+    for (i = 0; i < num_targets; i++) {
+        printf(" - Cluster%d (GPU %d): %llu requests, %llu open errors, %llu write errors\n", targets[i].cluster, targets[i].gpu_type,
+               (unsigned long long)targets[i].requests, (unsigned long long)targets[i].open_errors,
+               (unsigned long long)targets[i].write_errors);
+        total_requests += targets[i].requests;
+    }
+    printf(" - User time (s): %ld.%06ld\n", (long)usage.ru_utime.tv_sec, (long)usage.ru_utime.tv_usec);
+    printf(" - System time (s): %ld.%06ld\n", (long)usage.ru_stime.tv_sec, (long)usage.ru_stime.tv_usec);
+    printf(" - Context switches: %ld voluntary, %ld involuntary\n", usage.ru_nvcsw, usage.ru_nivcsw);
+    if (total_requests > 0) {
+        printf(" - CPU time per request (us): %.2f\n", cpu_time_us / total_requests);
     }
+    printf("===============\n");
 }
 
-int main(int argc, char* argv[]) {
-    struct sched_param param;
-    FILE *pid_file;
-    int gpu_type;
-    int pid;
-    
-    if (argc < 3) {
-        fprintf(stderr, "Input argument need to be <target_cluster> <GPU_type>\n");
-        exit(EXIT_FAILURE);
+static void print_latency_hist(const char* name, struct latency_hist* hist) {
+    if (hist->count == 0) {
+        printf("    - %s: no samples\n", name);
+        return;
     }
 
-    target_cluster = strtol(argv[1], NULL, 10);
-    if (target_cluster != 1 && target_cluster != 2) {
-        fprintf(stderr, "Wrong target cluster: %d\n", target_cluster);
-        exit(EXIT_FAILURE);
+    printf("    - %s (us): mean %.1f, p50 < %.1f, p99 < %.1f, p99.9 < %.1f, max %.1f\n", name,
+           (double)hist->sum_ns / hist->count / 1000.0,
+           latency_hist__percentile(hist, 50.0) / 1000.0,
+           latency_hist__percentile(hist, 99.0) / 1000.0,
+           latency_hist__percentile(hist, 99.9) / 1000.0,
+           hist->max_ns / 1000.0);
+}
+
+/* Sampling jitter, measured from the timestamp cl_mem_reg puts in each request */
+void print_latency_report() {
+    int i;
+
+    printf("=== GPU sampling latency ===\n");
+    for (i = 0; i < num_targets; i++) {
+        printf(" - Cluster%d:\n", targets[i].cluster);
+        print_latency_hist("Request delivery", &targets[i].delivery_latency);
+        print_latency_hist("Sampling", &targets[i].service_time);
+        print_latency_hist("Request to beats written", &targets[i].total_latency);
     }
+    printf("===============\n");
+}
 
-    gpu_type = strtol(argv[2], NULL, 10);
-    if (gpu_type != -1 && gpu_type != MALI_MP12 && gpu_type != MALI_MP3_1 && gpu_type != MALI_MP3_2) {
-        fprintf(stderr, "Wrong GPU type: %d\n", gpu_type);
+static int valid_gpu_type(int gpu_type) {
+    return gpu_type == MALI_MP12 || gpu_type == MALI_MP3_1 || gpu_type == MALI_MP3_2;
+}
+
+static void add_target(int cluster, int gpu_type) {
+    int i;
+
+    if (cluster != 1 && cluster != 2) {
+        fprintf(stderr, "Wrong target cluster: %d\n", cluster);
         exit(EXIT_FAILURE);
     }
 
-    printf("=== Cluster%d GPU profiler ===\n", target_cluster);
-    printf("GPU_TYPE: %d\n", gpu_type);
+    if (gpu_type == -1) {
+        return;
+    }
 
-    /* Priority */
-    param.sched_priority = 50;
-    if(sched_setscheduler(0, SCHED_FIFO, &param) == -1) {
-        perror("Cannot set SCHED_FIFO");
+    if (!valid_gpu_type(gpu_type)) {
+        fprintf(stderr, "Wrong GPU type: %d\n", gpu_type);
         exit(EXIT_FAILURE);
     }
-    
-    pid = (int)getpid();
 
-    if (target_cluster == 1) {
-        pid_file = fopen("/tmp/gpu_profiler_pid_cl1", "w");
-        if (!pid_file) {
-            perror("Failed to open /tmp/gpu_profiler_pid_cl1");
-            exit(EXIT_FAILURE);
-        }
-        fprintf(pid_file, "%d\n", pid);
-        fclose(pid_file);
-    }
-    else if (target_cluster == 2) {
-        pid_file = fopen("/tmp/gpu_profiler_pid_cl2", "w");
-        if (!pid_file) {
-            perror("Failed to open /tmp/gpu_profiler_pid_cl2");
+    for (i = 0; i < num_targets; i++) {
+        if (targets[i].cluster == cluster) {
+            fprintf(stderr, "Cluster%d is given more than once\n", cluster);
             exit(EXIT_FAILURE);
         }
-        fprintf(pid_file, "%d\n", pid);
-        fclose(pid_file);
     }
-    
-    struct sigaction sa;
 
-    sa.sa_handler = profile_gpu_bandwidth;
-    sa.sa_flags = 0;
-    sigemptyset(&sa.sa_mask);
+    memset(&targets[num_targets], 0, sizeof(struct gpu_profiling_target));
+    targets[num_targets].cluster = cluster;
+    targets[num_targets].gpu_type = gpu_type;
+    targets[num_targets].signal = cluster_signal(cluster);
+    targets[num_targets].fd = TERMINATED;
+    num_targets++;
+}
+
+static void init_target(struct gpu_profiling_target* target) {
+    // Init GPU and sampler
+    gpu__init(&target->gpu, target->gpu_type);
+    sampler_config__init(&target->sc, &target->gpu);
+
+    sampler_config__add_counter(&target->sc, counter1);
+    sampler_config__add_counter(&target->sc, counter2);
 
-    if (sigaction(SIGUSR1, &sa, NULL) == -1) {
-        perror("Cannot initialize sigaction for SIGUSR1");
+    sampler__init(&target->sampler, &target->sc);
+
+    sampler__start_sampling(&target->sampler);
+
+    counter_sample__init(&target->sample);
+}
+
+int main(int argc, char* argv[]) {
+    struct sched_param param;
+    pthread_attr_t attr;
+    sigset_t blocked, termination;
+    int sig;
+    int ret;
+    int i;
+
+    if (argc < 2) {
+        fprintf(stderr, "Input argument need to be <target_cluster>:<GPU_type> [<target_cluster>:<GPU_type>]\n");
+        fprintf(stderr, "                       or <target_cluster> <GPU_type>\n");
         exit(EXIT_FAILURE);
     }
 
-    if (sigaction(SIGINT, &sa, NULL) == -1) {
-        perror("Cannot initialize sigaction for SIGINT");
-        exit(EXIT_FAILURE);
+    if (argc == 3 && !strchr(argv[1], ':') && !strchr(argv[2], ':')) {
+        /* Legacy form: one cluster per process */
+        add_target(strtol(argv[1], NULL, 10), strtol(argv[2], NULL, 10));
+    }
+    else {
+        for (i = 1; i < argc; i++) {
+            char* sep = strchr(argv[i], ':');
+            if (!sep || num_targets >= NUMBER_OF_CLUSTERS) {
+                fprintf(stderr, "Wrong argument: %s\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+            add_target(strtol(argv[i], NULL, 10), strtol(sep + 1, NULL, 10));
+        }
     }
 
-    if (sigaction(SIGTERM, &sa, NULL) == -1) {
-        perror("Cannot initialize sigaction for SIGTERM");
+    if (num_targets == 0) {
+        fprintf(stderr, "No GPU to profile\n");
         exit(EXIT_FAILURE);
     }
-    
-    // Init GPU and sampler
-    gpu__init(&gpu, gpu_type);
-    sampler_config__init(&sc, &gpu);
 
-    sampler_config__add_counter(&sc, counter1);
-    sampler_config__add_counter(&sc, counter2);
+    printf("=== GPU profiler ===\n");
+    for (i = 0; i < num_targets; i++) {
+        printf("Cluster%d GPU_TYPE: %d\n", targets[i].cluster, targets[i].gpu_type);
+    }
 
-    sampler__init(&sampler, &sc);
+    /*
+     * Block every signal we handle before any thread exists: requests are
+     * consumed synchronously by the sampling thread, termination by main.
+     */
+    sigemptyset(&blocked);
+    sigaddset(&blocked, GPU_PROFILING_SIGNAL_CL1);
+    sigaddset(&blocked, GPU_PROFILING_SIGNAL_CL2);
+    sigaddset(&blocked, GPU_PROFILER_STOP_SIGNAL);
+    sigaddset(&blocked, SIGINT);
+    sigaddset(&blocked, SIGTERM);
+    if (pthread_sigmask(SIG_BLOCK, &blocked, NULL) != 0) {
+        perror("Cannot block signals");
+        exit(EXIT_FAILURE);
+    }
 
-    sampler__start_sampling(&sampler);
+    for (i = 0; i < num_targets; i++) {
+        init_target(&targets[i]);
+        targets[i].fd = NOT_STARTED;
+    }
 
-    counter_sample__init(&sample);
+    /* Keep every page (heap, sampler buffers, stacks) resident */
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) == -1) {
+        perror("Cannot lock memory");
+        exit(EXIT_FAILURE);
+    }
+
+    /* Only the sampling thread runs with real-time priority */
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, SAMPLING_THREAD_STACK_SIZE);
+    pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+    param.sched_priority = SAMPLING_THREAD_PRIORITY;
+    pthread_attr_setschedparam(&attr, &param);
+
+    ret = pthread_create(&sampling_thread, &attr, sampling_thread_func, NULL);
+    pthread_attr_destroy(&attr);
+    if (ret != 0) {
+        fprintf(stderr, "Cannot create SCHED_FIFO sampling thread: %s\n", strerror(ret));
+        exit(EXIT_FAILURE);
+    }
 
     printf("User mode GPU BW profiler - PID: %d\n", (int)getpid());
     printf("===============\n\n");
+    fflush(stdout);
 
-    fd = NOT_STARTED;
+    /* Wait for termination */
+    sigemptyset(&termination);
+    sigaddset(&termination, SIGINT);
+    sigaddset(&termination, SIGTERM);
+    while (sigwait(&termination, &sig) != 0)
+        ;
 
-    while(1) {
-        pause();
-    }
+    printf("Received termination signal (SIGINT or SIGTERM)\n");
+
+    stop_requested = 1;
+    pthread_kill(sampling_thread, GPU_PROFILER_STOP_SIGNAL);
+    pthread_join(sampling_thread, NULL);
+
+    stop_gpu_bandwidth_profiling();
+    print_overhead_report();
+    print_latency_report();
 
     cleanup();
     return 0;
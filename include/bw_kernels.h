@@ -0,0 +1,154 @@
+#ifndef BW_KERNELS_H
+#define BW_KERNELS_H
+
+/*
+ * Streaming memory kernels (read, write, copy) with a configurable
+ * intensity, shared by the benchmark and calibration tools.
+ *
+ * The intensity is the share of every BW_KERNEL_SLOT_NS slot spent
+ * streaming; the rest of the slot is slept away.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#define BW_KERNEL_SLOT_NS 1000000ULL      /* 1 ms */
+#define BW_KERNEL_CHUNK_SIZE (64 * 1024)  /* bytes streamed between clock reads */
+
+enum bw_kernel_type {
+    BW_KERNEL_READ,
+    BW_KERNEL_WRITE,
+    BW_KERNEL_COPY,
+};
+
+struct bw_kernel {
+    enum bw_kernel_type type;
+    int intensity;              /* 1-100 % */
+    size_t size;                /* bytes per buffer */
+    uint64_t *src;
+    uint64_t *dst;
+    size_t offset;              /* next chunk */
+
+    uint64_t bytes;             /* bytes moved (read + written) */
+    volatile uint64_t sink;     /* keeps reads alive */
+};
+
+uint64_t bw_kernel__now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+const char* bw_kernel__type_name(enum bw_kernel_type type) {
+    switch (type) {
+    case BW_KERNEL_READ: return "read";
+    case BW_KERNEL_WRITE: return "write";
+    case BW_KERNEL_COPY: return "copy";
+    }
+    return "unknown";
+}
+
+int bw_kernel__parse_type(const char* name, enum bw_kernel_type* type) {
+    if (strcmp(name, "read") == 0) *type = BW_KERNEL_READ;
+    else if (strcmp(name, "write") == 0) *type = BW_KERNEL_WRITE;
+    else if (strcmp(name, "copy") == 0) *type = BW_KERNEL_COPY;
+    else return -1;
+    return 0;
+}
+
+int bw_kernel__init(struct bw_kernel* kernel, enum bw_kernel_type type, size_t size, int intensity) {
+    size_t i;
+
+    memset(kernel, 0, sizeof(*kernel));
+    kernel->type = type;
+    kernel->intensity = intensity < 1 ? 1 : intensity > 100 ? 100 : intensity;
+    kernel->size = size - size % BW_KERNEL_CHUNK_SIZE;
+    if (kernel->size == 0)
+        kernel->size = BW_KERNEL_CHUNK_SIZE;
+
+    if (posix_memalign((void**)&kernel->src, 64, kernel->size) ||
+        posix_memalign((void**)&kernel->dst, 64, kernel->size)) {
+        fprintf(stderr, "Failed to allocate %zu bytes\n", kernel->size);
+        return -1;
+    }
+
+    /* Fault the pages in before measuring */
+    for (i = 0; i < kernel->size / sizeof(uint64_t); i++) {
+        kernel->src[i] = i;
+        kernel->dst[i] = 0;
+    }
+
+    return 0;
+}
+
+void bw_kernel__destroy(struct bw_kernel* kernel) {
+    free(kernel->src);
+    free(kernel->dst);
+    kernel->src = kernel->dst = NULL;
+}
+
+/* Stream one chunk of the buffer(s) */
+void bw_kernel__chunk(struct bw_kernel* kernel) {
+    size_t words = BW_KERNEL_CHUNK_SIZE / sizeof(uint64_t);
+    uint64_t* src = kernel->src + kernel->offset / sizeof(uint64_t);
+    uint64_t* dst = kernel->dst + kernel->offset / sizeof(uint64_t);
+    uint64_t sum = 0;
+    size_t i;
+
+    switch (kernel->type) {
+    case BW_KERNEL_READ:
+        for (i = 0; i < words; i += 4)
+            sum += src[i] + src[i + 1] + src[i + 2] + src[i + 3];
+        kernel->sink += sum;
+        kernel->bytes += BW_KERNEL_CHUNK_SIZE;
+        break;
+    case BW_KERNEL_WRITE:
+        for (i = 0; i < words; i++)
+            dst[i] = i;
+        kernel->bytes += BW_KERNEL_CHUNK_SIZE;
+        break;
+    case BW_KERNEL_COPY:
+        for (i = 0; i < words; i++)
+            dst[i] = src[i];
+        kernel->bytes += 2 * BW_KERNEL_CHUNK_SIZE;
+        break;
+    }
+
+    kernel->offset += BW_KERNEL_CHUNK_SIZE;
+    if (kernel->offset >= kernel->size)
+        kernel->offset = 0;
+}
+
+/* Run for 'duration_ns' (or until '*stop' is set); returns bytes moved */
+uint64_t bw_kernel__run(struct bw_kernel* kernel, uint64_t duration_ns, volatile int* stop) {
+    uint64_t start = bw_kernel__now_ns();
+    uint64_t bytes = kernel->bytes;
+    uint64_t busy_ns = BW_KERNEL_SLOT_NS * kernel->intensity / 100;
+    uint64_t now = start;
+
+    while (now - start < duration_ns && !(stop && *stop)) {
+        uint64_t slot_start = now;
+
+        do {
+            bw_kernel__chunk(kernel);
+            now = bw_kernel__now_ns();
+        } while (now - slot_start < busy_ns);
+
+        if (kernel->intensity < 100) {
+            uint64_t idle_ns = slot_start + BW_KERNEL_SLOT_NS > now ? slot_start + BW_KERNEL_SLOT_NS - now : 0;
+            struct timespec ts = { 0, (long)idle_ns };
+
+            if (idle_ns)
+                nanosleep(&ts, NULL);
+            now = bw_kernel__now_ns();
+        }
+    }
+
+    return kernel->bytes - bytes;
+}
+
+#endif /* BW_KERNELS_H */
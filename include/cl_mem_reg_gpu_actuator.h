@@ -0,0 +1,23 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * GPU actuator interface of the cluster-level memory access regulation module.
+ *
+ * With CPU/GPU sub-budgets and g_gpu_overrun_policy=1, cl_mem_reg does not
+ * stall the cluster's CPUs when the GPU overruns its share. It calls the
+ * registered hook instead (e.g. a module capping the GPU frequency), from the
+ * GPU beats receiver thread (process context), once per GPU sample while the
+ * GPU is over its share.
+ */
+#ifndef CL_MEM_REG_GPU_ACTUATOR_H
+#define CL_MEM_REG_GPU_ACTUATOR_H
+
+#include <linux/types.h>
+
+/* usage and share in LLC events (64 B) of the current regulation period */
+typedef void (*cl_mem_reg_gpu_overrun_fn)(int cluster, s64 usage, s64 share);
+
+/* One hook at a time: -EBUSY if another one is registered */
+int cl_mem_reg_register_gpu_overrun_hook(cl_mem_reg_gpu_overrun_fn fn);
+void cl_mem_reg_unregister_gpu_overrun_hook(cl_mem_reg_gpu_overrun_fn fn);
+
+#endif /* CL_MEM_REG_GPU_ACTUATOR_H */
@@ -0,0 +1,88 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Live statistics page of the cluster-level memory access regulation module.
+ *
+ * /sys/kernel/debug/cl_mem_reg/live maps one read-only page: one entry per
+ * core and per cluster, each on its own cache lines. Each core rewrites its
+ * own entry at every tick, and the cluster leader rewrites the cluster's.
+ * Every entry has a sequence count: odd while it is being written, so
+ * readers retry instead of seeing a torn entry. Counters are cumulative since
+ * the module was loaded; events are LLC events (64 B cache lines). Readers
+ * derive rates from two reads, with no syscall per sample.
+ */
+#ifndef CL_MEM_REG_LIVE_H
+#define CL_MEM_REG_LIVE_H
+
+#include <linux/types.h>
+
+#define CL_MEM_REG_LIVE_MAGIC        0x50524d43 /* "CMRP" */
+#define CL_MEM_REG_LIVE_VERSION      1
+#define CL_MEM_REG_LIVE_MAX_CORES    8
+#define CL_MEM_REG_LIVE_MAX_CLUSTERS 2
+#define CL_MEM_REG_LIVE_SIZE         4096 /* one page */
+
+struct cl_mem_reg_live_core {
+    __u32 seq;
+    __u32 throttled;                /* stalled by its throttle thread now */
+    __u64 ts_ns;                    /* CLOCK_MONOTONIC of the last update */
+    __u64 ticks;
+    __u64 events;
+    __u64 throttle_count;
+    __u64 throttled_ns;
+    __u64 throttle_latency_sum_ns;  /* throttle request -> throttle thread running */
+    __u64 throttle_latency_max_ns;
+    __u64 parked_ns;                /* idle ticking */
+} __attribute__((aligned(64)));
+
+struct cl_mem_reg_live_cluster {
+    __u32 seq;
+    __u32 throttled;                /* throttle requested in the current period */
+    __u64 ts_ns;
+    __u64 cpu_mask;                 /* regulated cores */
+    __u64 budget_events;            /* current period, carry-over included */
+    __u64 usage_events;             /* current period so far */
+    __u64 cpu_events;               /* cumulative */
+    __u64 gpu_events;
+    __u64 periods;
+    __u64 throttled_periods;
+    __u64 throttled_ns;
+    __u64 used_events;              /* at the end of each period, as in stats */
+    __u64 period_budget_events;
+} __attribute__((aligned(64)));
+
+struct cl_mem_reg_live_page {
+    __u32 magic;
+    __u32 version;
+    __u32 nr_cores;
+    __u32 nr_clusters;
+    __u64 regulation_period_ns;
+    __u64 aggregation_period_ns;
+    struct cl_mem_reg_live_cluster cluster[CL_MEM_REG_LIVE_MAX_CLUSTERS];
+    struct cl_mem_reg_live_core core[CL_MEM_REG_LIVE_MAX_CORES];
+};
+
+#ifndef __KERNEL__
+/*
+ * Consistent copy of one entry of the mapped page ('seq' first in every
+ * entry). Returns 0, or -1 if the writer kept it busy.
+ */
+static inline int cl_mem_reg_live__read(const void *entry, void *copy, unsigned long size) {
+    const volatile __u32 *seq = (const volatile __u32 *)entry;
+    int tries;
+
+    for (tries = 0; tries < 1000; tries++) {
+        __u32 start = __atomic_load_n(seq, __ATOMIC_ACQUIRE);
+
+        if (start & 1)
+            continue;
+        __builtin_memcpy(copy, (const void *)entry, size);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(seq, __ATOMIC_RELAXED) == start)
+            return 0;
+    }
+
+    return -1;
+}
+#endif
+
+#endif /* CL_MEM_REG_LIVE_H */
@@ -0,0 +1,168 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Binary log format of the cluster-level memory access regulation module
+ * (g_logging=2), shared by cl_mem_reg.ko and cl_mem_reg_logdump.
+ *
+ * A log file holds one header and then one record per sample: per T_A for
+ * a core log, per GPU sample for a GPU log. A record stores the regulation
+ * period and the timestamp as deltas to the previous record, and every
+ * counter as a LEB128 varint (signed fields zigzag-encoded), so a typical
+ * core record takes 5-8 bytes. All fields are little-endian.
+ */
+#ifndef CL_MEM_REG_LOG_H
+#define CL_MEM_REG_LOG_H
+
+#include <linux/types.h>
+
+#define CL_MEM_REG_LOG_MAGIC        0x4c524d43 /* "CMRL" */
+#define CL_MEM_REG_LOG_VERSION      1
+#define CL_MEM_REG_LOG_MAX_CLUSTERS 2
+#define CL_MEM_REG_LOG_MAX_RECORD   64         /* bytes, worst case of one record */
+
+#define CL_MEM_REG_LOG_CPU 0
+#define CL_MEM_REG_LOG_GPU 1
+
+struct cl_mem_reg_log_header {
+    __u32 magic;
+    __u32 version;
+    __u32 source;                  /* CL_MEM_REG_LOG_CPU or CL_MEM_REG_LOG_GPU */
+    __u32 id;                      /* core, or cluster of a GPU log */
+    __u32 cluster;                 /* cluster of the core or GPU (1-based) */
+    __u32 nr_clusters;
+    __u32 aggregation_period_us;   /* T_A */
+    __u32 regulation_period_us;    /* T_R */
+    __u32 budget_mb[CL_MEM_REG_LOG_MAX_CLUSTERS];
+    __u64 cluster_mask[CL_MEM_REG_LOG_MAX_CLUSTERS]; /* member cores */
+    __u64 start_ns;                /* CLOCK_REALTIME when logging started */
+};
+
+/*
+ * One sample. Events and usage are LLC events; usage is the cluster's CPU
+ * (resp. GPU) usage so far in the period, as in the CSV logs.
+ */
+struct cl_mem_reg_log_record {
+    __u64 period;                  /* regulation period count */
+    __s64 ts_ns;                   /* CLOCK_REALTIME */
+    __u64 events;
+    __s64 usage;
+    __u64 rd_beats;                /* GPU logs only */
+    __u64 wr_beats;
+    int throttled;
+};
+
+/* Delta base: the previous record of the same file, zero before the first */
+struct cl_mem_reg_log_state {
+    __u64 period;
+    __s64 ts_ns;
+};
+
+static inline __u64 cl_mem_reg_log__zigzag(__s64 v) { return ((__u64)v << 1) ^ (__u64)(v >> 63); }
+
+static inline __s64 cl_mem_reg_log__unzigzag(__u64 v) { return (__s64)(v >> 1) ^ -(__s64)(v & 1); }
+
+static inline int cl_mem_reg_log__put_varint(__u8 *p, __u64 v) {
+    int n = 0;
+
+    while (v >= 0x80) {
+        p[n++] = (__u8)v | 0x80;
+        v >>= 7;
+    }
+    p[n++] = (__u8)v;
+
+    return n;
+}
+
+/* Bytes consumed, 0 if the varint runs past 'end' */
+static inline int cl_mem_reg_log__get_varint(const __u8 *p, const __u8 *end, __u64 *v) {
+    __u64 result = 0;
+    int shift = 0, n = 0;
+
+    while (p + n < end && shift < 64) {
+        __u8 byte = p[n++];
+
+        result |= (__u64)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            *v = result;
+            return n;
+        }
+        shift += 7;
+    }
+
+    return 0;
+}
+
+/*
+ * Record layout:
+ *   varint(zigzag(period delta) << 1 | throttled)
+ *   varint(zigzag(timestamp delta ns))
+ *   varint(events)
+ *   varint(zigzag(usage))
+ *   varint(read beats), varint(write beats)      GPU logs only
+ * Returns the record's size (at most CL_MEM_REG_LOG_MAX_RECORD).
+ */
+static inline int cl_mem_reg_log__encode(struct cl_mem_reg_log_state *state, int source,
+                                         const struct cl_mem_reg_log_record *record, __u8 *buf) {
+    int n = 0;
+
+    n += cl_mem_reg_log__put_varint(buf + n, cl_mem_reg_log__zigzag((__s64)(record->period - state->period)) << 1 |
+                                                 (record->throttled ? 1 : 0));
+    n += cl_mem_reg_log__put_varint(buf + n, cl_mem_reg_log__zigzag(record->ts_ns - state->ts_ns));
+    n += cl_mem_reg_log__put_varint(buf + n, record->events);
+    n += cl_mem_reg_log__put_varint(buf + n, cl_mem_reg_log__zigzag(record->usage));
+    if (source == CL_MEM_REG_LOG_GPU) {
+        n += cl_mem_reg_log__put_varint(buf + n, record->rd_beats);
+        n += cl_mem_reg_log__put_varint(buf + n, record->wr_beats);
+    }
+
+    state->period = record->period;
+    state->ts_ns = record->ts_ns;
+
+    return n;
+}
+
+/* Bytes consumed, 0 if the record is cut short by 'end' (the end of a buffer or a truncated file) */
+static inline int cl_mem_reg_log__decode(struct cl_mem_reg_log_state *state, int source, const __u8 *p, const __u8 *end,
+                                         struct cl_mem_reg_log_record *record) {
+    int fields = source == CL_MEM_REG_LOG_GPU ? 6 : 4;
+    __u64 v[6];
+    int i, n = 0, len;
+
+    /* Away from 'end' a whole record is there: no bounds checks */
+    if (end - p >= CL_MEM_REG_LOG_MAX_RECORD) {
+        for (i = 0; i < fields; i++) {
+            __u64 result = 0;
+            int shift = 0;
+            __u8 byte;
+
+            do {
+                byte = p[n++];
+                result |= (__u64)(byte & 0x7f) << shift;
+                shift += 7;
+            } while ((byte & 0x80) && shift < 70);
+            v[i] = result;
+        }
+    }
+    else {
+        for (i = 0; i < fields; i++) {
+            len = cl_mem_reg_log__get_varint(p + n, end, &v[i]);
+            if (!len)
+                return 0;
+            n += len;
+        }
+    }
+
+    record->throttled = v[0] & 1;
+    record->period = state->period + cl_mem_reg_log__unzigzag(v[0] >> 1);
+    record->ts_ns = state->ts_ns + cl_mem_reg_log__unzigzag(v[1]);
+    record->events = v[2];
+    record->usage = cl_mem_reg_log__unzigzag(v[3]);
+    record->rd_beats = fields == 6 ? v[4] : 0;
+    record->wr_beats = fields == 6 ? v[5] : 0;
+
+    state->period = record->period;
+    state->ts_ns = record->ts_ns;
+
+    return n;
+}
+
+#endif /* CL_MEM_REG_LOG_H */
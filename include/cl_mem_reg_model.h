@@ -0,0 +1,184 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Regulation model of the cluster-level memory access regulation module.
+ *
+ * Accounting, budget and throttle decisions shared by cl_mem_reg.ko and the
+ * userspace tools (cl_mem_reg_sim). Keep it free of kernel-only and
+ * libc-only calls.
+ *
+ * Time line of a cluster (T_A: aggregation period, T_R: regulation period):
+ *   tick k of every core fires at start + k * T_A
+ *   tick k with k % interval == 1 starts a regulation period (unthrottle,
+ *   leader resets usage); every other tick is an aggregation tick (add the
+ *   core's events to the cluster usage, throttle the cluster if over budget)
+ */
+#ifndef CL_MEM_REG_MODEL_H
+#define CL_MEM_REG_MODEL_H
+
+#ifdef __KERNEL__
+#include <linux/types.h>
+#include <linux/math64.h>
+#else
+#include <stdint.h>
+typedef uint64_t u64;
+typedef int64_t s64;
+static inline u64 div64_u64(u64 dividend, u64 divisor) { return dividend / divisor; }
+#endif
+
+#define CL_MEM_REG_CACHE_LINE_SIZE 64 /* B, one LLC event */
+#define CL_MEM_REG_GPU_BEAT_SIZE   16 /* B, one GPU bus beat */
+#define CL_MEM_REG_DUTY_FULL       1000 /* duty cycle unit: per mille of T_A */
+
+/* MB/s -> LLC events per regulation period */
+static inline u64 cl_mem_reg_model__mb_to_events(int mb, int regulation_period_us) {
+    return div64_u64((u64)mb * 1024 * 1024,
+                     CL_MEM_REG_CACHE_LINE_SIZE * (1000000 / (u64)regulation_period_us));
+}
+
+/* LLC events per regulation period -> MB/s (rounded up) */
+static inline int cl_mem_reg_model__events_to_mb(u64 events, int regulation_period_us) {
+    u64 divisor = (u64)regulation_period_us * 1024 * 1024;
+
+    return div64_u64(events * CL_MEM_REG_CACHE_LINE_SIZE * 1000000 + (divisor - 1), divisor);
+}
+
+static inline u64 cl_mem_reg_model__bytes_to_events(u64 bytes) {
+    return div64_u64(bytes, CL_MEM_REG_CACHE_LINE_SIZE);
+}
+
+static inline u64 cl_mem_reg_model__gpu_beats_to_events(int rd_beats, int wr_beats) {
+    return cl_mem_reg_model__bytes_to_events((u64)rd_beats * CL_MEM_REG_GPU_BEAT_SIZE +
+                                             (u64)wr_beats * CL_MEM_REG_GPU_BEAT_SIZE);
+}
+
+/*
+ * Weighted accounting: a counted event (core counter, cluster PMU, GPU
+ * beat) stands for some bytes of DRAM traffic. Its cost in LLC events is
+ * kept in fixed point with CL_MEM_REG_COST_SHIFT fractional bits.
+ */
+#define CL_MEM_REG_COST_SHIFT 16
+
+static inline u64 cl_mem_reg_model__cost(u64 bytes) {
+    return div64_u64(bytes << CL_MEM_REG_COST_SHIFT, CL_MEM_REG_CACHE_LINE_SIZE);
+}
+
+/* 'count' events at 'cost' -> LLC events; the fraction left is carried over in '*rem' */
+static inline u64 cl_mem_reg_model__weigh(u64 count, u64 cost, u64 *rem) {
+    u64 scaled = count * cost + *rem;
+
+    *rem = scaled & ((1ULL << CL_MEM_REG_COST_SHIFT) - 1);
+    return scaled >> CL_MEM_REG_COST_SHIFT;
+}
+
+/* Number of aggregation ticks per regulation period: ceil(T_R / T_A) */
+static inline int cl_mem_reg_model__manage_period_interval(int regulation_period_us, int aggregation_period_us) {
+    return (regulation_period_us + aggregation_period_us - 1) / aggregation_period_us;
+}
+
+/* Tick 'cnt' (1-based) starts a regulation period. With T_A >= T_R every tick does. */
+static inline int cl_mem_reg_model__is_regulation_tick(s64 cnt, int interval) {
+    return interval <= 1 || cnt % interval == 1;
+}
+
+/*
+ * Index of the regulation period started by regulation tick 'cnt'. Only
+ * meaningful for regulation ticks: the last tick of period k - 1 also maps
+ * to k.
+ */
+static inline s64 cl_mem_reg_model__regulation_period(s64 cnt, int interval) {
+    return cnt / interval;
+}
+
+/* Throttle the cluster once its usage in the current period exceeds the budget */
+static inline int cl_mem_reg_model__should_throttle(s64 usage, s64 budget) {
+    return usage > budget;
+}
+
+/*
+ * Carry-over: balance (events) after a period that used 'usage' of
+ * 'budget' + 'balance'. Unused budget accumulates as credit up to 'cap';
+ * overshoot is carried as debt, paid back by the next periods. Debt stops
+ * at one period's budget, so traffic that cannot be throttled (GPU) does
+ * not stall the CPUs forever.
+ */
+static inline s64 cl_mem_reg_model__carry_over(s64 balance, s64 usage, s64 budget, s64 cap) {
+    balance += budget - usage;
+
+    if (balance < -budget)
+        return -budget;
+    return balance > cap ? cap : balance;
+}
+
+/*
+ * CPU/GPU sub-budgets: a class is over budget once its usage exceeds its
+ * reservation plus what the other class left of the shared pool.
+ */
+static inline int cl_mem_reg_model__class_over_budget(s64 usage, s64 reservation, s64 other_usage, s64 other_reservation, s64 pool) {
+    s64 other_borrowed = other_usage > other_reservation ? other_usage - other_reservation : 0;
+    s64 pool_left = pool > other_borrowed ? pool - other_borrowed : 0;
+
+    return usage > reservation + pool_left;
+}
+
+/* Position of tick 'cnt' in its regulation period (0: regulation tick) */
+static inline int cl_mem_reg_model__period_position(s64 cnt, int interval) {
+    return interval <= 1 ? 0 : (cnt - 1) % interval;
+}
+
+/*
+ * Adaptive T_A: number of base ticks (T_A) from tick 'cnt' to the core's
+ * next tick. 'rate' is the cluster's usage per base tick. The step spends at
+ * most half of the remaining headroom at that rate, is bounded by
+ * 'max_step', and never crosses the next regulation tick so that every core
+ * still starts each regulation period on time. A cluster that is already
+ * over budget is throttled until then, so it sleeps until the next
+ * regulation tick.
+ */
+static inline int cl_mem_reg_model__aggregation_step(s64 cnt, int interval, s64 usage, s64 budget, s64 rate, int max_step) {
+    int to_regulation = interval - cl_mem_reg_model__period_position(cnt, interval);
+    s64 headroom = budget - usage;
+    s64 step;
+
+    if (interval <= 1 || max_step <= 1)
+        return 1;
+
+    if (headroom <= 0)
+        step = to_regulation;
+    else if (rate <= 0)
+        step = max_step;
+    else
+        step = div64_u64(headroom, 2 * rate);
+
+    if (step > max_step)
+        step = max_step;
+    if (step > to_regulation)
+        step = to_regulation;
+    if (step < 1)
+        step = 1;
+
+    return step;
+}
+
+/*
+ * Duty-cycle throttling: share of the next T_A slot (per mille) a core
+ * stalls so that the 'nr_cores' cores spread the remaining 'headroom' evenly
+ * over the 'slots_left' slots up to the regulation tick. 'rate' is the
+ * core's events per slot while running. A core with no headroom left is
+ * stalled for the whole slot.
+ */
+static inline int cl_mem_reg_model__duty_cycle(s64 headroom, s64 rate, int slots_left, int nr_cores) {
+    s64 allowance;
+
+    if (headroom <= 0)
+        return CL_MEM_REG_DUTY_FULL;
+    if (rate <= 0 || slots_left < 1 || nr_cores < 1)
+        return 0;
+
+    allowance = div64_u64(headroom, (u64)slots_left * nr_cores);
+    if (rate <= allowance)
+        return 0;
+
+    return CL_MEM_REG_DUTY_FULL - div64_u64((u64)allowance * CL_MEM_REG_DUTY_FULL, rate);
+}
+
+#endif /* CL_MEM_REG_MODEL_H */
@@ -0,0 +1,78 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Regulation statistics of the cluster-level memory access regulation module.
+ *
+ * Binary layout of /sys/kernel/debug/cl_mem_reg/stats_bin, shared by the
+ * kernel module and userspace readers. Every counter is a __u64; events are
+ * LLC events (64 B cache lines).
+ */
+#ifndef CL_MEM_REG_STATS_H
+#define CL_MEM_REG_STATS_H
+
+#include <linux/types.h>
+
+#define CL_MEM_REG_STATS_MAGIC        0x434d5253 /* "CMRS" */
+#define CL_MEM_REG_STATS_VERSION      8
+#define CL_MEM_REG_STATS_MAX_CORES    8
+#define CL_MEM_REG_STATS_MAX_CLUSTERS 2
+
+/* per core */
+struct cl_mem_reg_core_stats {
+    __u64 ticks;                   /* regulation timer interrupts */
+    __u64 events;                  /* LLC events consumed by the core */
+    __u64 throttled_periods;       /* regulation periods in which the core was throttled */
+    __u64 throttle_count;          /* throttle episodes */
+    __u64 throttled_ns;            /* time spent in the throttle thread */
+    __u64 throttle_latency_sum_ns; /* throttle request (IPI) -> throttle thread running */
+    __u64 throttle_latency_max_ns;
+    __u64 stall_max_ns;            /* longest single stall */
+    __u64 parks;                   /* idle ticking: timer stopped on an idle tick */
+    __u64 parked_ns;               /* time with the timer stopped */
+};
+
+/* per cluster, accounted by the leader core at the end of each regulation period */
+struct cl_mem_reg_cluster_stats {
+    __u64 periods;                 /* completed regulation periods */
+    __u64 throttled_periods;
+    __u64 throttled_ns;            /* first throttle -> end of period */
+    __u64 cpu_events;              /* sum of the cluster's core events */
+    __u64 gpu_events;              /* events reported by the GPU profiler */
+    __u64 used_events;             /* usage at the end of each period */
+    __u64 budget_events;           /* budget of each period */
+    __u64 overrun_periods;         /* periods that ended over budget */
+    __u64 overshoot_events;        /* usage beyond budget */
+    __u64 overshoot_max_events;
+    __u64 cpu_over_periods;        /* periods the CPUs ended over their sub-budget */
+    __u64 gpu_over_periods;        /* periods the GPU ended over its sub-budget */
+    __u64 credit_periods;          /* periods started with carried-over credit */
+    __u64 debt_periods;            /* periods started with carried-over debt */
+    __u64 throttle_broadcasts;     /* throttle IPIs to the cluster */
+    __u64 duplicate_throttle_requests; /* requests while the cluster was already throttled */
+    __u64 release_skews;           /* period boundaries with a release skew (all cores released) */
+    __u64 release_skew_sum_ns;     /* first -> last core released at a period boundary */
+    __u64 release_skew_max_ns;
+    __u64 idle_periods;            /* periods no core ticked in (idle ticking), included in 'periods' */
+};
+
+/*
+ * 'total' counters are cumulative since the module was loaded. 'window'
+ * counters cover the last completed window of 'window_periods' regulation
+ * periods.
+ */
+struct cl_mem_reg_stats_snapshot {
+    __u32 magic;
+    __u32 version;
+    __u32 nr_cores;
+    __u32 nr_clusters;
+    __u64 timestamp_ns;            /* CLOCK_MONOTONIC */
+    __u64 regulation_period_ns;
+    __u64 window_periods;
+    __u64 cpu_mask;                /* regulated cores */
+
+    struct cl_mem_reg_core_stats core_total[CL_MEM_REG_STATS_MAX_CORES];
+    struct cl_mem_reg_core_stats core_window[CL_MEM_REG_STATS_MAX_CORES];
+    struct cl_mem_reg_cluster_stats cluster_total[CL_MEM_REG_STATS_MAX_CLUSTERS];
+    struct cl_mem_reg_cluster_stats cluster_window[CL_MEM_REG_STATS_MAX_CLUSTERS];
+};
+
+#endif /* CL_MEM_REG_STATS_H */
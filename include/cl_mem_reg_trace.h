@@ -0,0 +1,208 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Tracepoints of the cluster-level memory access regulation module.
+ *
+ * Usage: perf record -e 'cl_mem_reg:*' ..., or
+ *        echo 1 > /sys/kernel/tracing/events/cl_mem_reg/enable
+ *
+ * Usage and budget values are in LLC events per regulation period unless the
+ * field name says otherwise.
+ */
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM cl_mem_reg
+
+#if !defined(_CL_MEM_REG_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _CL_MEM_REG_TRACE_H
+
+#include <linux/tracepoint.h>
+
+/* Start of a regulation period (T_R), emitted by the cluster leader */
+TRACE_EVENT(cl_mem_reg_period_start,
+
+    TP_PROTO(int cluster, u64 period, s64 prev_usage, int budget, int prev_throttled),
+
+    TP_ARGS(cluster, period, prev_usage, budget, prev_throttled),
+
+    TP_STRUCT__entry(
+        __field(int, cluster)
+        __field(u64, period)
+        __field(s64, prev_usage)
+        __field(int, budget)
+        __field(int, prev_throttled)
+    ),
+
+    TP_fast_assign(
+        __entry->cluster = cluster;
+        __entry->period = period;
+        __entry->prev_usage = prev_usage;
+        __entry->budget = budget;
+        __entry->prev_throttled = prev_throttled;
+    ),
+
+    TP_printk("cluster=%d period=%llu prev_usage=%lld budget=%d prev_throttled=%d",
+              __entry->cluster, __entry->period, __entry->prev_usage,
+              __entry->budget, __entry->prev_throttled)
+);
+
+/* CPU sample of an aggregation period (T_A) */
+TRACE_EVENT(cl_mem_reg_aggregation,
+
+    TP_PROTO(int cpu, int cluster, s64 events, s64 usage, int budget),
+
+    TP_ARGS(cpu, cluster, events, usage, budget),
+
+    TP_STRUCT__entry(
+        __field(int, cpu)
+        __field(int, cluster)
+        __field(s64, events)
+        __field(s64, usage)
+        __field(int, budget)
+    ),
+
+    TP_fast_assign(
+        __entry->cpu = cpu;
+        __entry->cluster = cluster;
+        __entry->events = events;
+        __entry->usage = usage;
+        __entry->budget = budget;
+    ),
+
+    TP_printk("cpu=%d cluster=%d events=%lld usage=%lld budget=%d",
+              __entry->cpu, __entry->cluster, __entry->events,
+              __entry->usage, __entry->budget)
+);
+
+/* A core starts being throttled */
+TRACE_EVENT(cl_mem_reg_throttle_begin,
+
+    TP_PROTO(int cpu, int cluster, s64 usage, int budget),
+
+    TP_ARGS(cpu, cluster, usage, budget),
+
+    TP_STRUCT__entry(
+        __field(int, cpu)
+        __field(int, cluster)
+        __field(s64, usage)
+        __field(int, budget)
+    ),
+
+    TP_fast_assign(
+        __entry->cpu = cpu;
+        __entry->cluster = cluster;
+        __entry->usage = usage;
+        __entry->budget = budget;
+    ),
+
+    TP_printk("cpu=%d cluster=%d usage=%lld budget=%d",
+              __entry->cpu, __entry->cluster, __entry->usage, __entry->budget)
+);
+
+/* A core is released by the throttle thread */
+TRACE_EVENT(cl_mem_reg_throttle_end,
+
+    TP_PROTO(int cpu, int cluster, s64 duration_ns),
+
+    TP_ARGS(cpu, cluster, duration_ns),
+
+    TP_STRUCT__entry(
+        __field(int, cpu)
+        __field(int, cluster)
+        __field(s64, duration_ns)
+    ),
+
+    TP_fast_assign(
+        __entry->cpu = cpu;
+        __entry->cluster = cluster;
+        __entry->duration_ns = duration_ns;
+    ),
+
+    TP_printk("cpu=%d cluster=%d duration_ns=%lld",
+              __entry->cpu, __entry->cluster, __entry->duration_ns)
+);
+
+/* GPU beats received from the GPU profiler */
+TRACE_EVENT(cl_mem_reg_gpu_beats,
+
+    TP_PROTO(int cluster, int rd_beats, int wr_beats, s64 events, s64 usage),
+
+    TP_ARGS(cluster, rd_beats, wr_beats, events, usage),
+
+    TP_STRUCT__entry(
+        __field(int, cluster)
+        __field(int, rd_beats)
+        __field(int, wr_beats)
+        __field(s64, events)
+        __field(s64, usage)
+    ),
+
+    TP_fast_assign(
+        __entry->cluster = cluster;
+        __entry->rd_beats = rd_beats;
+        __entry->wr_beats = wr_beats;
+        __entry->events = events;
+        __entry->usage = usage;
+    ),
+
+    TP_printk("cluster=%d rd_beats=%d wr_beats=%d events=%lld usage=%lld",
+              __entry->cluster, __entry->rd_beats, __entry->wr_beats,
+              __entry->events, __entry->usage)
+);
+
+/* GPU usage went over its sub-budget; policy is g_gpu_overrun_policy */
+TRACE_EVENT(cl_mem_reg_gpu_overrun,
+
+    TP_PROTO(int cluster, s64 usage, s64 share, int policy),
+
+    TP_ARGS(cluster, usage, share, policy),
+
+    TP_STRUCT__entry(
+        __field(int, cluster)
+        __field(s64, usage)
+        __field(s64, share)
+        __field(int, policy)
+    ),
+
+    TP_fast_assign(
+        __entry->cluster = cluster;
+        __entry->usage = usage;
+        __entry->share = share;
+        __entry->policy = policy;
+    ),
+
+    TP_printk("cluster=%d usage=%lld share=%lld policy=%d",
+              __entry->cluster, __entry->usage, __entry->share, __entry->policy)
+);
+
+/* Bandwidth budget of a cluster changed at runtime */
+TRACE_EVENT(cl_mem_reg_budget_change,
+
+    TP_PROTO(int cluster, int old_mb, int new_mb, int budget),
+
+    TP_ARGS(cluster, old_mb, new_mb, budget),
+
+    TP_STRUCT__entry(
+        __field(int, cluster)
+        __field(int, old_mb)
+        __field(int, new_mb)
+        __field(int, budget)
+    ),
+
+    TP_fast_assign(
+        __entry->cluster = cluster;
+        __entry->old_mb = old_mb;
+        __entry->new_mb = new_mb;
+        __entry->budget = budget;
+    ),
+
+    TP_printk("cluster=%d old_mb=%d new_mb=%d budget=%d",
+              __entry->cluster, __entry->old_mb, __entry->new_mb, __entry->budget)
+);
+
+#endif /* _CL_MEM_REG_TRACE_H */
+
+/* This part must be outside protection */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE cl_mem_reg_trace
+#include <trace/define_trace.h>
@@ -7,12 +7,36 @@ source ./cl_mem_reg.conf
 # Default values
 BANDWIDTH_BUDGET_CL1=${BANDWIDTH_BUDGET_CL1:--1}
 BANDWIDTH_BUDGET_CL2=${BANDWIDTH_BUDGET_CL2:--1}
+SYSTEM_BUDGET=${SYSTEM_BUDGET:--1}
+CLUSTER_MIN_CL1=${CLUSTER_MIN_CL1:-0}
+CLUSTER_MIN_CL2=${CLUSTER_MIN_CL2:-0}
+DEMAND_EWMA_SHIFT=${DEMAND_EWMA_SHIFT:-2}
+CARRY_OVER=${CARRY_OVER:-0}
+BURST_CAP_PCT=${BURST_CAP_PCT:-100}
+CPU_RESERVATION_CL1=${CPU_RESERVATION_CL1:--1}
+GPU_RESERVATION_CL1=${GPU_RESERVATION_CL1:--1}
+CPU_RESERVATION_CL2=${CPU_RESERVATION_CL2:--1}
+GPU_RESERVATION_CL2=${GPU_RESERVATION_CL2:--1}
+GPU_OVERRUN_POLICY=${GPU_OVERRUN_POLICY:-1}
 GPU_CL1=${GPU_CL1:-0}
 GPU_CL2=${GPU_CL2:-1}
 GPU_PROFILING_CORE_CL1=${GPU_PROFILING_CORE_CL1:-3}
 GPU_PROFILING_CORE_CL2=${GPU_PROFILING_CORE_CL2:-7}
+GPU_PROFILER_CORE=${GPU_PROFILER_CORE:--1}
 REGULATION_PERIOD=${REGULATION_PERIOD:-5300}
 AGGREGATION_PERIOD=${AGGREGATION_PERIOD:-100}
+AGGREGATION_PERIOD_MAX=${AGGREGATION_PERIOD_MAX:--1}
+NOHZ_IDLE=${NOHZ_IDLE:-0}
+COST_TABLE=${COST_TABLE:-}
+COUNTER_SOURCE=${COUNTER_SOURCE:-auto}
+THROTTLE_POLICY=${THROTTLE_POLICY:-0}
+THROTTLE_MODE=${THROTTLE_MODE:-0}
+COORDINATED_REGULATION=${COORDINATED_REGULATION:-1}
+EXEMPT_CPUS=${EXEMPT_CPUS:-0x0}
+CLUSTER_PMU_TYPE_CL1=${CLUSTER_PMU_TYPE_CL1:--1}
+CLUSTER_PMU_CONFIG_CL1=${CLUSTER_PMU_CONFIG_CL1:-0}
+CLUSTER_PMU_TYPE_CL2=${CLUSTER_PMU_TYPE_CL2:--1}
+CLUSTER_PMU_CONFIG_CL2=${CLUSTER_PMU_CONFIG_CL2:-0}
 LOGGING=${LOGGING:-1}
 # ==================================================
 
@@ -25,12 +49,19 @@ if [ "$BANDWIDTH_BUDGET_CL2" -eq -1 ]; then
     BANDWIDTH_BUDGET_CL2=204800
 fi
 
-# === GPU - Cluster 1 ===
+# Adaptive aggregation period
+if [ "$AGGREGATION_PERIOD_MAX" -eq -1 ]; then
+    ADAPTIVE_AGGREGATION=0
+    AGGREGATION_PERIOD_MAX=$AGGREGATION_PERIOD
+else
+    ADAPTIVE_AGGREGATION=1
+fi
+
+# === GPU profiler (one daemon serves every cluster) ===
+GPU_PROFILER_TARGETS=""
 
 if [ "$GPU_CL1" -eq 0 ] || [ "$GPU_CL1" -eq 1 ]; then
-    TARGET_CLUSTER=1
-    taskset -c $GPU_PROFILING_CORE_CL1 ./gpu_profiler $TARGET_CLUSTER $GPU_CL1 &
-    sleep 1
+    GPU_PROFILER_TARGETS="$GPU_PROFILER_TARGETS 1:$GPU_CL1"
 elif [ "$GPU_CL1" -eq -1 ]; then
     GPU_PROFILING_CORE_CL1=-1
     GPU_PROFILER_PID_CL1=-1
@@ -39,12 +70,8 @@ else
     exit
 fi
 
-# === GPU - Cluster 2 ===
-
 if [ "$GPU_CL2" -eq 0 ] || [ "$GPU_CL2" -eq 1 ]; then
-    TARGET_CLUSTER=2
-    taskset -c $GPU_PROFILING_CORE_CL2 ./gpu_profiler $TARGET_CLUSTER $GPU_CL2 &
-    sleep 1
+    GPU_PROFILER_TARGETS="$GPU_PROFILER_TARGETS 2:$GPU_CL2"
 elif [ "$GPU_CL2" -eq -1 ]; then
     GPU_PROFILING_CORE_CL2=-1
     GPU_PROFILER_PID_CL2=-1
@@ -53,28 +80,52 @@ else
     exit
 fi
 
+if [ "$GPU_PROFILER_CORE" -lt 0 ]; then
+    if [ "$GPU_PROFILING_CORE_CL1" -ge 0 ]; then
+        GPU_PROFILER_CORE=$GPU_PROFILING_CORE_CL1
+    else
+        GPU_PROFILER_CORE=$GPU_PROFILING_CORE_CL2
+    fi
+fi
+
+if [ -n "$GPU_PROFILER_TARGETS" ]; then
+    rm -f /tmp/gpu_profiler_pid
+    taskset -c $GPU_PROFILER_CORE ./gpu_profiler $GPU_PROFILER_TARGETS &
+    sleep 1
+fi
+
 echo 25 > /proc/sys/kernel/perf_cpu_time_max_percent
 echo 100000 > /proc/sys/kernel/perf_event_max_sample_rate
 echo 0 > /proc/sys/kernel/perf_cpu_time_max_percent
 
-# Read the PID from the /tmp/gpu_profiler_pid_cl1 file
-if [ "$GPU_PROFILING_CORE_CL1" -ge 0 ]; then    
-    if [ -f /tmp/gpu_profiler_pid_cl1 ]; then
-        GPU_PROFILER_PID_CL1=$(cat /tmp/gpu_profiler_pid_cl1)
+# Read the PID from the /tmp/gpu_profiler_pid file
+if [ -n "$GPU_PROFILER_TARGETS" ]; then
+    if [ -f /tmp/gpu_profiler_pid ]; then
+        GPU_PROFILER_PID=$(cat /tmp/gpu_profiler_pid)
     else
-        echo "Error: /tmp/gpu_profiler_pid_cl1 file not found."
+        echo "Error: /tmp/gpu_profiler_pid file not found."
         exit 1
     fi
 fi
 
-# Read the PID from the /tmp/gpu_profiler_pid_cl2 file
-if [ "$GPU_PROFILING_CORE_CL2" -ge 0 ]; then    
-    if [ -f /tmp/gpu_profiler_pid_cl2 ]; then
-        GPU_PROFILER_PID_CL2=$(cat /tmp/gpu_profiler_pid_cl2)
-    else
-        echo "Error: /tmp/gpu_profiler_pid_cl2 file not found."
-        exit 1
-    fi
+if [ "$GPU_PROFILING_CORE_CL1" -ge 0 ]; then
+    GPU_PROFILER_PID_CL1=$GPU_PROFILER_PID
+fi
+
+if [ "$GPU_PROFILING_CORE_CL2" -ge 0 ]; then
+    GPU_PROFILER_PID_CL2=$GPU_PROFILER_PID
+fi
+
+LONG_WINDOW_PARAMS=
+if [ -n "$LONG_WINDOWS_MS" ]; then
+    LONG_WINDOW_PARAMS="g_long_window_ms=$LONG_WINDOWS_MS"
+    [ -n "$LONG_WINDOW_BUDGETS_CL1" ] && LONG_WINDOW_PARAMS="$LONG_WINDOW_PARAMS g_long_window_budget_cl1=$LONG_WINDOW_BUDGETS_CL1"
+    [ -n "$LONG_WINDOW_BUDGETS_CL2" ] && LONG_WINDOW_PARAMS="$LONG_WINDOW_PARAMS g_long_window_budget_cl2=$LONG_WINDOW_BUDGETS_CL2"
+fi
+
+CRITICAL_CGROUP_PARAM=
+if [ -n "$CRITICAL_CGROUP" ]; then
+    CRITICAL_CGROUP_PARAM="g_critical_cgroup=$CRITICAL_CGROUP"
 fi
 
 # Remove remain log files
@@ -93,15 +144,50 @@ sleep 1
 insmod cl_mem_reg.ko \
     g_bandwidth_budget_cl1=$BANDWIDTH_BUDGET_CL1 \
     g_bandwidth_budget_cl2=$BANDWIDTH_BUDGET_CL2 \
+    g_system_budget=$SYSTEM_BUDGET \
+    g_cluster_min_cl1=$CLUSTER_MIN_CL1 \
+    g_cluster_min_cl2=$CLUSTER_MIN_CL2 \
+    g_demand_ewma_shift=$DEMAND_EWMA_SHIFT \
+    g_carry_over=$CARRY_OVER \
+    g_burst_cap_pct=$BURST_CAP_PCT \
+    $LONG_WINDOW_PARAMS \
+    g_cpu_reservation_cl1=$CPU_RESERVATION_CL1 \
+    g_gpu_reservation_cl1=$GPU_RESERVATION_CL1 \
+    g_cpu_reservation_cl2=$CPU_RESERVATION_CL2 \
+    g_gpu_reservation_cl2=$GPU_RESERVATION_CL2 \
+    g_gpu_overrun_policy=$GPU_OVERRUN_POLICY \
     g_gpu_profiling_core_cl1=$GPU_PROFILING_CORE_CL1 \
     g_gpu_profiling_core_cl2=$GPU_PROFILING_CORE_CL2 \
     g_gpu_profiler_pid_cl1=$GPU_PROFILER_PID_CL1 \
     g_gpu_profiler_pid_cl2=$GPU_PROFILER_PID_CL2 \
     g_regulation_period_us=$REGULATION_PERIOD \
     g_aggregation_period_us=$AGGREGATION_PERIOD \
+    g_adaptive_aggregation=$ADAPTIVE_AGGREGATION \
+    g_aggregation_period_max_us=$AGGREGATION_PERIOD_MAX \
+    g_nohz_idle=$NOHZ_IDLE \
+    g_counter_source=$COUNTER_SOURCE \
+    g_throttle_policy=$THROTTLE_POLICY \
+    g_throttle_mode=$THROTTLE_MODE \
+    g_coordinated_regulation=$COORDINATED_REGULATION \
+    g_exempt_cpus=$EXEMPT_CPUS \
+    $CRITICAL_CGROUP_PARAM \
+    g_cluster_pmu_type_cl1=$CLUSTER_PMU_TYPE_CL1 \
+    g_cluster_pmu_config_cl1=$CLUSTER_PMU_CONFIG_CL1 \
+    g_cluster_pmu_type_cl2=$CLUSTER_PMU_TYPE_CL2 \
+    g_cluster_pmu_config_cl2=$CLUSTER_PMU_CONFIG_CL2 \
     g_logging=$LOGGING
 
 sleep 1
 
+# Per-cgroup budgets
+for cgroup_budget in $CGROUP_BUDGETS; do
+    echo "${cgroup_budget%:*} ${cgroup_budget##*:}" > /sys/kernel/debug/cl_mem_reg/cgroups
+done
+
+# Bytes per counted event
+for cost in $COST_TABLE; do
+    echo "${cost//:/ }" > /sys/kernel/debug/cl_mem_reg/cost_table
+done
+
 cat /sys/kernel/debug/cl_mem_reg/config
 cat /sys/kernel/debug/cl_mem_reg/config > /tmp/cl_mem_reg_config.txt